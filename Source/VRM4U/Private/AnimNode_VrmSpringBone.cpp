@@ -32,6 +32,8 @@ SOFTWARE.
 #include "AnimNode_VrmSpringBone.h"
 #include "AnimationRuntime.h"
 #include "Animation/AnimInstanceProxy.h"
+#include "Animation/AnimInstance.h"
+#include "Engine/World.h"
 #include "Kismet/KismetSystemLibrary.h"
 #include "SceneInterface.h"
 #include "DrawDebugHelpers.h"
@@ -42,11 +44,18 @@ SOFTWARE.
 #include "VrmUtil.h"
 
 #include "VrmSpringBone.h"
+#include "VRM4U_SpringBudgetSubsystem.h"
+#include "VRM4U_SpringCrowdSubsystem.h"
+
+#include "GameFramework/PlayerController.h"
+#include "Camera/PlayerCameraManager.h"
 
 #include <algorithm>
 /////////////////////////////////////////////////////
 // FAnimNode_ModifyBone
 
+FVrmSpringLODSelector FAnimNode_VrmSpringBone::SpringLODSelector;
+
 FAnimNode_VrmSpringBone::FAnimNode_VrmSpringBone()
 {
 	NoWindBoneNameList = TArray<FName>{
@@ -68,10 +77,46 @@ bool FAnimNode_VrmSpringBone::IsSpringInit() const {
 	}
 	return false;
 }
+
+void FAnimNode_VrmSpringBone::WaitSpringTask() const {
+	if (SpringTask.IsValid() && SpringTask->IsComplete() == false) {
+		FTaskGraphInterface::Get().WaitUntilTaskCompletes(SpringTask);
+	}
+	if (SpringCrowd && SpringManager.IsValid()) {
+		SpringCrowd->Retire(SpringManager.Get());
+	}
+}
+
+bool FAnimNode_VrmSpringBone::SaveSpringState(TArray<uint8>& OutData) const {
+	WaitSpringTask();
+	OutData.Reset();
+	if (SpringManager.Get()) {
+		return SpringManager->saveState(OutData);
+	}
+	return false;
+}
+
+void FAnimNode_VrmSpringBone::RestoreSpringState(const TArray<uint8>& Data) {
+	PendingSpringState = Data;
+}
+
+void FAnimNode_VrmSpringBone::WarmStart(int32 Steps) {
+	PendingWarmStartSteps = FMath::Max(PendingWarmStartSteps, Steps);
+}
+
+void FAnimNode_VrmSpringBone::RefreshJointOverrides() {
+	bJointOverridesDirty = true;
+}
 void FAnimNode_VrmSpringBone::Initialize_AnyThread(const FAnimationInitializeContext& Context) {
 
 	Super::Initialize_AnyThread(Context);
 
+	WaitSpringTask();
+	SpringTask = nullptr;
+	FixedStepAccumulator = 0.f;
+	bFixedStepPrimed = false;
+	BudgetSkippedTime = 0.f;
+
 	if (Context.AnimInstanceProxy == nullptr) return;
 
 #if UE_VERSION_OLDER_THAN(5,7,0)
@@ -119,6 +164,8 @@ void FAnimNode_VrmSpringBone::Initialize_AnyThread_local(const FAnimationInitial
 		AlphaBoolBlend.Reinitialize();
 		AlphaScaleBiasClamp.Reinitialize();
 	}
+	WaitSpringTask();
+	SpringTask = nullptr;
 	if (SpringManager.Get()) {
 		SpringManager.Get()->reset();
 	}
@@ -136,12 +183,19 @@ void FAnimNode_VrmSpringBone::Initialize_AnyThread_local(const FAnimationInitial
 
 void FAnimNode_VrmSpringBone::CacheBones_AnyThread(const FAnimationCacheBonesContext& Context) {
 	Super::CacheBones_AnyThread(Context);
+
+	// required bones changed (LOD etc). rebuild bone indices of the spring chains
+	WaitSpringTask();
+	if (SpringManager.Get() && SpringManager->bInit) {
+		SpringManager->compileBones(Context.AnimInstanceProxy->GetRequiredBones());
+	}
 }
 
 #if	UE_VERSION_OLDER_THAN(4,20,0)
 #else
 void FAnimNode_VrmSpringBone::ResetDynamics(ETeleportType InTeleportType) {
 	Super::ResetDynamics(InTeleportType);
+	WaitSpringTask();
 	if (SpringManager.Get()){
 		bool bReset = true;
 		if (InTeleportType == ETeleportType::TeleportPhysics) {
@@ -151,6 +205,9 @@ void FAnimNode_VrmSpringBone::ResetDynamics(ETeleportType InTeleportType) {
 		}
 		if (bReset) {
 			SpringManager.Get()->reset();
+			FixedStepAccumulator = 0.f;
+			BudgetSkippedTime = 0.f;
+			PendingWarmStartSteps = WarmStartSteps;
 		}
 	}
 }
@@ -162,6 +219,119 @@ void FAnimNode_VrmSpringBone::UpdateInternal(const FAnimationUpdateContext& Cont
 	CurrentDeltaTime = Context.GetDeltaTime();
 }
 
+void FAnimNode_VrmSpringBone::PreUpdate(const UAnimInstance* InAnimInstance) {
+	Super::PreUpdate(InAnimInstance);
+
+	const USkeletalMeshComponent* SkelComp = InAnimInstance ? InAnimInstance->GetSkelMeshComponent() : nullptr;
+	SampleWind(SkelComp);
+	SelectSpringLOD(SkelComp);
+	UpdateSpringBudget(SkelComp);
+
+	// kept after bCrowdEvaluation is turned off, for the job submitted last
+	SpringCrowd = UVRM4U_SpringCrowdSubsystem::Get();
+}
+
+void FAnimNode_VrmSpringBone::UpdateSpringBudget(const USkeletalMeshComponent* SkelComp) {
+	// game thread only
+	SpringBudget = UVRM4U_SpringBudgetSubsystem::Get();
+	if (SpringBudget == nullptr || SpringManager.IsValid() == false) {
+		return;
+	}
+	SpringBudget->BeginFrame();
+
+	if (bEnableSpringLOD && SpringLOD == EVRMSpringLOD::VRMSL_Frozen) {
+		// no cost this frame
+		return;
+	}
+	SpringManager->BudgetActiveFrame = GFrameCounter;
+
+	float Significance = SpringBudgetPriority;
+	if (SpringBudget->IsBudgetEnabled() && SkelComp) {
+		Significance *= SkelComp->WasRecentlyRendered() ? CalcScreenSize(SkelComp) : 0.01f;
+	}
+	// keep above zero. skipped frames multiply it
+	SpringManager->BudgetSignificance = FMath::Max(Significance, 0.001f);
+}
+
+void FAnimNode_VrmSpringBone::SampleWind(const USkeletalMeshComponent* SkelComp) {
+	// game thread only. spring groups and substeps reuse this
+	WindSnapshot.bValid = false;
+	if (bIgnoreWindDirectionalSource || SkelComp == nullptr) {
+		return;
+	}
+	const UWorld* World = SkelComp->GetWorld();
+	if (World == nullptr || World->Scene == nullptr) {
+		return;
+	}
+
+	// Unused by our simulation but needed for the call to GetWindParameters below
+	float WindMinGust;
+	float WindMaxGust;
+	FVector WindDirection;
+	float WindSpeed;
+	World->Scene->GetWindParameters_GameThread(SkelComp->GetComponentTransform().GetLocation(), WindDirection, WindSpeed, WindMinGust, WindMaxGust);
+
+	WindSnapshot.Direction = SkelComp->GetComponentTransform().Inverse().TransformVector(WindDirection);
+	WindSnapshot.Speed = WindSpeed;
+	WindSnapshot.bValid = true;
+}
+
+void FAnimNode_VrmSpringBone::SelectSpringLOD(const USkeletalMeshComponent* SkelComp) {
+	// game thread only
+	if (bEnableSpringLOD == false || SkelComp == nullptr) {
+		SpringLOD = EVRMSpringLOD::VRMSL_Full;
+		return;
+	}
+
+	if (SpringLODSelector.IsBound()) {
+		const int32 lod = SpringLODSelector.Execute(SkelComp);
+		if (lod != INDEX_NONE) {
+			SpringLOD = (EVRMSpringLOD)FMath::Clamp(lod, 0, (int32)EVRMSpringLOD::VRMSL_Frozen);
+			return;
+		}
+	}
+
+	// same as bRecentlyRendered
+	if (bLODFreezeWhenNotRendered && SkelComp->WasRecentlyRendered() == false) {
+		SpringLOD = EVRMSpringLOD::VRMSL_Frozen;
+		return;
+	}
+
+	const float ScreenSize = CalcScreenSize(SkelComp);
+
+	auto tierFor = [&](float scale) {
+		if (ScreenSize < LODScreenSizeFrozen * scale) return EVRMSpringLOD::VRMSL_Frozen;
+		if (ScreenSize < LODScreenSizeFirstJoints * scale) return EVRMSpringLOD::VRMSL_FirstJoints;
+		if (ScreenSize < LODScreenSizeReducedSubsteps * scale) return EVRMSpringLOD::VRMSL_ReducedSubsteps;
+		return EVRMSpringLOD::VRMSL_Full;
+	};
+
+	// hysteresis. go coarser below threshold * (1-h), finer above threshold * (1+h)
+	const EVRMSpringLOD coarser = tierFor(1.f - LODHysteresis);
+	const EVRMSpringLOD finer = tierFor(1.f + LODHysteresis);
+	if (coarser > SpringLOD) {
+		SpringLOD = coarser;
+	} else if (finer < SpringLOD) {
+		SpringLOD = finer;
+	}
+}
+
+float FAnimNode_VrmSpringBone::CalcScreenSize(const USkeletalMeshComponent* SkelComp) const {
+	// bounds radius / view distance from the first local player. 1 without a player camera
+	float ScreenSize = 1.f;
+	const UWorld* World = SkelComp->GetWorld();
+	const APlayerController* PC = World ? World->GetFirstPlayerController() : nullptr;
+	if (PC && PC->PlayerCameraManager) {
+		const FVector ViewLocation = PC->PlayerCameraManager->GetCameraLocation();
+		const float HalfFOV = FMath::DegreesToRadians(PC->PlayerCameraManager->GetFOVAngle() * 0.5f);
+		const float Div = (float)FVector::Dist(SkelComp->Bounds.Origin, ViewLocation) * FMath::Tan(HalfFOV);
+		if (Div > 1.f) {
+			ScreenSize = (float)SkelComp->Bounds.SphereRadius / Div;
+		}
+	}
+	return ScreenSize;
+}
+
 
 void FAnimNode_VrmSpringBone::GatherDebugData(FNodeDebugData& DebugData)
 {
@@ -200,9 +370,12 @@ void FAnimNode_VrmSpringBone::EvaluateComponentPose_AnyThread(FComponentSpacePos
 
 void FAnimNode_VrmSpringBone::EvaluateSkeletalControl_AnyThread(FComponentSpacePoseContext& Output, TArray<FBoneTransform>& OutBoneTransforms)
 {
+	TRACE_CPUPROFILER_EVENT_SCOPE(VRM4USpring_Evaluate);
+	SCOPE_CYCLE_COUNTER(STAT_VRM4USpring_Evaluate);
+	INC_DWORD_STAT(STAT_VRM4USpring_Nodes);
+
 	check(OutBoneTransforms.Num() == 0);
 
-	const auto RefSkeleton = Output.AnimInstanceProxy->GetSkeleton()->GetReferenceSkeleton();
 	const FTransform ComponentTransform = Output.AnimInstanceProxy->GetComponentTransform();
 
 	//dstRefSkeleton.GetParentIndex
@@ -238,14 +411,176 @@ void FAnimNode_VrmSpringBone::EvaluateSkeletalControl_AnyThread(FComponentSpaceP
 				}
 				return;
 			}
+			// the task reads the pose fetched last frame and writes the joints
+			WaitSpringTask();
+
 			if (SpringManager->bInit == false) {
 				SpringManager->init(VrmMetaObject_Internal.Get(), Output);
+				SpringManager->compileJointParams(JointOverrides, NoWindBoneNameList);
+				bJointOverridesDirty = false;
+				FixedStepAccumulator = 0.f;
+				bFixedStepPrimed = false;
+				bHasSpringResult = false;
+				PendingWarmStartSteps = FMath::Max(PendingWarmStartSteps, WarmStartSteps);
 				return;
 			}
 
-			SpringManager->update(this, CurrentDeltaTime, Output, OutBoneTransforms);
+			if (bJointOverridesDirty) {
+				SpringManager->compileJointParams(JointOverrides, NoWindBoneNameList);
+				bJointOverridesDirty = false;
+			}
+
+			if (PendingSpringState.Num() > 0) {
+				if (SpringManager->loadState(PendingSpringState, Output.AnimInstanceProxy->GetComponentTransform())) {
+					bHasSpringResult = true;
+					PendingWarmStartSteps = 0;
+				}
+				PendingSpringState.Reset();
+			}
+			if (PendingWarmStartSteps > 0) {
+				// settle with the current pose
+				const float StepTime = 1.f / FMath::Max(1.f, fixedStepRate);
+				SpringManager->OutputAlpha = 1.f;
+				for (int32 i = 0; i < PendingWarmStartSteps; ++i) {
+					SpringManager->update(this, StepTime, Output, OutBoneTransforms);
+				}
+				PendingWarmStartSteps = 0;
+				bHasSpringResult = true;
+			}
+
+			const EVRMSpringLOD lod = bEnableSpringLOD ? SpringLOD : EVRMSpringLOD::VRMSL_Full;
+			const bool bInputPose = (lod == EVRMSpringLOD::VRMSL_Frozen) && bLODFrozenUsesInputPose;
+			const float blendStep = (LODBlendTime > 0.f) ? CurrentDeltaTime / LODBlendTime : 1.f;
+
+			if (lod != AppliedSpringLOD) {
+				const bool bWasOff = (AppliedSpringLOD == EVRMSpringLOD::VRMSL_Frozen) && bLODFrozenUsesInputPose;
+				AppliedSpringLOD = lod;
+				if (bWasOff) {
+					// start again from rest. LODWeight fades the result in
+					SpringManager->reset();
+					FixedStepAccumulator = 0.f;
+					bFixedStepPrimed = false;
+					bHasSpringResult = false;
+					PendingWarmStartSteps = WarmStartSteps;
+					if (SpringManager->bInit == false) {
+						return;
+					}
+				} else if (bInputPose == false) {
+					SpringManager->beginLODBlend();
+				}
+			}
+			SpringManager->LODBlendAlpha = FMath::Min(1.f, SpringManager->LODBlendAlpha + blendStep);
+			LODWeight = bInputPose ? FMath::Max(0.f, LODWeight - blendStep) : FMath::Min(1.f, LODWeight + blendStep);
+			if (LODWeight <= 0.f) {
+				// input pose only
+				return;
+			}
+
+			SpringManager->LODLoopCount = (lod >= EVRMSpringLOD::VRMSL_ReducedSubsteps) ? FMath::Max(1, LODReducedLoopCount) : MAX_int32;
+			SpringManager->LODLevelNum = (lod >= EVRMSpringLOD::VRMSL_FirstJoints) ? FMath::Max(1, LODFirstJointCount) : MAX_int32;
+
+			// Frozen keeps the last result. simulate once if there is none yet
+			bool bSimulate = (lod != EVRMSpringLOD::VRMSL_Frozen || bHasSpringResult == false);
+
+			// over the frame budget. keep the last result and catch up the time on the next update
+			bool bBudgetUpdate = false;
+			if (bSimulate && SpringBudget) {
+				bBudgetUpdate = SpringManager->bBudgetGranted && SpringBudget->TryBeginUpdate(SpringManager.Get());
+				if (bBudgetUpdate == false) {
+					BudgetSkippedTime += CurrentDeltaTime;
+					bSimulate = false;
+				}
+			}
+			const bool bDecimated = bSimulate && BudgetSkippedTime > 0.f;
+			// budget catch up. one long verlet step tunnels through colliders, drop what the fixed step would drop
+			const float MaxCatchUpTime = FMath::Max(1, maxFixedSteps) / FMath::Max(1.f, fixedStepRate);
+			const float StepDeltaTime = bSimulate ? CurrentDeltaTime + FMath::Min(BudgetSkippedTime, MaxCatchUpTime) : 0.f;
+			const double BudgetStartTime = bBudgetUpdate ? FPlatformTime::Seconds() : 0.0;
+
+			// world collision reads physics bodies on the anim thread only
+			const bool bCrowd = bCrowdEvaluation && SpringCrowd && bIgnorePhysicsCollision;
+			const bool bPipelined = (bPipelinedEvaluation || bCrowd) && bIgnorePhysicsCollision;
+			if (bPipelined) {
+				// result of the task or the crowd batch launched after the last evaluate
+				SpringManager->applyToComponent(Output, OutBoneTransforms);
+			}
+
+			if (bSimulate) {
+				bHasSpringResult = true;
+				BudgetSkippedTime = 0.f;
+
+				float StepTime = StepDeltaTime;
+				int32 StepCount = 1;
+				if (bFixedTimestep == false) {
+					SpringManager->OutputAlpha = 1.f;
+				} else {
+					StepTime = 1.f / FMath::Max(1.f, fixedStepRate);
+					const int32 MaxSteps = FMath::Max(1, maxFixedSteps);
+
+					FixedStepAccumulator += FMath::Max(0.f, StepDeltaTime);
+					StepCount = FMath::FloorToInt(FixedStepAccumulator / StepTime);
+					if (StepCount > MaxSteps) {
+						// hitch. drop the time we can not catch up
+						StepCount = MaxSteps;
+						FixedStepAccumulator = StepTime * MaxSteps;
+					}
+					if (bFixedStepPrimed == false) {
+						// no previous step to blend from
+						StepCount = FMath::Max(StepCount, 1);
+					}
+					FixedStepAccumulator = FMath::Max(0.f, FixedStepAccumulator - StepTime * StepCount);
+
+					SpringManager->OutputAlpha = 1.f;
+					if (bInterpolateFixedStep && bFixedStepPrimed) {
+						SpringManager->OutputAlpha = FMath::Clamp(FixedStepAccumulator / StepTime, 0.f, 1.f);
+					}
+					bFixedStepPrimed = true;
+				}
+
+				if (bPipelined) {
+					if (StepCount > 0 && bCrowd) {
+						const VRMSpringBone::VRMSpringSimParams Params(this);
+						SpringManager->fetchPose(Params, Output);
+
+						// EndUpdate is called by the batch
+						SpringCrowd->Submit(SpringManager, Params, StepTime, StepCount, bBudgetUpdate ? SpringBudget : nullptr, bDecimated);
+						bBudgetUpdate = false;
+					} else if (StepCount > 0) {
+						// params are copied, the task does not read this node. the task function is allocated per update
+						const VRMSpringBone::VRMSpringSimParams Params(this);
+						SpringManager->fetchPose(Params, Output);
+
+						TSharedPtr<VRMSpringBone::VRMSpringManagerBase> Manager = SpringManager;
+						UVRM4U_SpringBudgetSubsystem* Budget = bBudgetUpdate ? SpringBudget : nullptr;
+						SpringTask = FFunctionGraphTask::CreateAndDispatchWhenReady([Manager, Params, StepTime, StepCount, Budget, bDecimated]() {
+							TRACE_CPUPROFILER_EVENT_SCOPE(VRM4USpring_PipelinedTask);
+							const double StartTime = FPlatformTime::Seconds();
+							for (int32 i = 0; i < StepCount; ++i) {
+								Manager->simulateFetched(Params, StepTime);
+							}
+							if (Budget) {
+								Budget->EndUpdate(Manager.Get(), FPlatformTime::Seconds() - StartTime, bDecimated);
+							}
+						}, TStatId(), nullptr, ENamedThreads::AnyBackgroundThreadNormalTask);
+						// EndUpdate is called by the task
+						bBudgetUpdate = false;
+					}
+				} else {
+					for (int32 i = 0; i < StepCount; ++i) {
+						SpringManager->update(this, StepTime, Output, OutBoneTransforms);
+					}
+				}
+			}
+			if (bBudgetUpdate) {
+				SpringBudget->EndUpdate(SpringManager.Get(), FPlatformTime::Seconds() - BudgetStartTime, bDecimated);
+			}
+
+			if (bPipelined == false) {
+				SpringManager->applyToComponent(Output, OutBoneTransforms);
+			}
 
-			SpringManager->applyToComponent(Output, OutBoneTransforms);
+			// fades the spring result against the input pose
+			ActualAlpha *= LODWeight;
 
 		}
 	}
@@ -0,0 +1,233 @@
+// VRM4U Copyright (c) 2021-2024 Haruyoshi Yamamoto. This software is released under the MIT License.
+
+
+#include "VRM4U_SpringBudgetSubsystem.h"
+#include "VrmSpringBone.h"
+#include "VRM4U.h"
+#include "Engine/Engine.h"
+#include "HAL/IConsoleManager.h"
+
+namespace {
+	void LogSpringBudgetStats(const TCHAR* Label, const FVrmSpringBudgetStats& s) {
+		UE_LOG(LogVRM4U, Log, TEXT("[VRM4U SpringBone] budget %s: registered=%d updated=%d skipped=%d overrun=%d decimated=%d joints=%d time=%.3fms"),
+			Label, s.Registered, s.Updated, s.Skipped, s.Overrun, s.Decimated, s.SimulatedJoints, s.TimeMs);
+	}
+
+	FAutoConsoleCommand CmdSpringBudgetStats(
+		TEXT("vrm4u.SpringBudget.Stats"),
+		TEXT("Log spring bone budget stats of the last frame and in total."),
+		FConsoleCommandDelegate::CreateLambda([]() {
+			if (auto* Budget = UVRM4U_SpringBudgetSubsystem::Get()) {
+				LogSpringBudgetStats(TEXT("last frame"), Budget->GetLastFrameStats());
+				LogSpringBudgetStats(TEXT("total"), Budget->GetTotalStats());
+			}
+		})
+	);
+
+	FAutoConsoleCommand CmdSpringBudgetTop(
+		TEXT("vrm4u.SpringBudget.Top"),
+		TEXT("Log spring bone managers by update time. vrm4u.SpringBudget.Top [Num=10]"),
+		FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args) {
+			if (auto* Budget = UVRM4U_SpringBudgetSubsystem::Get()) {
+				Budget->LogTopManagers(Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 10);
+			}
+		})
+	);
+
+	FAutoConsoleCommand CmdSpringBudgetSet(
+		TEXT("vrm4u.SpringBudget.Set"),
+		TEXT("Set spring bone budget per frame. vrm4u.SpringBudget.Set <MaxJoints> <MaxTimeMs>. 0 is unlimited."),
+		FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args) {
+			if (auto* Budget = UVRM4U_SpringBudgetSubsystem::Get()) {
+				if (Args.Num() > 0) {
+					Budget->MaxJointsPerFrame = FCString::Atoi(*Args[0]);
+				}
+				if (Args.Num() > 1) {
+					Budget->MaxTimeMsPerFrame = FCString::Atof(*Args[1]);
+				}
+				UE_LOG(LogVRM4U, Log, TEXT("[VRM4U SpringBone] budget: joints=%d time=%.3fms"), Budget->MaxJointsPerFrame, Budget->MaxTimeMsPerFrame);
+			}
+		})
+	);
+}
+
+UVRM4U_SpringBudgetSubsystem* UVRM4U_SpringBudgetSubsystem::Get() {
+	if (GEngine == nullptr) {
+		return nullptr;
+	}
+	return GEngine->GetEngineSubsystem<UVRM4U_SpringBudgetSubsystem>();
+}
+
+FVrmSpringBudgetStats UVRM4U_SpringBudgetSubsystem::GetLastFrameStats() {
+	FScopeLock Lock(&cs);
+	return LastFrameStats;
+}
+
+FVrmSpringBudgetStats UVRM4U_SpringBudgetSubsystem::GetTotalStats() {
+	FScopeLock Lock(&cs);
+	FVrmSpringBudgetStats s = TotalStats;
+	s.Registered = Managers.Num();
+	return s;
+}
+
+void UVRM4U_SpringBudgetSubsystem::ResetStats() {
+	FScopeLock Lock(&cs);
+	TotalStats = FVrmSpringBudgetStats();
+}
+
+void UVRM4U_SpringBudgetSubsystem::LogTopManagers(int32 Num) {
+	FScopeLock Lock(&cs);
+
+	TArray<VRMSpringBone::VRMSpringManagerBase*> Order = Managers;
+	Order.Sort([](const VRMSpringBone::VRMSpringManagerBase& a, const VRMSpringBone::VRMSpringManagerBase& b) {
+		return a.BudgetCostSeconds > b.BudgetCostSeconds;
+	});
+	for (int32 i = 0; i < FMath::Min(Num, Order.Num()); ++i) {
+		const auto* m = Order[i];
+		UE_LOG(LogVRM4U, Log, TEXT("[VRM4U SpringBone] %d: %s joints=%d time=%.3fms skipped=%d"),
+			i, m->skeletalMesh ? *m->skeletalMesh->GetName() : TEXT("none"), m->getJointNum(), m->BudgetCostSeconds * 1000.0, m->BudgetSkippedFrames);
+	}
+}
+
+void UVRM4U_SpringBudgetSubsystem::Register(VRMSpringBone::VRMSpringManagerBase* Manager) {
+	FScopeLock Lock(&cs);
+	Managers.AddUnique(Manager);
+}
+
+void UVRM4U_SpringBudgetSubsystem::Unregister(VRMSpringBone::VRMSpringManagerBase* Manager) {
+	FScopeLock Lock(&cs);
+	Managers.RemoveSwap(Manager);
+}
+
+void UVRM4U_SpringBudgetSubsystem::Deinitialize() {
+	FScopeLock Lock(&cs);
+	Managers.Empty();
+	Super::Deinitialize();
+}
+
+double UVRM4U_SpringBudgetSubsystem::GetExpectedSeconds(const VRMSpringBone::VRMSpringManagerBase* Manager) const {
+	if (Manager->BudgetCostSeconds > 0.0) {
+		return Manager->BudgetCostSeconds;
+	}
+	return Manager->getJointNum() * SecondsPerJoint;
+}
+
+void UVRM4U_SpringBudgetSubsystem::BeginFrame() {
+	FScopeLock Lock(&cs);
+	if (PlannedFrame == GFrameCounter) {
+		return;
+	}
+	PlannedFrame = GFrameCounter;
+
+	FrameStats.Registered = Managers.Num();
+	LastFrameStats = FrameStats;
+	TotalStats.Updated += FrameStats.Updated;
+	TotalStats.Skipped += FrameStats.Skipped;
+	TotalStats.Overrun += FrameStats.Overrun;
+	TotalStats.Decimated += FrameStats.Decimated;
+	TotalStats.SimulatedJoints += FrameStats.SimulatedJoints;
+	TotalStats.TimeMs += FrameStats.TimeMs;
+	FrameStats = FVrmSpringBudgetStats();
+	FrameSeconds = 0.0;
+
+	if (IsBudgetEnabled() == false) {
+		for (auto* m : Managers) {
+			m->bBudgetGranted = true;
+			m->BudgetSkippedFrames = 0;
+		}
+		return;
+	}
+
+	// managers simulated last frame. others are checked on the worker only
+	TArray<VRMSpringBone::VRMSpringManagerBase*> Order;
+	Order.Reserve(Managers.Num());
+	for (auto* m : Managers) {
+		m->bBudgetGranted = true;
+		if (m->bInit && m->BudgetActiveFrame + 1 >= GFrameCounter) {
+			Order.Add(m);
+		}
+	}
+
+	// skipped frames raise the order, so lower ones are updated in turn at a reduced rate
+	Order.Sort([](const VRMSpringBone::VRMSpringManagerBase& a, const VRMSpringBone::VRMSpringManagerBase& b) {
+		return a.BudgetSignificance * (1 + a.BudgetSkippedFrames) > b.BudgetSignificance * (1 + b.BudgetSkippedFrames);
+	});
+
+	const double MaxSeconds = MaxTimeMsPerFrame * 0.001;
+	int32 Joints = 0;
+	double Seconds = 0.0;
+	for (auto* m : Order) {
+		const int32 j = m->getJointNum();
+		bool bGrant = true;
+		if (MaxJointsPerFrame > 0 && Joints + j > MaxJointsPerFrame) {
+			bGrant = false;
+		}
+		const double Expected = GetExpectedSeconds(m);
+		if (MaxTimeMsPerFrame > 0.f && Seconds + Expected > MaxSeconds) {
+			bGrant = false;
+		}
+
+		m->bBudgetGranted = bGrant;
+		if (bGrant) {
+			Joints += j;
+			Seconds += Expected;
+		} else {
+			m->BudgetSkippedFrames++;
+			FrameStats.Skipped++;
+		}
+	}
+}
+
+bool UVRM4U_SpringBudgetSubsystem::TryBeginUpdate(VRMSpringBone::VRMSpringManagerBase* Manager) {
+	FScopeLock Lock(&cs);
+
+	// workers run in parallel. reserve the joints and the expected time before the update
+	const int32 j = Manager->getJointNum();
+	const double Expected = GetExpectedSeconds(Manager);
+	if (IsBudgetEnabled()) {
+		const bool bJointOver = MaxJointsPerFrame > 0 && FrameStats.SimulatedJoints + j > MaxJointsPerFrame;
+		const bool bTimeOver = MaxTimeMsPerFrame > 0.f && FrameSeconds + Expected > MaxTimeMsPerFrame * 0.001;
+		if (bJointOver || bTimeOver) {
+			Manager->BudgetSkippedFrames++;
+			FrameStats.Overrun++;
+			return false;
+		}
+	}
+	FrameStats.SimulatedJoints += j;
+	FrameSeconds += Expected;
+	Manager->BudgetReservedFrame = PlannedFrame;
+	Manager->BudgetReservedSeconds = Expected;
+	return true;
+}
+
+void UVRM4U_SpringBudgetSubsystem::EndUpdate(VRMSpringBone::VRMSpringManagerBase* Manager, double Seconds, bool bDecimated) {
+	FScopeLock Lock(&cs);
+
+	const int32 j = Manager->getJointNum();
+	if (j > 0) {
+		SecondsPerJoint = FMath::Lerp(SecondsPerJoint, Seconds / j, 0.05);
+	}
+	Manager->BudgetCostSeconds = (Manager->BudgetCostSeconds > 0.0) ? FMath::Lerp(Manager->BudgetCostSeconds, Seconds, 0.2) : Seconds;
+	Manager->BudgetSkippedFrames = 0;
+
+	auto AddStats = [&](FVrmSpringBudgetStats& s) {
+		s.Updated++;
+		s.TimeMs += (float)(Seconds * 1000.0);
+		if (bDecimated) {
+			s.Decimated++;
+		}
+	};
+
+	if (Manager->BudgetReservedFrame == PlannedFrame) {
+		// replace the reservation with the measured time
+		FrameSeconds += Seconds - Manager->BudgetReservedSeconds;
+		AddStats(FrameStats);
+	} else {
+		// pipelined task or crowd batch finished after the next BeginFrame. its frame is closed already
+		if (Manager->BudgetReservedFrame + 1 == PlannedFrame) {
+			AddStats(LastFrameStats);
+		}
+		AddStats(TotalStats);
+	}
+	Manager->BudgetReservedSeconds = 0.0;
+}
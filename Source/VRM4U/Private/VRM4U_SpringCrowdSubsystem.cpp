@@ -0,0 +1,290 @@
+// VRM4U Copyright (c) 2021-2024 Haruyoshi Yamamoto. This software is released under the MIT License.
+
+
+#include "VRM4U_SpringCrowdSubsystem.h"
+#include "VRM4U_SpringBudgetSubsystem.h"
+#include "VrmSpringBone.h"
+#include "VRM4U.h"
+#include "Engine/Engine.h"
+#include "Misc/CoreDelegates.h"
+#include "HAL/IConsoleManager.h"
+#include "Async/ParallelFor.h"
+#include "Async/TaskGraphInterfaces.h"
+
+class FVrmSpringCrowdQueue {
+public:
+	struct FJob {
+		TSharedPtr<VRMSpringBone::VRMSpringManagerBase> Manager;
+		VRMSpringBone::VRMSpringSimParams Params;
+		float StepTime = 0.f;
+		int32 StepCount = 0;
+		UVRM4U_SpringBudgetSubsystem* Budget = nullptr;
+		bool bDecimated = false;
+	};
+
+	FCriticalSection cs;
+	TArray<FJob> Pending;
+	// jobs of the last launched batch. swapped with Pending, so both keep their memory
+	TArray<FJob> Solving;
+	// last launched batch. batches run in launch order
+	FGraphEventRef SolveEvent;
+	// batch of each launched manager. removed by Retire once done
+	TMap<const VRMSpringBone::VRMSpringManagerBase*, FGraphEventRef> Launched;
+	FVrmSpringCrowdStats LastStats;
+
+	// joints of one pass of all characters. the next pass is written while the last one is finished, so two of them.
+	// only the solve task touches these
+	VRMSpringBone::VRMSpringJointSoA JointSoA[2];
+	TArray<int32> Base[2];
+	// per job. pass count of the current step, and time and integrated joints of the batch
+	TArray<int32> PassNum;
+	TArray<double> JobSeconds;
+	TArray<int32> JobJoints;
+
+	// joints of a pass are split into items of this size
+	static constexpr int32 IntegrateChunk = 1024;
+
+	void Solve(TArray<FJob>& Jobs) {
+		TRACE_CPUPROFILER_EVENT_SCOPE(VRM4USpring_CrowdBatch);
+		SCOPE_CYCLE_COUNTER(STAT_VRM4USpring_CrowdBatch);
+		const double StartTime = FPlatformTime::Seconds();
+
+		const int32 JobNum = Jobs.Num();
+		PassNum.SetNumUninitialized(JobNum);
+		Base[0].SetNumUninitialized(JobNum);
+		Base[1].SetNumUninitialized(JobNum);
+		JobSeconds.Reset();
+		JobSeconds.AddZeroed(JobNum);
+		JobJoints.Reset();
+		JobJoints.AddZeroed(JobNum);
+
+		int32 StepNum = 0;
+		for (const auto& job : Jobs) {
+			StepNum = FMath::Max(StepNum, job.StepCount);
+		}
+
+		double IntegrateSeconds = 0.0;
+		int32 IntegratedJoints = 0;
+		int32 MaxPassJoints = 0;
+
+		for (int32 step = 0; step < StepNum; ++step) {
+			// one character per item. a manager without passes is simulated here
+			ParallelFor(JobNum, [&](int32 i) {
+				auto& job = Jobs[i];
+				PassNum[i] = 0;
+				if (step >= job.StepCount) {
+					return;
+				}
+				const double JobStartTime = FPlatformTime::Seconds();
+				PassNum[i] = job.Manager->beginCrowdStep(job.Params, job.StepTime);
+				JobSeconds[i] += FPlatformTime::Seconds() - JobStartTime;
+			});
+
+			int32 MaxPassNum = 0;
+			for (int32 n : PassNum) {
+				MaxPassNum = FMath::Max(MaxPassNum, n);
+			}
+
+			// pass n of all characters is packed and integrated in one loop. joints of a pass depend only on the earlier passes
+			for (int32 pass = 0; pass <= MaxPassNum; ++pass) {
+				const int32 Cur = pass & 1;
+				const int32 Prev = Cur ^ 1;
+
+				int32 Total = 0;
+				if (pass < MaxPassNum) {
+					for (int32 i = 0; i < JobNum; ++i) {
+						Base[Cur][i] = Total;
+						if (pass < PassNum[i]) {
+							const int32 num = Jobs[i].Manager->getCrowdPassJointNum(pass);
+							Total += num;
+							JobJoints[i] += num;
+						}
+					}
+					if (JointSoA[Cur].Length.Num() < Total) {
+						JointSoA[Cur].SetNum(Total);
+					}
+				}
+
+				// finish the last pass and prepare this one. per character, so the solver state needs no lock
+				ParallelFor(JobNum, [&](int32 i) {
+					auto& job = Jobs[i];
+					const double JobStartTime = FPlatformTime::Seconds();
+					if (pass > 0 && pass - 1 < PassNum[i]) {
+						job.Manager->finishCrowdPass(job.Params, pass - 1, JointSoA[Prev], Base[Prev][i]);
+					}
+					if (pass < PassNum[i]) {
+						job.Manager->prepareCrowdPass(job.Params, pass, JointSoA[Cur], Base[Cur][i]);
+					}
+					JobSeconds[i] += FPlatformTime::Seconds() - JobStartTime;
+				});
+
+				if (Total == 0) {
+					continue;
+				}
+				const double IntegrateStartTime = FPlatformTime::Seconds();
+				{
+					SCOPE_CYCLE_COUNTER(STAT_VRM4USpring_Integrate);
+					const int32 ChunkNum = FMath::DivideAndRoundUp(Total, IntegrateChunk);
+					ParallelFor(ChunkNum, [&](int32 c) {
+						JointSoA[Cur].Integrate(c * IntegrateChunk, FMath::Min(Total, (c + 1) * IntegrateChunk));
+					}, ChunkNum < 2);
+				}
+				IntegrateSeconds += FPlatformTime::Seconds() - IntegrateStartTime;
+				IntegratedJoints += Total;
+				MaxPassJoints = FMath::Max(MaxPassJoints, Total);
+			}
+		}
+
+		// the shared loops are charged by the joints of each character
+		for (int32 i = 0; i < JobNum; ++i) {
+			const auto& job = Jobs[i];
+			if (job.Budget) {
+				const double Shared = (IntegratedJoints > 0) ? IntegrateSeconds * JobJoints[i] / IntegratedJoints : 0.0;
+				job.Budget->EndUpdate(job.Manager.Get(), JobSeconds[i] + Shared, job.bDecimated);
+			}
+		}
+
+		FScopeLock Lock(&cs);
+		LastStats.Characters = JobNum;
+		LastStats.PackedJoints = MaxPassJoints;
+		LastStats.TimeMs = (float)((FPlatformTime::Seconds() - StartTime) * 1000.0);
+	}
+};
+
+namespace {
+	FAutoConsoleCommand CmdSpringCrowdStats(
+		TEXT("vrm4u.SpringCrowd.Stats"),
+		TEXT("Log spring bone crowd stats of the last batch."),
+		FConsoleCommandDelegate::CreateLambda([]() {
+			if (auto* Crowd = UVRM4U_SpringCrowdSubsystem::Get()) {
+				const FVrmSpringCrowdStats s = Crowd->GetLastBatchStats();
+				UE_LOG(LogVRM4U, Log, TEXT("[VRM4U SpringBone] crowd: characters=%d joints=%d time=%.3fms"), s.Characters, s.PackedJoints, s.TimeMs);
+			}
+		})
+	);
+}
+
+UVRM4U_SpringCrowdSubsystem* UVRM4U_SpringCrowdSubsystem::Get() {
+	if (GEngine == nullptr) {
+		return nullptr;
+	}
+	return GEngine->GetEngineSubsystem<UVRM4U_SpringCrowdSubsystem>();
+}
+
+FVrmSpringCrowdStats UVRM4U_SpringCrowdSubsystem::GetLastBatchStats() const {
+	if (Queue.IsValid() == false) {
+		return FVrmSpringCrowdStats();
+	}
+	FScopeLock Lock(&Queue->cs);
+	return Queue->LastStats;
+}
+
+void UVRM4U_SpringCrowdSubsystem::Initialize(FSubsystemCollectionBase& Collection) {
+	Super::Initialize(Collection);
+	Queue = MakeShared<FVrmSpringCrowdQueue>();
+
+	// all anim evaluation of the last frame is done here. nodes which evaluate late still get their job into the batch
+	BeginFrameHandle = FCoreDelegates::OnBeginFrame.AddUObject(this, &UVRM4U_SpringCrowdSubsystem::BeginFrame);
+}
+
+void UVRM4U_SpringCrowdSubsystem::Deinitialize() {
+	FCoreDelegates::OnBeginFrame.Remove(BeginFrameHandle);
+	if (Queue.IsValid()) {
+		Retire(nullptr);
+		FScopeLock Lock(&Queue->cs);
+		Queue->Pending.Empty();
+		Queue->Solving.Empty();
+	}
+	Queue.Reset();
+	Super::Deinitialize();
+}
+
+void UVRM4U_SpringCrowdSubsystem::BeginFrame() {
+	if (Queue.IsValid() == false) {
+		return;
+	}
+
+	// the shared joint buffer and Solving are used by one batch at a time.
+	// nodes of the last frame waited for it already, unless none of them was evaluated
+	FGraphEventRef LastEvent;
+	{
+		FScopeLock Lock(&Queue->cs);
+		LastEvent = Queue->SolveEvent;
+	}
+	if (LastEvent.IsValid() && LastEvent->IsComplete() == false) {
+		FTaskGraphInterface::Get().WaitUntilTaskCompletes(LastEvent);
+	}
+
+	// hold the lock until the batch is in Launched, so that Retire always sees it
+	FScopeLock Lock(&Queue->cs);
+	if (Queue->Pending.Num() == 0) {
+		return;
+	}
+
+	// the task only reads Solving, so the jobs need no copy
+	Swap(Queue->Pending, Queue->Solving);
+	Queue->Pending.Reset();
+
+	// the function of the task is still allocated once per batch
+	TSharedPtr<FVrmSpringCrowdQueue> Q = Queue;
+	Queue->SolveEvent = FFunctionGraphTask::CreateAndDispatchWhenReady([Q]() {
+		Q->Solve(Q->Solving);
+	}, TStatId(), nullptr, ENamedThreads::AnyHiPriThreadHiPriTask);
+
+	for (const auto& Job : Queue->Solving) {
+		Queue->Launched.Add(Job.Manager.Get(), Queue->SolveEvent);
+	}
+}
+
+void UVRM4U_SpringCrowdSubsystem::Submit(const TSharedPtr<VRMSpringBone::VRMSpringManagerBase>& Manager, const VRMSpringBone::VRMSpringSimParams& Params,
+	float StepTime, int32 StepCount, UVRM4U_SpringBudgetSubsystem* Budget, bool bDecimated) {
+	if (Queue.IsValid() == false || Manager.IsValid() == false) {
+		return;
+	}
+
+	FScopeLock Lock(&Queue->cs);
+	FVrmSpringCrowdQueue::FJob* Job = Queue->Pending.FindByPredicate([&](const FVrmSpringCrowdQueue::FJob& j) {
+		return j.Manager == Manager;
+	});
+	if (Job == nullptr) {
+		Job = &Queue->Pending.AddDefaulted_GetRef();
+		Job->Manager = Manager;
+	}
+	Job->Params = Params;
+	Job->StepTime = StepTime;
+	Job->StepCount = StepCount;
+	Job->Budget = Budget;
+	Job->bDecimated = bDecimated;
+}
+
+void UVRM4U_SpringCrowdSubsystem::Retire(const VRMSpringBone::VRMSpringManagerBase* Manager) {
+	if (Queue.IsValid() == false) {
+		return;
+	}
+
+	FGraphEventRef Event;
+	{
+		FScopeLock Lock(&Queue->cs);
+		if (Manager == nullptr) {
+			Event = Queue->SolveEvent;
+		} else if (const FGraphEventRef* Found = Queue->Launched.Find(Manager)) {
+			Event = *Found;
+		}
+	}
+	if (Event.IsValid() == false) {
+		return;
+	}
+	if (Event->IsComplete() == false) {
+		FTaskGraphInterface::Get().WaitUntilTaskCompletes(Event);
+	}
+
+	FScopeLock Lock(&Queue->cs);
+	if (Manager == nullptr) {
+		Queue->Launched.Empty();
+	} else {
+		const FGraphEventRef* Found = Queue->Launched.Find(Manager);
+		if (Found && *Found == Event) {
+			Queue->Launched.Remove(Manager);
+		}
+	}
+}
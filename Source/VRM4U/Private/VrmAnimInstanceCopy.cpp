@@ -450,6 +450,15 @@ void FVrmAnimInstanceCopyProxy::UpdateAnimationNode(const FAnimationUpdateContex
 }
 #endif
 
+void FVrmAnimInstanceCopyProxy::PreUpdate(UAnimInstance* InAnimInstance, float DeltaSeconds) {
+	Super::PreUpdate(InAnimInstance, DeltaSeconds);
+
+	// spring node is evaluated by hand. sample wind here on game thread
+	if (Node_SpringBone.Get()) {
+		Node_SpringBone->PreUpdate(InAnimInstance);
+	}
+}
+
 /////
 
 UVrmAnimInstanceCopy::UVrmAnimInstanceCopy(const FObjectInitializer& ObjectInitializer)
@@ -583,6 +592,7 @@ void UVrmAnimInstanceCopy::SetVrmSpringBoneIgnoreWingBone(const TArray<FName> &b
 	if (a == nullptr) return;
 
 	a->NoWindBoneNameList = boneNameList;
+	a->RefreshJointOverrides();
 }
 
 
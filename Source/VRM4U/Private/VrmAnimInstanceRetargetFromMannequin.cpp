@@ -301,6 +301,10 @@ void FVrmAnimInstanceRetargetFromMannequinProxy::UpdateAnimationNode(const FAnim
 void FVrmAnimInstanceRetargetFromMannequinProxy::PreUpdate(UAnimInstance* InAnimInstance, float DeltaSeconds) {
 	Super::PreUpdate(InAnimInstance, DeltaSeconds);
 
+	// spring node is evaluated by hand. sample wind here on game thread
+	if (Node_SpringBone.Get()) {
+		Node_SpringBone->PreUpdate(InAnimInstance);
+	}
 
 	if (Node_Retarget.Get()) {
 		auto node = Node_Retarget.Get();
@@ -448,6 +452,7 @@ void UVrmAnimInstanceRetargetFromMannequin::SetVrmSpringBoneIgnoreWingBone(const
 	if (a == nullptr) return;
 
 	a->NoWindBoneNameList = boneNameList;
+	a->RefreshJointOverrides();
 }
 
 
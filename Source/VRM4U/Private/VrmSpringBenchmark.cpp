@@ -0,0 +1,525 @@
+// VRM4U Copyright (c) 2021-2024 Haruyoshi Yamamoto. This software is released under the MIT License.
+
+#include "VrmSpringBone.h"
+#include "VRM4U.h"
+#include "Engine/SkeletalMesh.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+#include "HAL/PlatformTLS.h"
+#include "HAL/MemoryBase.h"
+#include "Misc/EngineVersionComparison.h"
+#include "Misc/Parse.h"
+
+// spring solver benchmark without world, mesh or anim instance.
+// runs headless, e.g. UnrealEditor-Cmd <project> -nullrhi -ExecCmds="vrm4u.SpringBone.Benchmark; quit"
+//
+// topologies are built here like buildTopology() builds them from the meta, and the managers are set up by initTopology().
+// only what init/compileBones/fetchPose read from the pose is filled by hand.
+
+namespace {
+
+	const float BenchmarkBoneLength = 5.f;
+	const float BenchmarkFrameTime = 1.f / 60.f;
+	// tails must stay on the sphere of bone length around the head
+	const float BenchmarkLengthTolerance = 0.01f;
+
+	struct FSpringBenchmarkMotion {
+		TArray<FTransform> Root;
+		TArray<FTransform> Head;
+	};
+
+	// forwards every FMalloc call to the allocator it replaces, and counts allocations of one thread.
+	// other threads keep using it while installed, so trim, TLS cache and stats calls must reach Inner too
+	class FSpringBenchmarkMallocCounter final : public FMalloc {
+	public:
+		FMalloc* Inner = nullptr;
+		uint32 ThreadId = 0;
+		int32 Num = 0;
+
+		virtual void* Malloc(SIZE_T Count, uint32 Alignment) override {
+			Add();
+			return Inner->Malloc(Count, Alignment);
+		}
+		virtual void* Realloc(void* Original, SIZE_T Count, uint32 Alignment) override {
+			if (Count > 0) {
+				Add();
+			}
+			return Inner->Realloc(Original, Count, Alignment);
+		}
+		virtual void Free(void* Original) override {
+			Inner->Free(Original);
+		}
+		virtual SIZE_T QuantizeSize(SIZE_T Count, uint32 Alignment) override {
+			return Inner->QuantizeSize(Count, Alignment);
+		}
+		virtual bool GetAllocationSize(void* Original, SIZE_T& SizeOut) override {
+			return Inner->GetAllocationSize(Original, SizeOut);
+		}
+		virtual bool IsInternallyThreadSafe() const override {
+			return Inner->IsInternallyThreadSafe();
+		}
+		virtual const TCHAR* GetDescriptiveName() override {
+			return Inner->GetDescriptiveName();
+		}
+#if	UE_VERSION_OLDER_THAN(4,24,0)
+		virtual void Trim() override {
+			Inner->Trim();
+		}
+#else
+		virtual void Trim(bool bTrimThreadCaches) override {
+			Inner->Trim(bTrimThreadCaches);
+		}
+#endif
+		virtual void SetupTLSCachesOnCurrentThread() override {
+			Inner->SetupTLSCachesOnCurrentThread();
+		}
+		virtual void ClearAndDisableTLSCachesOnCurrentThread() override {
+			Inner->ClearAndDisableTLSCachesOnCurrentThread();
+		}
+#if	UE_VERSION_OLDER_THAN(5,1,0)
+#else
+		virtual void MarkTLSCachesAsUsedOnCurrentThread() override {
+			Inner->MarkTLSCachesAsUsedOnCurrentThread();
+		}
+		virtual void MarkTLSCachesAsUnusedOnCurrentThread() override {
+			Inner->MarkTLSCachesAsUnusedOnCurrentThread();
+		}
+#endif
+		virtual void UpdateStats() override {
+			Inner->UpdateStats();
+		}
+		virtual void GetAllocatorStats(FGenericMemoryStats& out_Stats) override {
+			Inner->GetAllocatorStats(out_Stats);
+		}
+		virtual void DumpAllocatorStats(class FOutputDevice& Ar) override {
+			Inner->DumpAllocatorStats(Ar);
+		}
+		virtual bool ValidateHeap() override {
+			return Inner->ValidateHeap();
+		}
+#if	UE_VERSION_OLDER_THAN(5,0,0)
+		virtual bool Exec(UWorld* InWorld, const TCHAR* Cmd, FOutputDevice& Ar) override {
+			return Inner->Exec(InWorld, Cmd, Ar);
+		}
+#endif
+
+	private:
+		void Add() {
+			if (FPlatformTLS::GetCurrentThreadId() == ThreadId) {
+				++Num;
+			}
+		}
+	};
+
+	// allocations of this thread while in scope. the solver steady state must not allocate.
+	// stat collection (stat VRM4USpring etc.) allocates its messages, run without it
+	class FSpringBenchmarkAllocScope {
+	public:
+		FSpringBenchmarkAllocScope() {
+			// other threads may still hold the pointer after the scope. never destroyed
+			static FSpringBenchmarkMallocCounter* Instance = new FSpringBenchmarkMallocCounter();
+			Counter = Instance;
+			Counter->Inner = GMalloc;
+			Counter->ThreadId = FPlatformTLS::GetCurrentThreadId();
+			Counter->Num = 0;
+			GMalloc = Counter;
+		}
+		~FSpringBenchmarkAllocScope() {
+			GMalloc = Counter->Inner;
+		}
+		int32 GetNum() const {
+			return Counter->Num;
+		}
+
+	private:
+		FSpringBenchmarkMallocCounter* Counter = nullptr;
+	};
+
+	struct FSpringBenchmarkResult {
+		double Seconds = 0.0;
+		// allocations after the first frame
+		int32 Allocations = 0;
+		// same input gives same tails. changes here mean the solver result changed
+		double Checksum = 0.0;
+		int32 JointNum = 0;
+		float MaxLengthError = 0.f;
+		bool bFinite = true;
+
+		void AddTail(const FVector& Head, const FVector& Tail, float Length) {
+			Checksum += Tail.X + Tail.Y + Tail.Z;
+			if (Tail.ContainsNaN()) {
+				bFinite = false;
+				return;
+			}
+			MaxLengthError = FMath::Max(MaxLengthError, FMath::Abs((float)(Tail - Head).Size() - Length));
+		}
+	};
+
+	// hair like chains hanging from a head, on a circle around it
+	FTransform ChainRootOffset(int32 Chain, int32 ChainNum) {
+		const float a = 2.f * PI * Chain / ChainNum;
+		return FTransform(FVector(FMath::Cos(a) * 10.f, FMath::Sin(a) * 10.f, 5.f));
+	}
+
+	// colliders around the head and shoulders, head bone space
+	FVector ColliderOffset(int32 Collider, int32 ColliderNum) {
+		const float a = 2.f * PI * Collider / ColliderNum;
+		return FVector(FMath::Cos(a) * 8.f, FMath::Sin(a) * 8.f, -10.f - Collider);
+	}
+
+	//////////////////////////////
+	// VRM0. one spring per chain, bone index j * ChainNum + c
+
+	TSharedPtr<VRMSpringBone::VRMSpringTopology> BuildVRM0Topology(int32 ChainNum, int32 JointNum, int32 ColliderNum, USkeletalMesh* Mesh) {
+		auto Result = MakeShared<VRMSpringBone::VRMSpringManagerTopology>();
+
+		Result->spring.SetNum(ChainNum);
+		for (int32 c = 0; c < ChainNum; ++c) {
+			auto& s = Result->spring[c];
+			s.skeletalMesh = Mesh;
+			s.stiffness = 1.f;
+			s.gravityPower = 0.2f;
+			// vrm axis. down in unreal
+			s.gravityDir = FVector(0, -1, 0);
+			s.dragForce = 0.4f;
+			s.hitRadius = 0.02f;
+			s.WindPhase = c * 7.31f + 0.5f;
+			s.ColliderGroupIndexArray.Add(0);
+
+			for (int32 j = 0; j < JointNum; ++j) {
+				auto& sData = s.SpringData.AddDefaulted_GetRef();
+				sData.boneIndex = j * ChainNum + c;
+				sData.parent = j - 1;
+				// offset to the child bone, not normalized
+				sData.m_boneAxis = FVector(0, 0, -BenchmarkBoneLength);
+				sData.m_length = sData.m_boneAxis.Size();
+			}
+			s.SortByDepth();
+		}
+
+		auto& cg = Result->colliderGroup.AddDefaulted_GetRef();
+		cg.colliders.SetNum(ColliderNum);
+		for (int32 i = 0; i < ColliderNum; ++i) {
+			cg.colliders[i].ueOffset = ColliderOffset(i, ColliderNum);
+			cg.colliders[i].ueRadius = 8.f;
+		}
+
+		// no bone is shared, every spring is its own group
+		for (int32 c = 0; c < ChainNum; ++c) {
+			Result->GroupStart.Add(c);
+			Result->GroupSpring.Add(c);
+		}
+		Result->GroupStart.Add(ChainNum);
+		return Result;
+	}
+
+	// what compileBones reads from the bone container
+	void CompileVRM0(VRMSpringBone::VRMSpringManager& m) {
+		for (auto& s : m.spring) {
+			for (auto& sData : s.SpringData) {
+				sData.compactIndex = sData.boneIndex;
+				sData.refPose = FTransform(FVector(0, 0, -BenchmarkBoneLength));
+			}
+			s.UpdateChainReach();
+		}
+		for (auto& cg : m.colliderGroup) {
+			cg.compactIndex = 0;
+		}
+	}
+
+	// what fetchPose reads from the pose
+	void FetchVRM0(VRMSpringBone::VRMSpringManager& m, const FTransform& Root, const FTransform& Head) {
+		const int32 ChainNum = m.spring.Num();
+		for (int32 c = 0; c < ChainNum; ++c) {
+			auto& s = m.spring[c];
+			for (int32 jointNo = s.LevelStart[0]; jointNo < s.LevelStart[1]; ++jointNo) {
+				s.SpringData[jointNo].m_poseTransform = ChainRootOffset(c, ChainNum) * Head;
+			}
+			s.UpdatePoseBounds();
+		}
+		for (auto& cg : m.colliderGroup) {
+			cg.m_transform = Head;
+			cg.UpdateBounds();
+		}
+		m.FetchedComponentTransform = Root;
+	}
+
+	// same as the default transform of VRMSpringManager::init
+	void ResetVRM0(VRMSpringBone::VRMSpringManager& m, const FTransform& Root) {
+		for (auto& s : m.spring) {
+			for (auto& sData : s.SpringData) {
+				sData.m_bValid = true;
+				sData.m_transform = (sData.parent == INDEX_NONE) ? sData.m_poseTransform : sData.refPose * s.SpringData[sData.parent].m_transform;
+				sData.m_currentTail = sData.m_prevTail = Root.TransformPosition(sData.m_transform.GetLocation() + sData.m_boneAxis);
+				sData.m_resultQuat = sData.m_prevResultQuat = sData.m_lodFromQuat = sData.m_transform.GetRotation();
+			}
+		}
+	}
+
+	FSpringBenchmarkResult RunVRM0(int32 ChainNum, int32 JointNum, int32 ColliderNum, const FSpringBenchmarkMotion& Motion) {
+		// the solver only checks the mesh for null
+		VRMSpringBone::VRMSpringManager m;
+		m.initTopology(BuildVRM0Topology(ChainNum, JointNum, ColliderNum, GetMutableDefault<USkeletalMesh>()));
+		CompileVRM0(m);
+		FetchVRM0(m, Motion.Root[0], Motion.Head[0]);
+		ResetVRM0(m, Motion.Root[0]);
+
+		const VRMSpringBone::VRMSpringSimParams Params;
+		const int32 FrameNum = Motion.Root.Num();
+
+		FSpringBenchmarkResult Result;
+		const uint64 StartCycles = FPlatformTime::Cycles64();
+		// the first frame sizes the work arrays
+		FetchVRM0(m, Motion.Root[0], Motion.Head[0]);
+		m.simulateFetched(Params, BenchmarkFrameTime);
+		{
+			FSpringBenchmarkAllocScope Alloc;
+			for (int32 f = 1; f < FrameNum; ++f) {
+				FetchVRM0(m, Motion.Root[f], Motion.Head[f]);
+				m.simulateFetched(Params, BenchmarkFrameTime);
+			}
+			Result.Allocations = Alloc.GetNum();
+		}
+		Result.Seconds = FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - StartCycles);
+
+		const FTransform& Root = Motion.Root.Last();
+		for (const auto& s : m.spring) {
+			for (const auto& sData : s.SpringData) {
+				Result.AddTail(Root.TransformPosition(sData.m_transform.GetLocation()), sData.m_currentTail, sData.m_length);
+			}
+		}
+		Result.JointNum = m.getJointNum();
+		return Result;
+	}
+
+	//////////////////////////////
+	// VRM1. chain c, joint j is bone j * ChainNum + c
+
+	TSharedPtr<VRMSpringBone::VRMSpringTopology> BuildVRM1Topology(int32 ChainNum, int32 JointNum, int32 ColliderNum) {
+		auto Result = MakeShared<VRM1Spring::VRM1SpringTopology>();
+
+		// already sorted by depth
+		for (int32 j = 0; j <= JointNum; ++j) {
+			Result->LevelStart.Add(j * ChainNum);
+		}
+		for (int32 j = 0; j < JointNum; ++j) {
+			for (int32 c = 0; c < ChainNum; ++c) {
+				auto& state = Result->JointState.AddDefaulted_GetRef();
+				state.boneNo = j * ChainNum + c;
+				state.parentSlot = (j == 0) ? INDEX_NONE : (j - 1) * ChainNum + c;
+				state.springNo = c;
+
+				state.hitRadius = 2.f;
+				state.stiffness = 1.f;
+				state.dragForce = 0.4f;
+				state.gravityPower = 0.2f;
+				state.gravityDir = FVector(0, 0, -1);
+
+				state.initialLocalMatrix = (j == 0) ? ChainRootOffset(c, ChainNum) : FTransform(FVector(0, 0, -BenchmarkBoneLength));
+				state.initialLocalRotation = state.initialLocalMatrix.GetRotation();
+				// same as buildTopology. unit axis, length apart
+				state.boneLength = state.initialLocalMatrix.GetLocation().Size();
+				state.boneAxis = state.initialLocalMatrix.TransformPosition(FVector::ZeroVector).GetSafeNormal();
+			}
+		}
+		Result->TotalJointCount = Result->JointState.Num();
+
+		// same as buildTopology. all bone lengths and the longest once more
+		TArray<float> MaxLength;
+		MaxLength.Init(0.f, ChainNum);
+		Result->SpringReach.Init(0.f, ChainNum);
+		for (const auto& state : Result->JointState) {
+			Result->SpringReach[state.springNo] += state.boneLength;
+			MaxLength[state.springNo] = FMath::Max(MaxLength[state.springNo], state.boneLength);
+		}
+		for (int32 c = 0; c < ChainNum; ++c) {
+			Result->SpringReach[c] += MaxLength[c];
+		}
+
+		// one group used by all springs
+		for (int32 i = 0; i < ColliderNum; ++i) {
+			auto& def = Result->ColliderDef.AddDefaulted_GetRef();
+			def.shape = (i % 2) ? VRM1Spring::ESpringColliderShape::Capsule : VRM1Spring::ESpringColliderShape::Sphere;
+			def.offset = ColliderOffset(i, ColliderNum);
+			def.tail = def.offset + FVector(0, 0, -10.f);
+			def.radius = 8.f;
+			Result->GroupCollider.Add(i);
+		}
+		Result->GroupColliderStart = { 0, ColliderNum };
+		for (int32 c = 0; c < ChainNum; ++c) {
+			Result->SpringColliderGroupStart.Add(c);
+			Result->SpringColliderGroup.Add(0);
+		}
+		Result->SpringColliderGroupStart.Add(ChainNum);
+		return Result;
+	}
+
+	// what fetchPose and updateColliders read from the pose. all bones are in the pose
+	void FetchVRM1(VRM1Spring::VRM1SpringManager& m, const FTransform& Head) {
+		for (int32 slot = m.LevelStart[0]; slot < m.LevelStart[1]; ++slot) {
+			m.ParentTransform[slot] = Head;
+			m.RootPoseTransform[slot] = m.JointState[slot].initialLocalMatrix * Head;
+		}
+		for (int32 i = 0; i < m.ColliderDef.Num(); ++i) {
+			auto& cs = m.ColliderState[i];
+			cs.bValid = true;
+			cs.offset = Head.TransformPosition(m.ColliderDef[i].offset);
+			cs.tail = Head.TransformPosition(m.ColliderDef[i].tail);
+		}
+	}
+
+	// same as the tails of VRM1SpringManager::init
+	void ResetVRM1(VRM1Spring::VRM1SpringManager& m, const FTransform& Root, const FTransform& Head) {
+		FetchVRM1(m, Head);
+		for (int32 slot = 0; slot < m.JointState.Num(); ++slot) {
+			auto& state = m.JointState[slot];
+			state.bActive = true;
+			m.JointTransform[slot] = (state.parentSlot == INDEX_NONE) ? m.RootPoseTransform[slot] : state.initialLocalMatrix * m.JointTransform[state.parentSlot];
+
+			const FTransform& t = m.JointTransform[slot];
+			state.initialTail = state.currentTail = state.prevTail = Root.TransformPosition(t.GetLocation());
+			state.resultQuat = state.prevResultQuat = state.lodFromQuat = t.GetRotation();
+		}
+	}
+
+	void InitVRM1(VRM1Spring::VRM1SpringManager& m, int32 ChainNum, int32 JointNum, int32 ColliderNum, const FSpringBenchmarkMotion& Motion) {
+		m.initTopology(BuildVRM1Topology(ChainNum, JointNum, ColliderNum));
+		ResetVRM1(m, Motion.Root[0], Motion.Head[0]);
+	}
+
+	FSpringBenchmarkResult RunVRM1(int32 ChainNum, int32 JointNum, int32 ColliderNum, const FSpringBenchmarkMotion& Motion) {
+		VRM1Spring::VRM1SpringManager m;
+		InitVRM1(m, ChainNum, JointNum, ColliderNum, Motion);
+
+		const VRMSpringBone::VRMSpringSimParams Params;
+		const int32 FrameNum = Motion.Root.Num();
+
+		FSpringBenchmarkResult Result;
+		const uint64 StartCycles = FPlatformTime::Cycles64();
+		// the first frame sizes the work arrays
+		FetchVRM1(m, Motion.Head[0]);
+		m.simulate(Params, BenchmarkFrameTime, Motion.Root[0]);
+		{
+			FSpringBenchmarkAllocScope Alloc;
+			for (int32 f = 1; f < FrameNum; ++f) {
+				FetchVRM1(m, Motion.Head[f]);
+				m.simulate(Params, BenchmarkFrameTime, Motion.Root[f]);
+			}
+			Result.Allocations = Alloc.GetNum();
+		}
+		Result.Seconds = FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - StartCycles);
+
+		const FTransform& Root = Motion.Root.Last();
+		for (int32 slot = 0; slot < m.JointState.Num(); ++slot) {
+			const auto& state = m.JointState[slot];
+			Result.AddTail(Root.TransformPosition(m.JointTransform[slot].GetLocation()), state.currentTail, state.boneLength);
+		}
+		Result.JointNum = m.getJointNum();
+		return Result;
+	}
+
+	// pipelined and crowd mode run several steps on one fetched pose. the result must match a pose fetch per step
+	bool CheckFetchedSteps(int32 ChainNum, int32 JointNum, int32 ColliderNum, const FSpringBenchmarkMotion& Motion) {
+		const int32 StepCount = 3;
+		const float StepTime = BenchmarkFrameTime / StepCount;
+		const VRMSpringBone::VRMSpringSimParams Params;
+
+		VRM1Spring::VRM1SpringManager Sync;
+		VRM1Spring::VRM1SpringManager Fetched;
+		InitVRM1(Sync, ChainNum, JointNum, ColliderNum, Motion);
+		InitVRM1(Fetched, ChainNum, JointNum, ColliderNum, Motion);
+
+		for (int32 f = 0; f < Motion.Root.Num(); ++f) {
+			FetchVRM1(Fetched, Motion.Head[f]);
+			for (int32 i = 0; i < StepCount; ++i) {
+				FetchVRM1(Sync, Motion.Head[f]);
+				Sync.simulate(Params, StepTime, Motion.Root[f]);
+				Fetched.simulate(Params, StepTime, Motion.Root[f]);
+			}
+		}
+
+		float MaxError = 0.f;
+		for (int32 slot = 0; slot < Sync.JointState.Num(); ++slot) {
+			MaxError = FMath::Max(MaxError, (float)FVector::Dist(Sync.JointState[slot].currentTail, Fetched.JointState[slot].currentTail));
+		}
+		if (MaxError > KINDA_SMALL_NUMBER) {
+			UE_LOG(LogVRM4U, Error, TEXT("[VRM4U SpringBone] benchmark: %d steps on one fetched pose differ from %d fetched steps. max error=%f"), StepCount, StepCount, MaxError);
+			return false;
+		}
+		return true;
+	}
+
+	bool ReportResult(const TCHAR* Name, const FSpringBenchmarkResult& Result, int32 FrameNum, const TCHAR* Args, const TCHAR* ExpectKey) {
+		const double JointSteps = (double)FrameNum * FMath::Max(1, Result.JointNum);
+		UE_LOG(LogVRM4U, Display, TEXT("[VRM4U SpringBone] benchmark %s: joints=%d frames=%d time=%.3fms %.2f ns/joint allocations=%d checksum=%.4f"),
+			Name, Result.JointNum, FrameNum, Result.Seconds * 1000.0, Result.Seconds * 1.e9 / JointSteps, Result.Allocations, Result.Checksum);
+
+		bool bPass = true;
+		if (Result.bFinite == false) {
+			UE_LOG(LogVRM4U, Error, TEXT("[VRM4U SpringBone] benchmark %s: the solver exploded. NaN tails"), Name);
+			bPass = false;
+		} else if (Result.MaxLengthError > BenchmarkLengthTolerance * BenchmarkBoneLength) {
+			UE_LOG(LogVRM4U, Error, TEXT("[VRM4U SpringBone] benchmark %s: tails are off the bone length. max error=%f"), Name, Result.MaxLengthError);
+			bPass = false;
+		}
+		if (Result.Allocations > 0) {
+			UE_LOG(LogVRM4U, Error, TEXT("[VRM4U SpringBone] benchmark %s: %d allocations after the first frame"), Name, Result.Allocations);
+			bPass = false;
+		}
+
+		float Expected = 0.f;
+		if (FParse::Value(Args, ExpectKey, Expected)) {
+			// sums of float tails. allow the rounding of other compilers and instruction sets
+			const double Tolerance = 1.e-4 * FMath::Max(1.0, FMath::Abs((double)Expected));
+			if (FMath::Abs(Result.Checksum - Expected) > Tolerance) {
+				UE_LOG(LogVRM4U, Error, TEXT("[VRM4U SpringBone] benchmark %s: checksum %.4f does not match %s%.4f"), Name, Result.Checksum, ExpectKey, Expected);
+				bPass = false;
+			}
+		}
+		return bPass;
+	}
+
+	void RunSpringBenchmark(const TArray<FString>& Args) {
+		// positional sizes, then the optional Expect0= Expect1= checksums
+		TArray<int32> Size;
+		for (const FString& a : Args) {
+			if (a.Contains(TEXT("=")) == false) {
+				Size.Add(FCString::Atoi(*a));
+			}
+		}
+		const FString Options = FString::Join(Args, TEXT(" "));
+
+		const int32 ChainNum = FMath::Max(1, Size.Num() > 0 ? Size[0] : 40);
+		const int32 JointNum = FMath::Max(1, Size.Num() > 1 ? Size[1] : 5);
+		const int32 ColliderNum = FMath::Max(0, Size.Num() > 2 ? Size[2] : 8);
+		const int32 FrameNum = FMath::Max(1, Size.Num() > 3 ? Size[3] : 600);
+
+		// record root motion first. walk on a circle with head bob and sway
+		FSpringBenchmarkMotion Motion;
+		for (int32 f = 0; f < FrameNum; ++f) {
+			const float t = f * BenchmarkFrameTime;
+			const float a = t * 0.5f;
+			Motion.Root.Add(FTransform(FRotator(0, FMath::RadiansToDegrees(a) + 90.f, 0), FVector(FMath::Cos(a) * 300.f, FMath::Sin(a) * 300.f, 0)));
+
+			const float step = 2.f * PI * 1.8f * t;
+			Motion.Head.Add(FTransform(FRotator(FMath::Sin(step) * 8.f, FMath::Sin(step * 0.5f) * 15.f, FMath::Cos(step) * 5.f), FVector(0, 0, 150.f + FMath::Sin(step) * 3.f)));
+		}
+
+		UE_LOG(LogVRM4U, Display, TEXT("[VRM4U SpringBone] benchmark: chains=%d joints=%d colliders=%d frames=%d"), ChainNum, JointNum, ColliderNum, FrameNum);
+
+		bool bPass = ReportResult(TEXT("VRM0"), RunVRM0(ChainNum, JointNum, ColliderNum, Motion), FrameNum, *Options, TEXT("Expect0="));
+		bPass &= ReportResult(TEXT("VRM1"), RunVRM1(ChainNum, JointNum, ColliderNum, Motion), FrameNum, *Options, TEXT("Expect1="));
+		bPass &= CheckFetchedSteps(ChainNum, JointNum, ColliderNum, Motion);
+
+		UE_LOG(LogVRM4U, Display, TEXT("[VRM4U SpringBone] benchmark: %s"), bPass ? TEXT("passed") : TEXT("FAILED"));
+	}
+
+	FAutoConsoleCommand CmdSpringBenchmark(
+		TEXT("vrm4u.SpringBone.Benchmark"),
+		TEXT("Run the VRM0 and VRM1 spring solvers over recorded root motion and log ns/joint and a checksum of the tails.\n")
+		TEXT("Fails when a solver explodes, when tails leave the bone length, when a solver allocates after the first frame,\n")
+		TEXT("or when a checksum differs from Expect0/Expect1.\n")
+		TEXT("vrm4u.SpringBone.Benchmark [Chains=40] [JointsPerChain=5] [Colliders=8] [Frames=600] [Expect0=<checksum>] [Expect1=<checksum>]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&RunSpringBenchmark)
+	);
+}
@@ -2,7 +2,25 @@
 
 #include "VrmAssetListObject.h"
 #include "Engine/World.h"
+#include "Async/ParallelFor.h"
+#include "Serialization/MemoryWriter.h"
+#include "Serialization/MemoryReader.h"
+#include "HAL/IConsoleManager.h"
+#include "UObject/ObjectKey.h"
 #include "VRM4U.h"
+#include "VRM4U_SpringBudgetSubsystem.h"
+
+DEFINE_STAT(STAT_VRM4USpring_Evaluate);
+DEFINE_STAT(STAT_VRM4USpring_Init);
+DEFINE_STAT(STAT_VRM4USpring_Fetch);
+DEFINE_STAT(STAT_VRM4USpring_Integrate);
+DEFINE_STAT(STAT_VRM4USpring_Collide);
+DEFINE_STAT(STAT_VRM4USpring_Apply);
+DEFINE_STAT(STAT_VRM4USpring_CrowdBatch);
+DEFINE_STAT(STAT_VRM4USpring_Nodes);
+DEFINE_STAT(STAT_VRM4USpring_JointSteps);
+DEFINE_STAT(STAT_VRM4USpring_ColliderTests);
+DEFINE_STAT(STAT_VRM4USpring_Collisions);
 
 VrmSpringBone::VrmSpringBone()
 {
@@ -14,286 +32,734 @@ VrmSpringBone::~VrmSpringBone()
 
 namespace VRMSpringBone {
 
-	void VRMSpring::Update(const FAnimNode_VrmSpringBone* animNode, float DeltaTime, FTransform ComponentToLocal,
-		const TArray<VRMSpringColliderGroup>& colliderGroup,
-		FComponentSpacePoseContext& Output) {
+	VRMSpringManagerBase::VRMSpringManagerBase() {
+		if (auto* Budget = UVRM4U_SpringBudgetSubsystem::Get()) {
+			Budget->Register(this);
+		}
+	}
 
-		if (skeletalMesh == nullptr) {
-			return;
+	VRMSpringManagerBase::~VRMSpringManagerBase() {
+		if (auto* Budget = UVRM4U_SpringBudgetSubsystem::Get()) {
+			Budget->Unregister(this);
 		}
+	}
 
-		const auto RefSkeleton = Output.AnimInstanceProxy->GetSkeleton()->GetReferenceSkeleton();
-		const auto& RefSkeletonTransform = Output.Pose.GetPose().GetBoneContainer().GetRefPoseArray();
+	namespace {
+		const uint32 SpringStateMagic = 0x52505356; // VSPR
+		const uint8 SpringStateVersion = 1;
+		// prevTail, currentTail, resultQuat
+		const int32 SpringStateFloatNum = 3 + 3 + 4;
+	}
 
-		const FTransform ComponentTransform = Output.AnimInstanceProxy->GetComponentTransform();
-		// モデルローカル座標
-		ComponentToLocal = ComponentTransform.Inverse();
+	bool VRMSpringManagerBase::saveState(TArray<uint8>& OutData) {
+		OutData.Reset();
+		if (bInit == false) {
+			return false;
+		}
+		uint32 magic = SpringStateMagic;
+		uint8 version = SpringStateVersion;
+		int32 num = getJointNum();
+
+		OutData.Reserve(sizeof(magic) + sizeof(version) + sizeof(num) + num * SpringStateFloatNum * sizeof(float));
+		FMemoryWriter Ar(OutData);
+		Ar << magic << version << num;
+
+		forEachJointState([&](FVector& prevTail, FVector& currentTail, FQuat& resultQuat, FQuat&) {
+			const FVector p = LastComponentTransform.InverseTransformPosition(prevTail);
+			const FVector c = LastComponentTransform.InverseTransformPosition(currentTail);
+			float v[SpringStateFloatNum] = {
+				(float)p.X, (float)p.Y, (float)p.Z,
+				(float)c.X, (float)c.Y, (float)c.Z,
+				(float)resultQuat.X, (float)resultQuat.Y, (float)resultQuat.Z, (float)resultQuat.W,
+			};
+			for (float& f : v) {
+				Ar << f;
+			}
+		});
+		return true;
+	}
 
-		//
-		// x10 adjust?
-		FVector ue4grav(-gravityDir.X, gravityDir.Z, gravityDir.Y);
+	bool VRMSpringManagerBase::loadState(const TArray<uint8>& Data, const FTransform& ComponentTransform) {
+		if (bInit == false) {
+			return false;
+		}
+		FMemoryReader Ar(Data);
+		uint32 magic = 0;
+		uint8 version = 0;
+		int32 num = 0;
+		Ar << magic << version << num;
+		if (Ar.IsError() || magic != SpringStateMagic || version != SpringStateVersion) {
+			UE_LOG(LogVRM4U, Warning, TEXT("[VRM4U SpringBone] Spring state is not valid"));
+			return false;
+		}
+		if (num != getJointNum() || Ar.TotalSize() - Ar.Tell() != (int64)num * SpringStateFloatNum * sizeof(float)) {
+			UE_LOG(LogVRM4U, Warning, TEXT("[VRM4U SpringBone] Spring state is for another model. joints %d / %d"), num, getJointNum());
+			return false;
+		}
 
-		const int MAX_LOOP = FMath::Max(1, animNode->loopc);
-		for (int i = 0; i < MAX_LOOP; ++i) {
-			//const float stiffnessForce = stiffness * DeltaTime * 10.f * animNode->stiffnessScale + animNode->stiffinessAdd;
-			//FVector external = ComponentToLocal.TransformVector(ue4grav) * (gravityPower * DeltaTime) * animNode->gravityScale + ComponentToLocal.TransformVector(animNode->gravityAdd) * DeltaTime;
-			//external *= 100.f; // to unreal scale
+		forEachJointState([&](FVector& prevTail, FVector& currentTail, FQuat& resultQuat, FQuat& prevResultQuat) {
+			float v[SpringStateFloatNum];
+			for (float& f : v) {
+				Ar << f;
+			}
+			prevTail = ComponentTransform.TransformPosition(FVector(v[0], v[1], v[2]));
+			currentTail = ComponentTransform.TransformPosition(FVector(v[3], v[4], v[5]));
+			resultQuat = FQuat(v[6], v[7], v[8], v[9]).GetNormalized();
+			prevResultQuat = resultQuat;
+		});
+		LastComponentTransform = ComponentTransform;
+		OutputAlpha = 1.f;
+		LODBlendAlpha = 1.f;
+		return true;
+	}
+
+	namespace {
+		// meta, mesh, manager type
+		typedef TTuple<TObjectKey<UVrmMetaObject>, TObjectKey<USkeletalMesh>, int32> FSpringTopologyKey;
+
+		FCriticalSection SpringTopologyLock;
+		TMap<FSpringTopologyKey, TSharedPtr<const VRMSpringTopology>> SpringTopologyMap;
+
+		FAutoConsoleCommand CmdClearSpringTopology(
+			TEXT("vrm4u.SpringBone.ClearTopologyCache"),
+			TEXT("Drop cached spring topology. spring nodes initialized after this read the meta data again."),
+			FConsoleCommandDelegate::CreateStatic(&VRMSpringTopologyCache::Clear)
+		);
+	}
+
+	TSharedPtr<const VRMSpringTopology> VRMSpringTopologyCache::FindOrBuild(const UVrmMetaObject* meta, const USkeletalMesh* mesh, int32 Type, TFunctionRef<TSharedPtr<VRMSpringTopology>()> Build) {
+		const FSpringTopologyKey Key(TObjectKey<UVrmMetaObject>(meta), TObjectKey<USkeletalMesh>(mesh), Type);
+
+		// anim workers init in parallel. the first one builds, the others wait and share it
+		FScopeLock Lock(&SpringTopologyLock);
+		if (const auto* Found = SpringTopologyMap.Find(Key)) {
+			return *Found;
+		}
+
+		// drop models which are unloaded
+		for (auto It = SpringTopologyMap.CreateIterator(); It; ++It) {
+			if (It.Key().Get<0>().ResolveObjectPtr() == nullptr || It.Key().Get<1>().ResolveObjectPtr() == nullptr) {
+				It.RemoveCurrent();
+			}
+		}
+
+		TSharedPtr<const VRMSpringTopology> Topology = Build();
+		SpringTopologyMap.Add(Key, Topology);
+		return Topology;
+	}
+
+	void VRMSpringTopologyCache::Clear() {
+		FScopeLock Lock(&SpringTopologyLock);
+		SpringTopologyMap.Reset();
+	}
+
+	VRMSpringSimParams::VRMSpringSimParams(const FAnimNode_VrmSpringBone* animNode) {
+		stiffnessScale = animNode->stiffnessScale;
+		stiffnessAdd = animNode->stiffnessAdd;
+		gravityScale = animNode->gravityScale;
+		gravityAdd = animNode->gravityAdd;
+		bCollision = (animNode->bIgnoreVRMCollision == false);
+
+		loopc = animNode->loopc;
+		collisionCheckLoopCount = animNode->collisionCheckLoopCount;
+		bPhysicsCollision = (animNode->bIgnorePhysicsCollision == false);
+		bParallelEvaluation = animNode->bParallelEvaluation;
+		bWind = (animNode->bIgnoreWindDirectionalSource == false);
+		bDeterministicWindNoise = animNode->bDeterministicWindNoise;
+		randomWindRange = animNode->randomWindRange;
+		windScale = animNode->windScale;
+		Wind = animNode->WindSnapshot;
+	}
+
+	void VRMSpringManagerBase::update(const FAnimNode_VrmSpringBone* animNode, float DeltaTime, FComponentSpacePoseContext& Output, TArray<FBoneTransform>& OutBoneTransforms) {
+		const VRMSpringSimParams Params(animNode);
+		fetchPose(Params, Output);
+		simulateFetched(Params, DeltaTime);
+	}
+
+	void VRMSpringJointSoA::SetNum(int32 Num) {
+		for (TArray<float>* a : {
+			&CurrentTailX, &CurrentTailY, &CurrentTailZ,
+			&PrevTailX, &PrevTailY, &PrevTailZ,
+			&HeadX, &HeadY, &HeadZ,
+			&ForceX, &ForceY, &ForceZ,
+			&NextTailX, &NextTailY, &NextTailZ,
+			&Drag, &Length }) {
+			a->SetNumZeroed(Num);
+		}
+	}
 
-			float CurrentDeltaTime = DeltaTime / (float)MAX_LOOP;
+	void VRMSpringJointParams::Init(int32 Num) {
+		StiffnessScale.Init(1.f, Num);
+		GravityScale.Init(1.f, Num);
+		DragScale.Init(1.f, Num);
+		HitRadiusScale.Init(1.f, Num);
+		NoWind.Init(false, Num);
+		MaxHitRadiusScale = 1.f;
+	}
 
-			const float stiffnessForce = stiffness * CurrentDeltaTime * 10.f * animNode->stiffnessScale + animNode->stiffnessAdd;
-			FVector external = ComponentToLocal.TransformVector(ue4grav) * (gravityPower * CurrentDeltaTime) * animNode->gravityScale + ComponentToLocal.TransformVector(animNode->gravityAdd) * CurrentDeltaTime;
+	void VRMSpringJointParams::Resolve(const TArray<FVrmSpringJointOverride>& Overrides, const TArray<FName>& NoWindBoneNameList, int32 Num,
+		TFunctionRef<FName(int32)> BoneName, TFunctionRef<int32(int32)> Parent) {
+		Init(Num);
 
-			//wind
-			if (animNode->bIgnoreWindDirectionalSource == false) {
-				const USkeletalMeshComponent* SkelComp = Output.AnimInstanceProxy->GetSkelMeshComponent();
-				//InAnimInstance->GetSkelMeshComponent();
+		// later entries win
+		TMap<FName, int32> OverrideIndex;
+		for (int32 i = 0; i < Overrides.Num(); ++i) {
+			if (Overrides[i].BoneName != NAME_None) {
+				OverrideIndex.Add(Overrides[i].BoneName, i);
+			}
+		}
 
-				const UWorld* World = nullptr;
-				if (SkelComp) {
-					World = SkelComp->GetWorld();
+		// override which children of the joint use
+		TArray<int32> ChainOverride;
+		ChainOverride.Init(INDEX_NONE, Num);
+
+		MaxHitRadiusScale = 0.f;
+		for (int32 i = 0; i < Num; ++i) {
+			const FName Name = BoneName(i);
+			const int32 p = Parent(i);
+			check(p < i);
+
+			int32 o = (p != INDEX_NONE) ? ChainOverride[p] : INDEX_NONE;
+			ChainOverride[i] = o;
+			if (const int32* Own = OverrideIndex.Find(Name)) {
+				o = *Own;
+				if (Overrides[o].bApplyToChildren) {
+					ChainOverride[i] = o;
 				}
-				FSceneInterface* Scene = nullptr;
-				if (World) {
-					Scene = World->Scene;
+			}
+
+			// same as before: children of a no wind bone have no wind
+			bool bNoWind = NoWindBoneNameList.Contains(Name) || (p != INDEX_NONE && NoWind[p]);
+			if (o != INDEX_NONE) {
+				const auto& ov = Overrides[o];
+				StiffnessScale[i] = ov.stiffnessScale;
+				GravityScale[i] = ov.gravityScale;
+				DragScale[i] = ov.dragScale;
+				HitRadiusScale[i] = ov.hitRadiusScale;
+				bNoWind |= ov.bNoWind;
+			}
+			NoWind[i] = bNoWind;
+			MaxHitRadiusScale = FMath::Max(MaxHitRadiusScale, HitRadiusScale[i]);
+		}
+		if (Num == 0) {
+			MaxHitRadiusScale = 1.f;
+		}
+	}
+
+	void VRMSpringJointSoA::Integrate(int32 Begin, int32 End) {
+		const float* RESTRICT cx = CurrentTailX.GetData();
+		const float* RESTRICT cy = CurrentTailY.GetData();
+		const float* RESTRICT cz = CurrentTailZ.GetData();
+		const float* RESTRICT px = PrevTailX.GetData();
+		const float* RESTRICT py = PrevTailY.GetData();
+		const float* RESTRICT pz = PrevTailZ.GetData();
+		const float* RESTRICT hx = HeadX.GetData();
+		const float* RESTRICT hy = HeadY.GetData();
+		const float* RESTRICT hz = HeadZ.GetData();
+		const float* RESTRICT fx = ForceX.GetData();
+		const float* RESTRICT fy = ForceY.GetData();
+		const float* RESTRICT fz = ForceZ.GetData();
+		const float* RESTRICT drag = Drag.GetData();
+		const float* RESTRICT length = Length.GetData();
+		float* RESTRICT nx = NextTailX.GetData();
+		float* RESTRICT ny = NextTailY.GetData();
+		float* RESTRICT nz = NextTailZ.GetData();
+
+		// no branch, no call. keep this loop vectorizable
+		for (int32 i = Begin; i < End; ++i) {
+			const float k = 1.f - drag[i];
+			const float dx = cx[i] + (cx[i] - px[i]) * k + fx[i] - hx[i];
+			const float dy = cy[i] + (cy[i] - py[i]) * k + fy[i] - hy[i];
+			const float dz = cz[i] + (cz[i] - pz[i]) * k + fz[i] - hz[i];
+
+			// same as GetSafeNormal(). zero length stays at head
+			const float lenSq = dx * dx + dy * dy + dz * dz;
+			const float scale = (lenSq < 1.e-8f) ? 0.f : length[i] / FMath::Sqrt(lenSq);
+
+			nx[i] = hx[i] + dx * scale;
+			ny[i] = hy[i] + dy * scale;
+			nz[i] = hz[i] + dz * scale;
+		}
+	}
+
+	void VRMSpring::SortByDepth() {
+		const int32 Num = SpringData.Num();
+
+		TArray<int32> Depth;
+		Depth.SetNumUninitialized(Num);
+		int32 MaxDepth = 0;
+		for (int32 i = 0; i < Num; ++i) {
+			const int32 p = SpringData[i].parent;
+			Depth[i] = (p == INDEX_NONE) ? 0 : Depth[p] + 1;
+			MaxDepth = FMath::Max(MaxDepth, Depth[i]);
+		}
+
+		TArray<int32> Order;
+		Order.Reserve(Num);
+		LevelStart.Reset();
+		for (int32 d = 0; d <= MaxDepth; ++d) {
+			LevelStart.Add(Order.Num());
+			for (int32 i = 0; i < Num; ++i) {
+				if (Depth[i] == d) {
+					Order.Add(i);
 				}
+			}
+		}
+		LevelStart.Add(Order.Num());
 
-				if (Scene)
-				{
+		TArray<int32> NewIndex;
+		NewIndex.SetNumUninitialized(Num);
+		for (int32 i = 0; i < Num; ++i) {
+			NewIndex[Order[i]] = i;
+		}
+
+		TArray<VRMSpringData> Sorted;
+		Sorted.Reserve(Num);
+		for (int32 i = 0; i < Num; ++i) {
+			auto& sData = Sorted.Add_GetRef(SpringData[Order[i]]);
+			if (sData.parent != INDEX_NONE) {
+				sData.parent = NewIndex[sData.parent];
+			}
+		}
+		SpringData = MoveTemp(Sorted);
+
+		JointParams.Init(Num);
+	}
+
+	void VRMSpringColliderGroup::UpdateBounds() {
+		m_boundsCenter = FVector::ZeroVector;
+		m_boundsRadius = 0.f;
+		if (colliders.Num() == 0) {
+			return;
+		}
+		for (auto& c : colliders) {
+			c.m_position = m_transform.TransformPosition(c.ueOffset);
+			m_boundsCenter += c.m_position;
+		}
+		m_boundsCenter /= (float)colliders.Num();
+		for (const auto& c : colliders) {
+			m_boundsRadius = FMath::Max(m_boundsRadius, (float)(c.m_position - m_boundsCenter).Size() + c.ueRadius);
+		}
+	}
+
+	void VRMSpring::FetchPose(FComponentSpacePoseContext& Output) {
+		Bounds = FBox(ForceInit);
+		if (LevelStart.Num() < 2) {
+			return;
+		}
+		for (int jointNo = LevelStart[0]; jointNo < LevelStart[1]; ++jointNo) {
+			auto& sData = SpringData[jointNo];
+			if (sData.compactIndex != INDEX_NONE) {
+				sData.m_poseTransform = Output.Pose.GetComponentSpaceTransform(FCompactPoseBoneIndex(sData.compactIndex));
+			}
+		}
+		UpdatePoseBounds();
+	}
 
-					// Unused by our simulation but needed for the call to GetWindParameters below
-					float WindMinGust;
-					float WindMaxGust;
-					FVector WindDirection;
-					float WindSpeed;
+	void VRMSpring::UpdatePoseBounds() {
+		Bounds = FBox(ForceInit);
+		if (LevelStart.Num() < 2) {
+			return;
+		}
+		for (int jointNo = LevelStart[0]; jointNo < LevelStart[1]; ++jointNo) {
+			const auto& sData = SpringData[jointNo];
+			if (sData.compactIndex != INDEX_NONE) {
+				// every tail of the chain stays inside this box
+				const float r = sData.m_chainReach * sData.m_poseTransform.GetMaximumAxisScale() + hitRadius * 100.f * JointParams.MaxHitRadiusScale;
+				const FVector center = sData.m_poseTransform.GetLocation();
+				Bounds += FBox(center - FVector(r), center + FVector(r));
+			}
+		}
+	}
 
+	void VRMSpring::UpdateChainReach() {
+		// parent is stored before children
+		for (auto& sData : SpringData) {
+			sData.m_chainReach = 0.f;
+		}
+		TArray<int32> ChainRoot;
+		ChainRoot.SetNumUninitialized(SpringData.Num());
+		for (int32 jointNo = 0; jointNo < SpringData.Num(); ++jointNo) {
+			auto& sData = SpringData[jointNo];
+			if (sData.parent == INDEX_NONE) {
+				ChainRoot[jointNo] = jointNo;
+				sData.m_headReach = 0.f;
+			} else {
+				ChainRoot[jointNo] = ChainRoot[sData.parent];
+				sData.m_headReach = SpringData[sData.parent].m_headReach + sData.refPose.GetTranslation().Size();
+			}
+			auto& root = SpringData[ChainRoot[jointNo]];
+			root.m_chainReach = FMath::Max(root.m_chainReach, sData.m_headReach + sData.m_length);
+		}
+	}
 
-					// Setup wind data
-					//Body->bWindEnabled = true;
-					//Scene->GetWindParameters_GameThread(SkelComp->GetComponentTransform().TransformPosition(Body->Pose.Position), Body->WindData.WindDirection, Body->WindData.WindSpeed, WindMinGust, WindMaxGust);
-					Scene->GetWindParameters_GameThread(SkelComp->GetComponentTransform().GetLocation(), WindDirection, WindSpeed, WindMinGust, WindMaxGust);
+	void VRMSpring::FetchWorldPrimitives(FComponentSpacePoseContext& Output) {
+		WorldPrimitive.Reset();
+		if (Bounds.IsValid == false) {
+			return;
+		}
+		USkeletalMeshComponent* SkelComp = Output.AnimInstanceProxy->GetSkelMeshComponent();
+		const UWorld* World = SkelComp ? SkelComp->GetWorld() : nullptr;
+		if (World == nullptr) {
+			return;
+		}
 
-					WindDirection = SkelComp->GetComponentTransform().Inverse().TransformVector(WindDirection);
+		const FTransform ComponentTransform = Output.AnimInstanceProxy->GetComponentTransform();
+		const FVector center = ComponentTransform.TransformPosition(Bounds.GetCenter());
+		const float radius = Bounds.GetExtent().Size() * ComponentTransform.GetMaximumAxisScale();
+
+		// same channel and self filter as the former per joint SphereTraceMulti
+		// WorldOverlap keeps its memory between updates. the physics query itself may still allocate
+		FCollisionQueryParams Params(FName(TEXT("VrmSpringBone")), false, SkelComp->GetOwner());
+		World->OverlapMultiByChannel(WorldOverlap, center, FQuat::Identity,
+			UEngineTypes::ConvertToCollisionChannel(ETraceTypeQuery::TraceTypeQuery1),
+			FCollisionShape::MakeSphere(radius), Params);
+
+		for (const auto& o : WorldOverlap) {
+			UPrimitiveComponent* p = o.GetComponent();
+			if (p == nullptr || p == SkelComp) {
+				continue;
+			}
+			WorldPrimitive.AddUnique(p);
+		}
+	}
 
-					// from AnimPhysicsSolver
-					const float WindUnitScale = 0.5f * 250.0f * FMath::FRandRange(1.f - animNode->randomWindRange, 1.f + animNode->randomWindRange) * animNode->windScale;
-					//
+	int32 VRMSpring::GetLoopCount(const VRMSpringSimParams& Params, int32 LoopCount) {
+		return FMath::Clamp(Params.loopc, 1, FMath::Max(1, LoopCount));
+	}
 
-					// Wind velocity in body space
-					FVector WindVelocity = WindDirection * WindSpeed * WindUnitScale;// *BodyWindScale;
-					WindVelocity *= CurrentDeltaTime;
+	int32 VRMSpring::GetLevelJointNum(int32 level, int32 LevelNum) const {
+		if (skeletalMesh == nullptr || level + 1 >= LevelStart.Num() || (level > 0 && level >= LevelNum)) {
+			return 0;
+		}
+		return LevelStart[level + 1] - LevelStart[level];
+	}
 
-					//Body->WindData.WindDirection = SkelComp->GetComponentTransform().Inverse().TransformVector(Body->WindData.WindDirection);
-					//Body->WindData.WindAdaption = FMath::FRandRange(0.0f, 2.0f);
-					//Body->WindData.BodyWindScale = WindScale;
+	void VRMSpring::BeginUpdate(const VRMSpringSimParams& Params, const FTransform& ComponentTransform,
+		const TArray<VRMSpringColliderGroup>& colliderGroup) {
 
-					//if (CVarEnableWind.GetValueOnAnyThread() == 1 && bEnableWind)
+		// モデルローカル座標
+		StepComponentToLocal = ComponentTransform.Inverse();
 
-					external += WindVelocity / 100.f;
+		// broadphase. collider groups which can touch this spring
+		ActiveColliderGroup.Reset();
+		if (Params.bCollision && Bounds.IsValid) {
+			for (auto ind : ColliderGroupIndexArray) {
+				if (colliderGroup.IsValidIndex(ind) == false) {
+					continue;
+				}
+				const auto& cg = colliderGroup[ind];
+				if (cg.compactIndex == INDEX_NONE) {
+					continue;
+				}
+				if (Bounds.ComputeSquaredDistanceToPoint(cg.m_boundsCenter) > FMath::Square(cg.m_boundsRadius)) {
+					continue;
 				}
-			}// wind end
+				ActiveColliderGroup.Add(ind);
+			}
+		}
+	}
 
+	void VRMSpring::BeginLoop(const VRMSpringSimParams& Params, float CurrentDeltaTime) {
+		const FTransform& ComponentToLocal = StepComponentToLocal;
 
-			external *= 100.f; // to unreal scale
+		//
+		// x10 adjust?
+		FVector ue4grav(-gravityDir.X, gravityDir.Z, gravityDir.Y);
 
-			FVector external_noAdd = ComponentToLocal.TransformVector(ue4grav) * (gravityPower * CurrentDeltaTime) * animNode->gravityScale;
-			external_noAdd *= 100.f; // to unreal scale
+		//const float stiffnessForce = stiffness * DeltaTime * 10.f * animNode->stiffnessScale + animNode->stiffinessAdd;
+		//FVector external = ComponentToLocal.TransformVector(ue4grav) * (gravityPower * DeltaTime) * animNode->gravityScale + ComponentToLocal.TransformVector(animNode->gravityAdd) * DeltaTime;
+		//external *= 100.f; // to unreal scale
 
+		StepStiffnessForce = stiffness * CurrentDeltaTime * 10.f * Params.stiffnessScale + Params.stiffnessAdd;
+		FVector external = ComponentToLocal.TransformVector(Params.gravityAdd) * CurrentDeltaTime;
 
-			const auto WorldContext = Output.AnimInstanceProxy->GetSkelMeshComponent();
+		//wind
+		// sampled once per frame on game thread. see FAnimNode_VrmSpringBone::SampleWind
+		const FVrmSpringWindSnapshot& Wind = Params.Wind;
+		if (Params.bWind && Wind.bValid) {
+			WindTime += CurrentDeltaTime;
 
-			for (int springCount = 0; springCount < SpringDataChain.Num(); ++springCount) {
+			float gust = 1.f;
+			if (Params.bDeterministicWindNoise) {
+				gust += Params.randomWindRange * FMath::PerlinNoise1D(WindTime * 2.f + WindPhase);
+			} else {
+				gust = FMath::FRandRange(1.f - Params.randomWindRange, 1.f + Params.randomWindRange);
+			}
 
-				auto& ChainRoot = SpringDataChain[springCount];
-				FTransform currentTransform = FTransform::Identity;
+			// from AnimPhysicsSolver
+			const float WindUnitScale = 0.5f * 250.0f * gust * Params.windScale;
 
-				bool bSkipGravAdd = false;
+			// Wind velocity in body space
+			FVector WindVelocity = Wind.Direction * Wind.Speed * WindUnitScale;// *BodyWindScale;
+			WindVelocity *= CurrentDeltaTime;
 
-				for (int chainCount = 0; chainCount < ChainRoot.Num(); ++chainCount) {
+			external += WindVelocity / 100.f;
+		}// wind end
 
-					auto& sData = ChainRoot[chainCount];
 
-					FVector currentTail = ComponentToLocal.TransformPosition(sData.m_currentTail);
-					FVector prevTail = ComponentToLocal.TransformPosition(sData.m_prevTail);
+		external *= 100.f; // to unreal scale
+		StepExternal = external;
 
-					int myBoneIndex = RefSkeleton.FindBoneIndex(sData.boneName);
-					if (myBoneIndex < 0) {
-						continue;
-					}
+		// gravity is scaled per joint. JointParams.NoWind joints get no external
+		FVector gravity = ComponentToLocal.TransformVector(ue4grav) * (gravityPower * CurrentDeltaTime) * Params.gravityScale;
+		gravity *= 100.f; // to unreal scale
+		StepGravity = gravity;
+	}
 
-					if (animNode->NoWindBoneNameList.Contains(sData.boneName)) {
-						bSkipGravAdd = true;
-					}
+	bool VRMSpring::PrepareLevel(int32 level, int32 LevelNum, VRMSpringJointSoA& SoA, int32 SoABase, VRMSpringStatCounter& Counter) {
+		const FTransform& ComponentToLocal = StepComponentToLocal;
+		const int32 levelBegin = LevelStart[level];
+		const int32 levelEnd = LevelStart[level + 1];
+
+		if (level > 0 && level >= LevelNum) {
+			// LOD. follow the parent rigidly and keep the tail at rest
+			for (int jointNo = levelBegin; jointNo < levelEnd; ++jointNo) {
+				auto& sData = SpringData[jointNo];
+				const auto& parent = SpringData[sData.parent];
+				sData.m_bValid = parent.m_bValid;
+				if (sData.m_bValid == false) {
+					continue;
+				}
+				sData.m_transform = sData.refPose * parent.m_transform;
+				sData.m_resultQuat = sData.m_transform.GetRotation();
 
+				const FVector restTail = sData.m_transform.GetLocation() + sData.m_resultQuat * sData.m_boneAxis;
+				sData.m_currentTail = sData.m_prevTail = ComponentToLocal.InverseTransformPosition(restTail);
+			}
+			return false;
+		}
 
-					int myParentBoneIndex = RefSkeleton.GetParentIndex(myBoneIndex);
+		SCOPE_CYCLE_COUNTER(STAT_VRM4USpring_Integrate);
+		Counter.JointSteps += levelEnd - levelBegin;
+		// parent transform and forces
+		for (int jointNo = levelBegin; jointNo < levelEnd; ++jointNo) {
+			auto& sData = SpringData[jointNo];
+
+			if (sData.parent == INDEX_NONE) {
+				// chain root
+				sData.m_bValid = (sData.compactIndex != INDEX_NONE);
+				if (sData.m_bValid) {
+					sData.m_transform = sData.m_poseTransform;
+				}
+			}
+			else {
+				const auto& parent = SpringData[sData.parent];
+				sData.m_bValid = parent.m_bValid;
+				if (sData.m_bValid) {
+					sData.m_transform = sData.refPose * parent.m_transform;
+				}
+			}
+			if (sData.m_bValid == false) {
+				SoA.SetJoint(SoABase + jointNo, FVector::ZeroVector, FVector::ZeroVector, FVector::ZeroVector, FVector::ZeroVector, 0.f, 0.f);
+				continue;
+			}
 
-					//currentTransform = FTransform::Identity;
-					FQuat ParentRotation = FQuat::Identity;
-					if (chainCount == 0) {
-						FCompactPoseBoneIndex uu = Output.Pose.GetPose().GetBoneContainer().GetCompactPoseIndexFromSkeletonIndex(myBoneIndex);
-						//FCompactPoseBoneIndex uu(myBoneIndex);
+			const FQuat ParentRotation = sData.m_transform.GetRotation();
+			FQuat m_localRotation = FQuat::Identity;
 
-						if (Output.Pose.GetPose().IsValidIndex(uu) == false) {
-							continue;
-						}
+			// verlet積分で次の位置を計算
+			// 親の回転による子ボーンの移動目標 + 外力による移動量
+			FVector force = ParentRotation * m_localRotation * sData.m_boneAxis * (StepStiffnessForce * JointParams.StiffnessScale[jointNo])
+				+ StepGravity * JointParams.GravityScale[jointNo];
+			if (JointParams.NoWind[jointNo] == false) {
+				force += StepExternal;
+			}
 
-						FTransform NewBoneTM = Output.Pose.GetComponentSpaceTransform(uu);
-						ParentRotation = NewBoneTM.GetRotation();
+			SoA.SetJoint(SoABase + jointNo,
+				ComponentToLocal.TransformPosition(sData.m_currentTail),
+				ComponentToLocal.TransformPosition(sData.m_prevTail),
+				sData.m_transform.GetLocation(),
+				force, dragForce * JointParams.DragScale[jointNo], sData.m_length);
+		}
+		return true;
+	}
 
-						currentTransform = NewBoneTM;
-					}
-					else {
-						auto c = RefSkeletonTransform[sData.boneIndex];
-						auto t = c * currentTransform;
+	void VRMSpring::FinishLevel(const VRMSpringSimParams& Params, int32 level, const TArray<VRMSpringColliderGroup>& colliderGroup,
+		const VRMSpringJointSoA& SoA, int32 SoABase, VRMSpringStatCounter& Counter) {
 
-						ParentRotation = t.GetRotation();
-						currentTransform = t;
-					}
-					FQuat m_localRotation = FQuat::Identity;
+		// collision and rotation. until the end of this level
+		SCOPE_CYCLE_COUNTER(STAT_VRM4USpring_Collide);
 
+		const FTransform& ComponentToLocal = StepComponentToLocal;
+		for (int jointNo = LevelStart[level]; jointNo < LevelStart[level + 1]; ++jointNo) {
+			auto& sData = SpringData[jointNo];
+			if (sData.m_bValid == false) {
+				continue;
+			}
 
-					// verlet積分で次の位置を計算
-					FVector nextTail = currentTail
-						+ (currentTail - prevTail) * (1.0f - dragForce) // 前フレームの移動を継続する(減衰もあるよ)
-						+ ParentRotation * m_localRotation * sData.m_boneAxis * stiffnessForce // 親の回転による子ボーンの移動目標
-						;
-					if (bSkipGravAdd) {
-						nextTail += external_noAdd; // 外力による移動量
+			const FTransform& currentTransform = sData.m_transform;
+			const FVector currentTail = SoA.GetCurrentTail(SoABase + jointNo);
+			const float jointHitRadius = hitRadius * 100.f * JointParams.HitRadiusScale[jointNo];
+			FVector nextTail = SoA.GetNextTail(SoABase + jointNo);
+
+			// Collisionで移動
+
+			// vrm <-> physics collision
+			if (Params.bPhysicsCollision && WorldPrimitive.Num() > 0) {
+				const FCollisionShape JointShape = FCollisionShape::MakeSphere(jointHitRadius);
+				const int ColCount = Params.collisionCheckLoopCount;
+				for (int colc = 0; colc < ColCount; ++colc) {
+					bool bHit = false;
+					for (auto* p : WorldPrimitive) {
+						FMTDResult mtd;
+						const FVector worldTail = ComponentToLocal.InverseTransformPosition(nextTail);
+						++Counter.ColliderTests;
+						if (p->ComputePenetration(mtd, JointShape, worldTail, FQuat::Identity) == false) {
+							continue;
+						}
+						++Counter.Collisions;
+						bHit = true;
+						auto posFromCollider = nextTail + ComponentToLocal.TransformVector(mtd.Direction * mtd.Distance);
+						// 長さをboneLengthに強制
+						nextTail = currentTransform.GetLocation() + (posFromCollider - currentTransform.GetLocation()).GetSafeNormal() * sData.m_length;
 					}
-					else {
-						nextTail += external; // 外力による移動量
+					if (bHit == false) {
+						break;
 					}
+				}
+			}
 
+			// vrm <-> vrm collision
+			if (Params.bCollision) {
+				// tail is always on the sphere of bone length
+				const float jointRadius = sData.m_length + jointHitRadius;
 
-					// 長さをboneLengthに強制
-					//nextTail = sData.m_transform.GetLocation() + (nextTail - sData.m_transform.GetLocation()).GetSafeNormal() * sData.m_length;
-					nextTail = currentTransform.GetLocation() + (nextTail - currentTransform.GetLocation()).GetSafeNormal() * sData.m_length;
-
-					// Collisionで移動
-
-					// vrm <-> physics collision
-					if (animNode->bIgnorePhysicsCollision == false) {
-						const int ColCount = animNode->collisionCheckLoopCount;
-						for (int colc = 0; colc < ColCount; ++colc) {
-							FVector Start = ComponentToLocal.InverseTransformPosition(nextTail);
-							FVector End = Start + FVector(0.001f);
-							//* WorldContextObject
-							float Radius = hitRadius * 100.f;
-							ETraceTypeQuery TraceChannel = ETraceTypeQuery::TraceTypeQuery1;
-							bool bTraceComplex = false;
-
-							TArray<AActor*> ActorsToIgnore;
-							EDrawDebugTrace::Type DrawDebugType = EDrawDebugTrace::None;
-							TArray<FHitResult> OutHits;
-							bool bIgnoreSelf = true;
-							FLinearColor TraceColor(EForceInit::ForceInit);
-							FLinearColor TraceHitColor(EForceInit::ForceInit);
-							float DrawTime = 0.f;
-
-							bool b = UKismetSystemLibrary::SphereTraceMulti(WorldContext, Start, End, hitRadius * 100.f,
-								TraceChannel, false, ActorsToIgnore,
-								DrawDebugType,
-								OutHits, bIgnoreSelf, TraceColor, TraceHitColor, DrawTime);
-							if (b == false) {
-								break;
-							}
-							for (auto hit : OutHits) {
-								{
-									//WorldContext->GetOwner
-									//hit.BoneName
-
-								}
-								float r = hit.PenetrationDepth; //  hitRadius * 100.f + hit.Distance;
-								auto normal = hit.Normal;
-								auto posFromCollider = nextTail + normal * r; // (float)ColCount;
-								// 長さをboneLengthに強制
-								nextTail = currentTransform.GetLocation() + (posFromCollider - currentTransform.GetLocation()).GetSafeNormal() * sData.m_length;
-							}
-						}
+				for (auto ind : ActiveColliderGroup) {
+					const auto& cg = colliderGroup[ind];
+
+					if ((cg.m_boundsCenter - currentTransform.GetLocation()).SizeSquared() > FMath::Square(jointRadius + cg.m_boundsRadius)) {
+						continue;
 					}
 
-					// vrm <-> vrm collision
-					if (animNode->bIgnoreVRMCollision == false) {
-						for (auto ind : ColliderGroupIndexArray) {
-							if (ind >= colliderGroup.Num()) {
-								continue;
-							}
-							const auto& cg = colliderGroup[ind];
-
-							int ii = RefSkeleton.FindBoneIndex(cg.node_name);
-							if (ii < 0) {
-								continue;
-							}
-
-							FCompactPoseBoneIndex uu = Output.Pose.GetPose().GetBoneContainer().GetCompactPoseIndexFromSkeletonIndex(ii);
-							//FCompactPoseBoneIndex uu(ii);
-							if (uu == INDEX_NONE) {
-								continue;
-							}
-							FTransform collisionBoneTrans = Output.Pose.GetComponentSpaceTransform(uu);
-
-							for (auto c : cg.colliders) {
-
-
-								float r = (hitRadius + c.radius) * 100.f;
-								//FVector v = collisionBoneTrans.TransformPosition(c.offset*100);
-								auto offs = c.offset;
-								//offs.Set(offs.X, -offs.Z, offs.Y);	// 本来はこれが正しいが、VRM0の座標が間違っている
-								offs.Set(-offs.X, offs.Z, offs.Y);		// VRM0の仕様としては これ
-								offs *= 100;
-								FVector v = collisionBoneTrans.TransformPosition(offs);
-
-								if ((v - nextTail).SizeSquared() > r * r) {
-									continue;
-								}
-
-								// ヒット。Colliderの半径方向に押し出す
-								auto normal = (nextTail - v).GetSafeNormal();
-								auto posFromCollider = v + normal * (r);
-								// 長さをboneLengthに強制
-								nextTail = currentTransform.GetLocation() + (posFromCollider - currentTransform.GetLocation()).GetSafeNormal() * sData.m_length;
-							}
+					Counter.ColliderTests += cg.colliders.Num();
+					for (const auto& c : cg.colliders) {
+						FVector dir;
+						if (CollideSphere(currentTransform.GetLocation(), sData.m_length, c.m_position, jointHitRadius + c.ueRadius, nextTail, dir)) {
+							++Counter.Collisions;
 						}
 					}
+				}
+			}
+
+			sData.m_prevTail = ComponentToLocal.InverseTransformPosition(currentTail);
+			sData.m_currentTail = ComponentToLocal.InverseTransformPosition(nextTail);
+
+			FQuat rotation = currentTransform.GetRotation();
+
+			sData.m_resultQuat = FQuat::FindBetween((rotation * sData.m_boneAxis).GetSafeNormal(),
+				(nextTail - currentTransform.GetLocation()).GetSafeNormal()) * rotation;
+
+			sData.m_transform.SetRotation(sData.m_resultQuat);
+		}
+	}
+
+	void VRMSpring::Update(const VRMSpringSimParams& Params, float DeltaTime, const FTransform& ComponentTransform,
+		const TArray<VRMSpringColliderGroup>& colliderGroup,
+		int32 LoopCount, int32 LevelNum) {
+
+		if (skeletalMesh == nullptr) {
+			return;
+		}
 
-					sData.m_prevTail = ComponentToLocal.InverseTransformPosition(currentTail);
-					sData.m_currentTail = ComponentToLocal.InverseTransformPosition(nextTail);
+		// crowd mode integrates in the buffer of the batch. sized on the first own update
+		if (JointSoA.Length.Num() < SpringData.Num()) {
+			JointSoA.SetNum(SpringData.Num());
+		}
+		VRMSpringStatCounter Counter;
 
-					FQuat rotation = ParentRotation * m_localRotation;
+		BeginUpdate(Params, ComponentTransform, colliderGroup);
 
-					sData.m_resultQuat = FQuat::FindBetween((rotation * sData.m_boneAxis).GetSafeNormal(),
-						(nextTail - currentTransform.GetLocation()).GetSafeNormal()) * rotation;
+		const int MAX_LOOP = GetLoopCount(Params, LoopCount);
+		for (int i = 0; i < MAX_LOOP; ++i) {
+			BeginLoop(Params, DeltaTime / (float)MAX_LOOP);
 
-					currentTransform.SetRotation(sData.m_resultQuat);
+			// joints of the same depth are independent. integrate them together with JointSoA
+			for (int level = 0; level + 1 < LevelStart.Num(); ++level) {
+				if (PrepareLevel(level, LevelNum, JointSoA, 0, Counter) == false) {
+					continue;
 				}
-			}// chain loop
+				{
+					SCOPE_CYCLE_COUNTER(STAT_VRM4USpring_Integrate);
+					// 前フレームの移動を継続する(減衰もあるよ) + 長さをboneLengthに強制
+					JointSoA.Integrate(LevelStart[level], LevelStart[level + 1]);
+				}
+				FinishLevel(Params, level, colliderGroup, JointSoA, 0, Counter);
+			}// level loop
 		}// delta time loop
 	}
 
 
 	void VRMSpringManager::reset() {
 		spring.Empty();
+		CompiledBoneNum = INDEX_NONE;
 		bInit = false;
 	}
 
-	void VRMSpringManager::init(const UVrmMetaObject* meta, FComponentSpacePoseContext& Output) {
-		if (meta == nullptr) {
-			UE_LOG(LogVRM4U, Warning, TEXT("[VRM4U SpringBone] Init failed: VrmMetaObject is null. SpringBone physics will not work."));
-			return;
+	static void buildIndependentGroups(const TArray<VRMSpring>& spring, TArray<int32>& GroupSpring, TArray<int32>& GroupStart) {
+		// springs which share a bone must be evaluated in the same group, in spring order
+		TArray<int32> Root;
+		Root.SetNumUninitialized(spring.Num());
+		for (int32 i = 0; i < spring.Num(); ++i) {
+			Root[i] = i;
+		}
+		auto findRoot = [&Root](int32 i) {
+			while (Root[i] != i) {
+				Root[i] = Root[Root[i]];
+				i = Root[i];
+			}
+			return i;
+		};
+
+		TMap<int32, int32> BoneOwner;
+		for (int32 i = 0; i < spring.Num(); ++i) {
+			for (const auto& sData : spring[i].SpringData) {
+				const int32* owner = BoneOwner.Find(sData.boneIndex);
+				if (owner == nullptr) {
+					BoneOwner.Add(sData.boneIndex, i);
+					continue;
+				}
+				const int32 a = findRoot(*owner);
+				const int32 b = findRoot(i);
+				// smaller index becomes root. keeps group order stable
+				Root[FMath::Max(a, b)] = FMath::Min(a, b);
+			}
 		}
-		if (bInit) return;
 
-		if (meta->GetVRMVersion() == 1) return;
-		if (meta->VrmAssetListObject == nullptr) {
-			UE_LOG(LogVRM4U, Warning, TEXT("[VRM4U SpringBone] Init failed: VrmAssetListObject is null. SpringBone physics will not work."));
-			return;
+		GroupSpring.Reset(spring.Num());
+		GroupStart.Reset();
+		for (int32 i = 0; i < spring.Num(); ++i) {
+			if (findRoot(i) != i) {
+				continue;
+			}
+			GroupStart.Add(GroupSpring.Num());
+			for (int32 j = i; j < spring.Num(); ++j) {
+				if (findRoot(j) == i) {
+					GroupSpring.Add(j);
+				}
+			}
 		}
+		GroupStart.Add(GroupSpring.Num());
 
-		skeletalMesh = VRMGetSkinnedAsset(Output.AnimInstanceProxy->GetSkelMeshComponent());
-		//skeletalMesh = meta->SkeletalMesh;
-		const FReferenceSkeleton& RefSkeleton = VRMGetRefSkeleton(skeletalMesh);
-		const auto& RefSkeletonTransform = Output.Pose.GetPose().GetBoneContainer().GetRefPoseArray();
+		UE_LOG(LogVRM4U, Log, TEXT("[VRM4U SpringBone] %d spring groups are split into %d independent groups"), spring.Num(), GroupStart.Num() - 1);
+	}
+	static TSharedPtr<VRMSpringTopology> buildTopology(const UVrmMetaObject* meta, USkeletalMesh* mesh, const TArray<FTransform>& RefSkeletonTransform) {
+		auto Result = MakeShared<VRMSpringManagerTopology>();
+		auto& spring = Result->spring;
+		auto& colliderGroup = Result->colliderGroup;
+
+		const FReferenceSkeleton& RefSkeleton = VRMGetRefSkeleton(mesh);
+
+		// first child of each bone. same as GetDirectChildBones()[0] without scanning all bones per call
+		TArray<int32> FirstChild;
+		FirstChild.Init(INDEX_NONE, RefSkeleton.GetNum());
+		for (int32 i = RefSkeleton.GetNum() - 1; i > 0; --i) {
+			const int32 p = RefSkeleton.GetParentIndex(i);
+			if (p != INDEX_NONE) {
+				FirstChild[p] = i;
+			}
+		}
 
 		const int32 SpringCount = meta->VRMSpringMeta.Num();
 		UE_LOG(LogVRM4U, Log, TEXT("[VRM4U SpringBone] Initializing VRM0 SpringBone: Found %d spring groups in metadata"), SpringCount);
@@ -304,13 +770,15 @@ namespace VRMSpringBone {
 			auto& s = spring[i];
 			const auto& metaS = meta->VRMSpringMeta[i];
 
-			s.skeletalMesh = skeletalMesh;// meta->SkeletalMesh;
+			s.skeletalMesh = mesh;// meta->SkeletalMesh;
 
 			s.stiffness = metaS.stiffness;
 			s.gravityPower = metaS.gravityPower;
 			s.gravityDir = meta->VrmAssetListObject->model_root_transform.TransformVector(metaS.gravityDir);
 			s.dragForce = metaS.dragForce;
 			s.hitRadius = metaS.hitRadius;
+			s.WindTime = 0.f;
+			s.WindPhase = i * 7.31f + 0.5f;
 
 			s.RootSpringData.SetNum(metaS.bones.Num());
 			int32 ValidBoneCount = 0;
@@ -325,27 +793,26 @@ namespace VRMSpringBone {
 			}
 			UE_LOG(LogVRM4U, Log, TEXT("[VRM4U SpringBone] Spring group %d: %d/%d bones found (stiffness=%.2f, gravity=%.2f, drag=%.2f, hitRadius=%.2f)"),
 				i, ValidBoneCount, metaS.bones.Num(), s.stiffness, s.gravityPower, s.dragForce, s.hitRadius);
-			// TODO add child
 
-			s.SpringDataChain.SetNum(metaS.bones.Num());
+			s.SpringData.Reset();
 			for (int scount = 0; scount < s.RootSpringData.Num(); ++scount) {
-				auto& chain = s.SpringDataChain[scount];
-
 				//root
+				int32 jointNo = INDEX_NONE;
 				{
-					auto index = VRMGetRefSkeleton(skeletalMesh).FindBoneIndex(*metaS.boneNames[scount]);
+					auto index = s.RootSpringData[scount].boneIndex;
 					if (index == INDEX_NONE) {
 						continue;
 					}
 
-					auto& sData = chain.AddDefaulted_GetRef();
-					sData.boneName = *metaS.boneNames[scount];
+					jointNo = s.SpringData.AddDefaulted();
+					auto& sData = s.SpringData[jointNo];
+					sData.boneName = s.RootSpringData[scount].boneName;
 					sData.boneIndex = index;
+					sData.parent = INDEX_NONE;
 
-					TArray<int32> Children;
-					VRMUtil::GetDirectChildBones(VRMGetRefSkeleton(skeletalMesh), sData.boneIndex, Children);
-					if (Children.Num() > 0) {
-						sData.m_boneAxis = RefSkeletonTransform[Children[0]].GetLocation();
+					const int32 child = FirstChild[sData.boneIndex];
+					if (child != INDEX_NONE) {
+						sData.m_boneAxis = RefSkeletonTransform[child].GetLocation();
 					}
 					else {
 						sData.m_boneAxis = RefSkeletonTransform[sData.boneIndex].GetLocation() * 0.7f;
@@ -355,22 +822,22 @@ namespace VRMSpringBone {
 				// child
 				if (1) {
 					for (int chainCount = 0; chainCount < 100; ++chainCount) {
-						bool bLast = false;
-						TArray<int32> Children;
-
-						VRMUtil::GetDirectChildBones(VRMGetRefSkeleton(skeletalMesh), chain[chainCount].boneIndex, Children);
-						if (Children.Num() <= 0) {
+						const int32 childBone = FirstChild[s.SpringData[jointNo].boneIndex];
+						if (childBone == INDEX_NONE) {
 							break;
 						}
 
-						auto& sData = chain.AddDefaulted_GetRef();
+						const int32 parentJointNo = jointNo;
+						jointNo = s.SpringData.AddDefaulted();
+						auto& sData = s.SpringData[jointNo];
 
-						sData.boneIndex = Children[0];
+						sData.boneIndex = childBone;
 						sData.boneName = *RefSkeleton.GetBoneName(sData.boneIndex).ToString();
+						sData.parent = parentJointNo;
 
-						VRMUtil::GetDirectChildBones(VRMGetRefSkeleton(skeletalMesh), sData.boneIndex, Children);
-						if (Children.Num() > 0) {
-							sData.m_boneAxis = RefSkeletonTransform[Children[0]].GetLocation();
+						const int32 child = FirstChild[sData.boneIndex];
+						if (child != INDEX_NONE) {
+							sData.m_boneAxis = RefSkeletonTransform[child].GetLocation();
 						}
 						else {
 							sData.m_boneAxis = RefSkeletonTransform[sData.boneIndex].GetLocation() * 0.7f;
@@ -378,6 +845,10 @@ namespace VRMSpringBone {
 					}
 				}
 			}
+			for (auto& sData : s.SpringData) {
+				sData.m_length = sData.m_boneAxis.Size();
+			}
+			s.SortByDepth();
 
 
 			s.ColliderGroupIndexArray.SetNum(metaS.ColliderIndexArray.Num());
@@ -387,58 +858,6 @@ namespace VRMSpringBone {
 
 		}
 
-		// init default transform
-		{
-			const FTransform ComponentTransform = Output.AnimInstanceProxy->GetComponentTransform();
-			for (auto& s : spring) {
-				for (auto& root : s.SpringDataChain) {
-					FTransform currentTransform = FTransform::Identity;
-
-					for (int ChildCount = 0; ChildCount < root.Num(); ++ChildCount) {
-						//for (auto& sData : root) {
-						auto& sData = root[ChildCount];
-						sData.m_length = sData.m_boneAxis.Size();
-						int myBoneIndex = RefSkeleton.FindBoneIndex(sData.boneName);
-
-#if	UE_VERSION_OLDER_THAN(5,0,0)
-						if (sData.boneIndex >= Output.Pose.GetPose().GetBoneContainer().GetSkeletonToPoseBoneIndexArray().Num()) {
-							continue;
-						}
-#else
-						if (Output.Pose.GetPose().GetBoneContainer().GetMeshPoseIndexFromSkeletonPoseIndex(FSkeletonPoseBoneIndex(sData.boneIndex)) == FMeshPoseBoneIndex(INDEX_NONE)) {
-							continue;
-						}
-#endif
-
-						{
-							FQuat ParentRotation = FQuat::Identity;
-							if (ChildCount == 0) {
-								FCompactPoseBoneIndex uu = Output.Pose.GetPose().GetBoneContainer().GetCompactPoseIndexFromSkeletonIndex(myBoneIndex);
-
-								if (Output.Pose.GetPose().IsValidIndex(uu) == false) {
-									continue;
-								}
-
-								FTransform NewBoneTM = Output.Pose.GetComponentSpaceTransform(uu);
-								ParentRotation = NewBoneTM.GetRotation();
-
-								currentTransform = NewBoneTM;
-							}
-							else {
-								auto c = RefSkeletonTransform[sData.boneIndex];
-								auto t = c * currentTransform;
-
-								ParentRotation = t.GetRotation();
-								currentTransform = t;
-							}
-						}
-						FVector v = currentTransform.GetLocation() + sData.m_boneAxis;
-						sData.m_currentTail = sData.m_prevTail = ComponentTransform.TransformPosition(v);
-					}
-				}
-			}
-		}
-
 		// collider
 		colliderGroup.SetNum(meta->VRMColliderMeta.Num());
 		int32 TotalColliderCount = 0;
@@ -452,93 +871,340 @@ namespace VRMSpringBone {
 			cg.colliders.SetNum(cmeta.collider.Num());
 			TotalColliderCount += cmeta.collider.Num();
 			for (int c = 0; c < cg.colliders.Num(); ++c) {
-				cg.colliders[c].offset = cmeta.collider[c].offset;
-				cg.colliders[c].radius = cmeta.collider[c].radius;
+				auto& col = cg.colliders[c];
+				col.offset = cmeta.collider[c].offset;
+				col.radius = cmeta.collider[c].radius;
+
+				auto offs = col.offset;
+				//offs.Set(offs.X, -offs.Z, offs.Y);	// 本来はこれが正しいが、VRM0の座標が間違っている
+				offs.Set(-offs.X, offs.Z, offs.Y);		// VRM0の仕様としては これ
+				col.ueOffset = offs * 100.f;
+				col.ueRadius = col.radius * 100.f;
 			}
-
-			TArray<VRMSpringCollider> colliders;
 		}
 		
 		UE_LOG(LogVRM4U, Log, TEXT("[VRM4U SpringBone] Initialized %d collider groups with %d total colliders"), colliderGroup.Num(), TotalColliderCount);
 
 
-		bInit = true;
-		UE_LOG(LogVRM4U, Log, TEXT("[VRM4U SpringBone] VRM0 SpringBone initialization complete. Physics is active."));
+		buildIndependentGroups(spring, Result->GroupSpring, Result->GroupStart);
+		return Result;
 	}
-	void VRMSpringManager::update(const FAnimNode_VrmSpringBone* animNode, float DeltaTime, FComponentSpacePoseContext& Output, TArray<FBoneTransform>& OutBoneTransforms) {
-		for (int i = 0; i < spring.Num(); ++i) {
-			FTransform c;
-			//c = Output.AnimInstanceProxy->GetComponentTransform();
-			c = Output.AnimInstanceProxy->GetActorTransform();
 
-			spring[i].Update(animNode, DeltaTime, c, colliderGroup, Output);
-		}
+	void VRMSpringManager::initTopology(const TSharedPtr<const VRMSpringTopology>& InTopology) {
+		Topology = InTopology;
+		const auto& topo = static_cast<const VRMSpringManagerTopology&>(*Topology);
+		spring = topo.spring;
+		colliderGroup = topo.colliderGroup;
+		GroupSpring = topo.GroupSpring;
+		GroupStart = topo.GroupStart;
 	}
-	void VRMSpringManager::applyToComponent(FComponentSpacePoseContext& Output, TArray<FBoneTransform>& OutBoneTransforms) {
-
-		const auto RefSkeleton = Output.AnimInstanceProxy->GetSkeleton()->GetReferenceSkeleton();
-		const auto& RefSkeletonTransform = Output.Pose.GetPose().GetBoneContainer().GetRefPoseArray();
-
-
-		VRMSpringManager* SpringManager = this;
-
-		for (auto& springRoot : SpringManager->spring) {
-			for (auto& sChain : springRoot.SpringDataChain) {
-				int BoneChain = 0;
 
-				FTransform CurrentTransForm = FTransform::Identity;
-				for (auto& sData : sChain) {
+	void VRMSpringManager::init(const UVrmMetaObject* meta, FComponentSpacePoseContext& Output) {
+		TRACE_CPUPROFILER_EVENT_SCOPE(VRM4USpring_Init);
+		SCOPE_CYCLE_COUNTER(STAT_VRM4USpring_Init);
 
+		if (meta == nullptr) {
+			UE_LOG(LogVRM4U, Warning, TEXT("[VRM4U SpringBone] Init failed: VrmMetaObject is null. SpringBone physics will not work."));
+			return;
+		}
+		if (bInit) return;
 
-					//FCompactPoseBoneIndex uu = Output.Pose.GetPose().GetBoneContainer().GetCompactPoseIndexFromSkeletonIndex(sData.boneIndex);
-					FCompactPoseBoneIndex uu(sData.boneIndex);
+		if (meta->GetVRMVersion() == 1) return;
+		if (meta->VrmAssetListObject == nullptr) {
+			UE_LOG(LogVRM4U, Warning, TEXT("[VRM4U SpringBone] Init failed: VrmAssetListObject is null. SpringBone physics will not work."));
+			return;
+		}
 
-					if (Output.Pose.GetPose().IsValidIndex(uu) == false) {
-						continue;
-					}
+		skeletalMesh = VRMGetSkinnedAsset(Output.AnimInstanceProxy->GetSkelMeshComponent());
+		//skeletalMesh = meta->SkeletalMesh;
 
-					FTransform NewBoneTM;
+		// chains and colliders are the same for all instances of this model. build once
+		initTopology(VRMSpringTopologyCache::FindOrBuild(meta, skeletalMesh, 0, [&]() {
+			return buildTopology(meta, skeletalMesh, Output.Pose.GetPose().GetBoneContainer().GetRefPoseArray());
+		}));
 
-					if (BoneChain == 0) {
-						NewBoneTM = Output.Pose.GetComponentSpaceTransform(uu);
-						NewBoneTM.SetRotation(sData.m_resultQuat);
+		compileBones(Output.Pose.GetPose().GetBoneContainer());
 
-						CurrentTransForm = NewBoneTM;
+		// init default transform
+		{
+			const FTransform ComponentTransform = Output.AnimInstanceProxy->GetComponentTransform();
+			for (auto& s : spring) {
+				for (auto& sData : s.SpringData) {
+					if (sData.parent == INDEX_NONE) {
+						sData.m_bValid = (sData.compactIndex != INDEX_NONE);
+						if (sData.m_bValid) {
+							sData.m_transform = Output.Pose.GetComponentSpaceTransform(FCompactPoseBoneIndex(sData.compactIndex));
+						}
 					}
 					else {
-
-						NewBoneTM = CurrentTransForm;
-
-						auto c = RefSkeletonTransform[sData.boneIndex];
-						NewBoneTM = c * NewBoneTM;
-						NewBoneTM.SetRotation(sData.m_resultQuat);
-
-
-						//const FTransform ComponentTransform = Output.AnimInstanceProxy->GetComponentTransform();
-						//NewBoneTM.SetLocation(ComponentTransform.TransformPosition(sData.m_currentTail));
-
-						CurrentTransForm = NewBoneTM;
-					}
-
-					FBoneTransform a(uu, NewBoneTM);
-
-					bool bFirst = true;
-					for (auto& t : OutBoneTransforms) {
-						if (t.BoneIndex == a.BoneIndex) {
-							bFirst = false;
-							break;
+						const auto& parent = s.SpringData[sData.parent];
+						sData.m_bValid = parent.m_bValid;
+						if (sData.m_bValid) {
+							sData.m_transform = sData.refPose * parent.m_transform;
 						}
 					}
-
-					if (bFirst) {
-						OutBoneTransforms.Add(a);
+					if (sData.m_bValid == false) {
+						continue;
 					}
-					BoneChain++;
+					// pipelined and crowd evaluation output this before the first simulate
+					sData.m_resultQuat = sData.m_prevResultQuat = sData.m_lodFromQuat = sData.m_transform.GetRotation();
+					FVector v = sData.m_transform.GetLocation() + sData.m_boneAxis;
+					sData.m_currentTail = sData.m_prevTail = ComponentTransform.TransformPosition(v);
 				}
 			}
-
 		}
-		OutBoneTransforms.Sort(FCompareBoneTransformIndex());
+
+		bInit = true;
+		UE_LOG(LogVRM4U, Log, TEXT("[VRM4U SpringBone] VRM0 SpringBone initialization complete. Physics is active."));
+	}
+
+	void VRMSpringManager::compileBones(const FBoneContainer& RequiredBones) {
+		// resolve bone names once. update() and applyToComponent() only use compact pose indices
+		const USkeleton* Skeleton = RequiredBones.GetSkeletonAsset();
+		if (Skeleton == nullptr || skeletalMesh == nullptr) {
+			return;
+		}
+		const FReferenceSkeleton& SkeletonRef = Skeleton->GetReferenceSkeleton();
+		const auto& MeshRefPose = VRMGetRefSkeleton(skeletalMesh).GetRefBonePose();
+
+		auto toCompactIndex = [&](const FName& boneName) {
+			const int32 SkeletonIndex = SkeletonRef.FindBoneIndex(boneName);
+			if (SkeletonIndex == INDEX_NONE) {
+				return (int32)INDEX_NONE;
+			}
+			return RequiredBones.GetCompactPoseIndexFromSkeletonIndex(SkeletonIndex).GetInt();
+		};
+
+		for (auto& s : spring) {
+			for (auto& sData : s.SpringData) {
+				sData.compactIndex = toCompactIndex(sData.boneName);
+				if (sData.compactIndex != INDEX_NONE) {
+					sData.refPose = RequiredBones.GetRefPoseTransform(FCompactPoseBoneIndex(sData.compactIndex));
+				} else if (MeshRefPose.IsValidIndex(sData.boneIndex)) {
+					// stripped by LOD. keep chain shape from mesh ref pose
+					sData.refPose = MeshRefPose[sData.boneIndex];
+				}
+			}
+
+			// chain reach for broadphase
+			s.UpdateChainReach();
+		}
+		for (auto& cg : colliderGroup) {
+			cg.compactIndex = toCompactIndex(cg.node_name);
+		}
+
+		// output order. first writer of a bone wins, then walk bones in compact order so no sort is needed
+		const int32 NumBones = RequiredBones.GetCompactPoseNumBones();
+		TArray<FIntPoint> BoneWriter;
+		BoneWriter.Init(FIntPoint(INDEX_NONE, INDEX_NONE), NumBones);
+		for (int springNo = 0; springNo < spring.Num(); ++springNo) {
+			const auto& s = spring[springNo];
+			for (int jointNo = 0; jointNo < s.SpringData.Num(); ++jointNo) {
+				const int32 c = s.SpringData[jointNo].compactIndex;
+				if (BoneWriter.IsValidIndex(c) && BoneWriter[c].X == INDEX_NONE) {
+					BoneWriter[c] = FIntPoint(springNo, jointNo);
+				}
+			}
+		}
+		EmitOrder.Reset();
+		for (const auto& w : BoneWriter) {
+			if (w.X != INDEX_NONE) {
+				EmitOrder.Add(w);
+			}
+		}
+
+		CompiledBoneNum = NumBones;
+	}
+
+	void VRMSpringManager::compileJointParams(const TArray<FVrmSpringJointOverride>& Overrides, const TArray<FName>& NoWindBoneNameList) {
+		for (auto& s : spring) {
+			s.JointParams.Resolve(Overrides, NoWindBoneNameList, s.SpringData.Num(),
+				[&](int32 i) { return s.SpringData[i].boneName; },
+				[&](int32 i) { return s.SpringData[i].parent; });
+		}
+	}
+
+	void VRMSpringManager::fetchPose(const VRMSpringSimParams& Params, FComponentSpacePoseContext& Output) {
+		TRACE_CPUPROFILER_EVENT_SCOPE(VRM4USpring_FetchPose);
+		SCOPE_CYCLE_COUNTER(STAT_VRM4USpring_Fetch);
+
+		if (CompiledBoneNum != Output.Pose.GetPose().GetNumBones()) {
+			// CacheBones is not called when evaluated from AnimInstance proxy
+			compileBones(Output.Pose.GetPose().GetBoneContainer());
+		}
+
+		// FCSPose calculates component space lazily and is not thread safe. fetch everything before the spring update
+		for (auto& cg : colliderGroup) {
+			if (cg.compactIndex != INDEX_NONE) {
+				cg.m_transform = Output.Pose.GetComponentSpaceTransform(FCompactPoseBoneIndex(cg.compactIndex));
+				cg.UpdateBounds();
+			}
+		}
+		for (auto& s : spring) {
+			s.FetchPose(Output);
+			if (Params.bPhysicsCollision) {
+				s.FetchWorldPrimitives(Output);
+			}
+		}
+
+		//c = Output.AnimInstanceProxy->GetActorTransform();
+		FetchedComponentTransform = Output.AnimInstanceProxy->GetComponentTransform();
+	}
+
+	void VRMSpringManager::beginSimulate() {
+		for (auto& s : spring) {
+			for (auto& sData : s.SpringData) {
+				sData.m_prevResultQuat = sData.m_resultQuat;
+			}
+		}
+		LastComponentTransform = FetchedComponentTransform;
+	}
+
+	void VRMSpringManager::simulateFetched(const VRMSpringSimParams& Params, float DeltaTime) {
+		TRACE_CPUPROFILER_EVENT_SCOPE(VRM4USpring_Simulate);
+		beginSimulate();
+
+		// world collision reads physics bodies. keep it on a single thread
+		const bool bParallel = Params.bParallelEvaluation
+			&& Params.bPhysicsCollision == false
+			&& GroupStart.Num() > 2;
+
+		// each group writes its own springs only. the result does not depend on the thread count
+		ParallelFor(FMath::Max(0, GroupStart.Num() - 1), [&](int32 groupNo) {
+			for (int32 n = GroupStart[groupNo]; n < GroupStart[groupNo + 1]; ++n) {
+				spring[GroupSpring[n]].Update(Params, DeltaTime, FetchedComponentTransform, colliderGroup, LODLoopCount, LODLevelNum);
+			}
+		}, bParallel == false);
+	}
+
+	int32 VRMSpringManager::beginCrowdStep(const VRMSpringSimParams& Params, float DeltaTime) {
+		beginSimulate();
+
+		CrowdLoopCount = VRMSpring::GetLoopCount(Params, LODLoopCount);
+		CrowdLoopDeltaTime = DeltaTime / (float)CrowdLoopCount;
+		CrowdLevelNum = 0;
+		for (auto& s : spring) {
+			if (s.skeletalMesh == nullptr) {
+				continue;
+			}
+			s.BeginUpdate(Params, FetchedComponentTransform, colliderGroup);
+			CrowdLevelNum = FMath::Max(CrowdLevelNum, s.LevelStart.Num() - 1);
+		}
+		// springs are independent, so a pass is one level of all springs. substeps follow each other
+		return CrowdLoopCount * CrowdLevelNum;
+	}
+
+	int32 VRMSpringManager::getCrowdPassJointNum(int32 Pass) const {
+		const int32 level = Pass % CrowdLevelNum;
+		int32 num = 0;
+		for (const auto& s : spring) {
+			num += s.GetLevelJointNum(level, LODLevelNum);
+		}
+		return num;
+	}
+
+	void VRMSpringManager::prepareCrowdPass(const VRMSpringSimParams& Params, int32 Pass, VRMSpringJointSoA& SoA, int32 Base) {
+		const int32 level = Pass % CrowdLevelNum;
+		VRMSpringStatCounter Counter;
+		for (auto& s : spring) {
+			if (s.skeletalMesh == nullptr) {
+				continue;
+			}
+			if (level == 0) {
+				s.BeginLoop(Params, CrowdLoopDeltaTime);
+			}
+			if (level + 1 >= s.LevelStart.Num()) {
+				continue;
+			}
+			// springs are packed in order. the joints of the level start at Base
+			s.PrepareLevel(level, LODLevelNum, SoA, Base - s.LevelStart[level], Counter);
+			Base += s.GetLevelJointNum(level, LODLevelNum);
+		}
+	}
+
+	void VRMSpringManager::finishCrowdPass(const VRMSpringSimParams& Params, int32 Pass, const VRMSpringJointSoA& SoA, int32 Base) {
+		const int32 level = Pass % CrowdLevelNum;
+		VRMSpringStatCounter Counter;
+		for (auto& s : spring) {
+			const int32 num = s.GetLevelJointNum(level, LODLevelNum);
+			if (num == 0) {
+				continue;
+			}
+			s.FinishLevel(Params, level, colliderGroup, SoA, Base - s.LevelStart[level], Counter);
+			Base += num;
+		}
+	}
+
+	void VRMSpringManager::applyToComponent(FComponentSpacePoseContext& Output, TArray<FBoneTransform>& OutBoneTransforms) {
+		SCOPE_CYCLE_COUNTER(STAT_VRM4USpring_Apply);
+
+		VRMSpringManager* SpringManager = this;
+
+		// parents are stored before children
+		for (auto& springRoot : SpringManager->spring) {
+			for (auto& sData : springRoot.SpringData) {
+
+				FTransform& NewBoneTM = sData.m_transform;
+
+				if (sData.parent == INDEX_NONE) {
+					sData.m_bValid = (sData.compactIndex != INDEX_NONE);
+					if (sData.m_bValid == false) {
+						continue;
+					}
+					NewBoneTM = Output.Pose.GetComponentSpaceTransform(FCompactPoseBoneIndex(sData.compactIndex));
+					NewBoneTM.SetRotation(GetOutputRotation(sData.m_prevResultQuat, sData.m_resultQuat, sData.m_lodFromQuat));
+				}
+				else {
+					const auto& parent = springRoot.SpringData[sData.parent];
+					sData.m_bValid = parent.m_bValid;
+					if (sData.m_bValid == false) {
+						continue;
+					}
+
+					NewBoneTM = sData.refPose * parent.m_transform;
+					NewBoneTM.SetRotation(GetOutputRotation(sData.m_prevResultQuat, sData.m_resultQuat, sData.m_lodFromQuat));
+
+					//const FTransform ComponentTransform = Output.AnimInstanceProxy->GetComponentTransform();
+					//NewBoneTM.SetLocation(ComponentTransform.TransformPosition(sData.m_currentTail));
+				}
+			}
+
+		}
+
+		// EmitOrder is already sorted by compact index and has no duplicates
+		OutBoneTransforms.Reserve(OutBoneTransforms.Num() + EmitOrder.Num());
+		for (const auto& w : EmitOrder) {
+			const auto& sData = spring[w.X].SpringData[w.Y];
+			if (sData.m_bValid) {
+				OutBoneTransforms.Add(FBoneTransform(FCompactPoseBoneIndex(sData.compactIndex), sData.m_transform));
+			}
+		}
+	}
+
+	void VRMSpringManager::forEachJointState(TFunctionRef<void(FVector&, FVector&, FQuat&, FQuat&)> Func) {
+		for (auto& s : spring) {
+			for (auto& sData : s.SpringData) {
+				Func(sData.m_prevTail, sData.m_currentTail, sData.m_resultQuat, sData.m_prevResultQuat);
+			}
+		}
+	}
+
+	int32 VRMSpringManager::getJointNum() const {
+		int32 num = 0;
+		for (const auto& s : spring) {
+			num += s.SpringData.Num();
+		}
+		return num;
+	}
+
+	void VRMSpringManager::beginLODBlend() {
+		// start from the rotation currently shown, including a blend in progress
+		for (auto& springRoot : spring) {
+			for (auto& sData : springRoot.SpringData) {
+				sData.m_lodFromQuat = GetOutputRotation(sData.m_prevResultQuat, sData.m_resultQuat, sData.m_lodFromQuat);
+			}
+		}
+		LODBlendAlpha = 0.f;
 	}
 
 }
@@ -547,36 +1213,89 @@ namespace VRMSpringBone {
 namespace VRM1Spring {
 
 	void VRM1SpringManager::reset() {
-		for (auto &j : JointStateMap) {
-			j.Value.currentTail = j.Value.prevTail = j.Value.initialTail;
+		for (auto &state : JointState) {
+			state.currentTail = state.prevTail = state.initialTail;
 		}
 	}
 
-	void VRM1SpringManager::init(const UVrmMetaObject* meta, FComponentSpacePoseContext& Output) {
+	static void compileColliders(const UVrmMetaObject* meta, VRM1SpringTopology& Result) {
+		const auto& AllColliderArray = meta->VRM1SpringBoneMeta.Colliders;
+		const auto& AllColliderGroupArray = meta->VRM1SpringBoneMeta.ColliderGroups;
+		const auto& AllSpringArray = meta->VRM1SpringBoneMeta.Springs;
+		auto& ColliderDef = Result.ColliderDef;
+		auto& GroupCollider = Result.GroupCollider;
+		auto& GroupColliderStart = Result.GroupColliderStart;
+		auto& SpringColliderGroup = Result.SpringColliderGroup;
+		auto& SpringColliderGroupStart = Result.SpringColliderGroupStart;
+
+		ColliderDef.SetNum(AllColliderArray.Num());
+		for (int colNo = 0; colNo < AllColliderArray.Num(); ++colNo) {
+			const auto& collider = AllColliderArray[colNo];
+			auto& def = ColliderDef[colNo];
+
+			def.boneName = *collider.boneName;
+			def.compactIndex = INDEX_NONE;
+			def.shape = (collider.shapeType == TEXT("sphere")) ? ESpringColliderShape::Sphere : ESpringColliderShape::Capsule;
+
+			auto offs = collider.offset;
+			offs.Set(offs.X, -offs.Z, offs.Y);
+			def.offset = offs * 100.f;
+
+			auto tail = collider.tail;
+			tail.Set(tail.X, -tail.Z, tail.Y);
+			def.tail = tail * 100.f;
+
+			def.radius = collider.radius * 100.f;
+		}
 
-		if (meta == nullptr) {
-			UE_LOG(LogVRM4U, Warning, TEXT("[VRM4U SpringBone] VRM1 init failed: VrmMetaObject is null. SpringBone physics will not work."));
-			return;
+		GroupCollider.Reset();
+		GroupColliderStart.Reset();
+		for (const auto& g : AllColliderGroupArray) {
+			GroupColliderStart.Add(GroupCollider.Num());
+			for (auto colNo : g.colliders) {
+				if (ColliderDef.IsValidIndex(colNo)) {
+					GroupCollider.Add(colNo);
+				}
+			}
 		}
+		GroupColliderStart.Add(GroupCollider.Num());
+
+		SpringColliderGroup.Reset();
+		SpringColliderGroupStart.Reset();
+		for (const auto& spr : AllSpringArray) {
+			SpringColliderGroupStart.Add(SpringColliderGroup.Num());
+			for (auto colg : spr.colliderGroups) {
+				if (AllColliderGroupArray.IsValidIndex(colg)) {
+					SpringColliderGroup.Add(colg);
+				}
+			}
+		}
+		SpringColliderGroupStart.Add(SpringColliderGroup.Num());
+	}
 
-		const FTransform ComponentTransform = Output.AnimInstanceProxy->GetComponentTransform();
-		FTransform ComponentToLocal = ComponentTransform.Inverse();
+	static TSharedPtr<VRMSpringBone::VRMSpringTopology> buildTopology(const UVrmMetaObject* meta, USkeletalMesh* mesh) {
+		auto Result = MakeShared<VRM1SpringTopology>();
 
-		vrmMetaObject = meta;
-		skeletalMesh = VRMGetSkinnedAsset(Output.AnimInstanceProxy->GetSkelMeshComponent());
-		const FReferenceSkeleton& RefSkeleton = VRMGetRefSkeleton(skeletalMesh);
-		//const auto& RefSkeletonTransform = Output.Pose.GetPose().GetBoneContainer().GetRefPoseArray();
+		const FReferenceSkeleton& RefSkeleton = VRMGetRefSkeleton(mesh);
 		const auto& RefSkeletonTransform = RefSkeleton.GetRefBonePose();
 
-		const int32 SpringCount = vrmMetaObject->VRM1SpringBoneMeta.Springs.Num();
-		const int32 ColliderCount = vrmMetaObject->VRM1SpringBoneMeta.Colliders.Num();
-		const int32 ColliderGroupCount = vrmMetaObject->VRM1SpringBoneMeta.ColliderGroups.Num();
+		const int32 SpringCount = meta->VRM1SpringBoneMeta.Springs.Num();
+		const int32 ColliderCount = meta->VRM1SpringBoneMeta.Colliders.Num();
+		const int32 ColliderGroupCount = meta->VRM1SpringBoneMeta.ColliderGroups.Num();
 		UE_LOG(LogVRM4U, Log, TEXT("[VRM4U SpringBone] Initializing VRM1 SpringBone: %d springs, %d colliders, %d collider groups"), 
 			SpringCount, ColliderCount, ColliderGroupCount);
 
+		FTransform modelRootInv = FTransform::Identity;
+		if (meta->VrmAssetListObject) {
+			modelRootInv = meta->VrmAssetListObject->model_root_transform.Inverse();
+		}
+
+		TArray<SpringBoneJointState> JointList;
+		TMap<int32, int32> BoneToSlot;
+
 		int32 TotalJointCount = 0;
-		int32 ValidJointCount = 0;
-		for (auto& s : vrmMetaObject->VRM1SpringBoneMeta.Springs) {
+		for (int springNo = 0; springNo < SpringCount; ++springNo) {
+			const auto& s = meta->VRM1SpringBoneMeta.Springs[springNo];
 			TotalJointCount += s.joints.Num();
 			for (int jointNo = 0; jointNo < s.joints.Num(); jointNo++) {
 
@@ -586,25 +1305,33 @@ namespace VRM1Spring {
 					UE_LOG(LogVRM4U, Warning, TEXT("[VRM4U SpringBone] VRM1 joint '%s' has invalid bone index"), *j1.boneName);
 					continue;
 				}
+				if (RefSkeletonTransform.IsValidIndex(j1.boneNo) == false) {
+					UE_LOG(LogVRM4U, Warning, TEXT("[VRM4U SpringBone] VRM1 joint '%s' bone index %d out of range"), *j1.boneName, j1.boneNo);
+					continue;
+				}
 
 				int parentBoneIndex = RefSkeleton.GetParentIndex(j1.boneNo);
 				if (parentBoneIndex < 0) {
 					UE_LOG(LogVRM4U, Warning, TEXT("[VRM4U SpringBone] VRM1 joint '%s' has no parent bone"), *j1.boneName);
 					continue;
 				}
-				FCompactPoseBoneIndex uu = Output.Pose.GetPose().GetBoneContainer().GetCompactPoseIndexFromSkeletonIndex(parentBoneIndex);
-				if (Output.Pose.GetPose().IsValidIndex(uu) == false) {
-					UE_LOG(LogVRM4U, Warning, TEXT("[VRM4U SpringBone] VRM1 joint '%s' parent not in pose"), *j1.boneName);
+				if (BoneToSlot.Contains(j1.boneNo)) {
+					UE_LOG(LogVRM4U, Warning, TEXT("[VRM4U SpringBone] VRM1 joint '%s' is used by more than one spring"), *j1.boneName);
 					continue;
 				}
-				FTransform parentTransform = Output.Pose.GetComponentSpaceTransform(uu);
+				BoneToSlot.Add(j1.boneNo, JointList.Num());
 
-				auto& state = JointStateMap.FindOrAdd(j1.boneNo);
+				auto& state = JointList.AddDefaulted_GetRef();
+				state.boneNo = j1.boneNo;
+				state.parentBoneNo = parentBoneIndex;
+				state.springNo = springNo;
 
-				if (RefSkeletonTransform.IsValidIndex(j1.boneNo) == false) {
-					UE_LOG(LogVRM4U, Warning, TEXT("[VRM4U SpringBone] VRM1 joint '%s' bone index %d out of range"), *j1.boneName, j1.boneNo);
-					continue;
-				}
+				state.hitRadius = j1.hitRadius * 100.f;
+				state.stiffness = j1.stiffness;
+				state.dragForce = j1.dragForce;
+				state.gravityPower = j1.gravityPower;
+				FVector ue4grav(-j1.gravityDir.X, j1.gravityDir.Z, j1.gravityDir.Y);
+				state.gravityDir = modelRootInv.TransformVector(ue4grav);
 
 				state.initialLocalMatrix = RefSkeletonTransform[j1.boneNo];
 				state.initialLocalRotation = RefSkeletonTransform[j1.boneNo].GetRotation();
@@ -615,344 +1342,558 @@ namespace VRM1Spring {
 				state.boneLength = RefSkeletonTransform[j1.boneNo].GetLocation().Length();
 #endif
 				state.boneAxis = RefSkeletonTransform[j1.boneNo].TransformPosition(FVector::ZeroVector).GetSafeNormal();
+			}
+		}
 
-				{
-					FCompactPoseBoneIndex u = Output.Pose.GetPose().GetBoneContainer().GetCompactPoseIndexFromSkeletonIndex(j1.boneNo);
-					auto t = Output.Pose.GetComponentSpaceTransform(u);
+		// 親が揺れ骨なら、そのslot。別のSpringの骨も含む
+		const int32 Num = JointList.Num();
+		for (auto& state : JointList) {
+			const int32* p = BoneToSlot.Find(state.parentBoneNo);
+			state.parentSlot = p ? *p : INDEX_NONE;
+		}
 
-					state.prevTail = 
-						state.currentTail =
-						state.initialTail = ComponentToLocal.InverseTransformPosition(t.GetLocation());
+		// sort by depth. a parent may belong to a later spring, so walk up the chain
+		TArray<int32> Depth;
+		Depth.SetNumUninitialized(Num);
+		int32 MaxDepth = 0;
+		for (int32 i = 0; i < Num; ++i) {
+			int32 d = 0;
+			for (int32 p = JointList[i].parentSlot; p != INDEX_NONE; p = JointList[p].parentSlot) {
+				++d;
+			}
+			Depth[i] = d;
+			MaxDepth = FMath::Max(MaxDepth, d);
+		}
 
-					state.resultQuat = t.GetRotation();
+		TArray<int32> Order;
+		Order.Reserve(Num);
+		auto& LevelStart = Result->LevelStart;
+		LevelStart.Reset();
+		for (int32 d = 0; d <= MaxDepth && Num > 0; ++d) {
+			LevelStart.Add(Order.Num());
+			for (int32 i = 0; i < Num; ++i) {
+				if (Depth[i] == d) {
+					Order.Add(i);
 				}
-				ValidJointCount++;
 			}
 		}
-		bInit = true;
-		UE_LOG(LogVRM4U, Log, TEXT("[VRM4U SpringBone] VRM1 SpringBone initialization complete. %d/%d joints initialized successfully. Physics is active."), 
-			ValidJointCount, TotalJointCount);
-	}
-
-	void VRM1SpringManager::update(const FAnimNode_VrmSpringBone* animNode, float DeltaTime, FComponentSpacePoseContext& Output, TArray<FBoneTransform>& OutBoneTransforms) {
+		LevelStart.Add(Order.Num());
 
-		if (skeletalMesh == nullptr) {
-			return;
+		TArray<int32> NewIndex;
+		NewIndex.SetNumUninitialized(Num);
+		for (int32 i = 0; i < Num; ++i) {
+			NewIndex[Order[i]] = i;
 		}
-		if (FMath::IsNearlyZero(DeltaTime)) {
-			return;
-		}
-
-		const auto RefSkeleton = Output.AnimInstanceProxy->GetSkeleton()->GetReferenceSkeleton();
-		//const auto& RefSkeletonTransform = Output.Pose.GetPose().GetBoneContainer().GetRefPoseArray();
-		const auto& RefSkeletonTransform = RefSkeleton.GetRefBonePose();
-
-		const FTransform ComponentTransform = Output.AnimInstanceProxy->GetComponentTransform();
-		// モデルローカル座標
-		// 			FTransform c;
-		//c = Output.AnimInstanceProxy->GetComponentTransform();
-		//c = Output.AnimInstanceProxy->GetActorTransform();
 
-		const FTransform ComponentToLocal = ComponentTransform.Inverse();
-
-		// 計算した揺れ骨、または揺れ骨の親
-		TMap<int, FTransform> calcTransform;
+		auto& JointState = Result->JointState;
+		JointState.Reset(Num);
+		for (int32 i = 0; i < Num; ++i) {
+			auto& state = JointState.Add_GetRef(JointList[Order[i]]);
+			if (state.parentSlot != INDEX_NONE) {
+				state.parentSlot = NewIndex[state.parentSlot];
+			}
+		}
 
-		// 揺れ骨一覧
-		TArray<int> springBoneNoList;
+		auto& SpringReach = Result->SpringReach;
+		auto& SpringMaxHitRadius = Result->SpringMaxHitRadius;
+		SpringReach.SetNumZeroed(SpringCount);
+		SpringMaxHitRadius.SetNumZeroed(SpringCount);
 		{
-			for (auto& s : vrmMetaObject->VRM1SpringBoneMeta.Springs) {
-				for (auto& j : s.joints) {
-					springBoneNoList.AddUnique(j.boneNo);
-				}
+			TArray<float> maxLength;
+			maxLength.SetNumZeroed(SpringCount);
+			for (const auto& state : JointState) {
+				SpringReach[state.springNo] += state.boneLength;
+				maxLength[state.springNo] = FMath::Max(maxLength[state.springNo], state.boneLength);
+				SpringMaxHitRadius[state.springNo] = FMath::Max(SpringMaxHitRadius[state.springNo], state.hitRadius);
+			}
+			for (int springNo = 0; springNo < SpringCount; ++springNo) {
+				SpringReach[springNo] += maxLength[springNo];
 			}
 		}
 
-		for (auto& s : vrmMetaObject->VRM1SpringBoneMeta.Springs) {
-			
-			for (int jointNo = 0; jointNo < s.joints.Num(); ++jointNo) {
-				FTransform parentTransform = FTransform::Identity;
-				FTransform currentTransform = FTransform::Identity;
-
-				auto& j1 = s.joints[jointNo];
-
-				auto* state = JointStateMap.Find(j1.boneNo);
-				if (state == nullptr) {
-					init(vrmMetaObject, Output);
-					continue;
-				}
+		compileColliders(meta, *Result);
+		Result->TotalJointCount = TotalJointCount;
+		return Result;
+	}
 
-				if (RefSkeletonTransform.IsValidIndex(j1.boneNo) == false) {
-					continue;
-				}
+	void VRM1SpringManager::init(const UVrmMetaObject* meta, FComponentSpacePoseContext& Output) {
+		TRACE_CPUPROFILER_EVENT_SCOPE(VRM4USpring_Init);
+		SCOPE_CYCLE_COUNTER(STAT_VRM4USpring_Init);
 
-				int parentBoneIndex = RefSkeleton.GetParentIndex(j1.boneNo);
-				if (parentBoneIndex < 0) {
-					continue;
-				}
+		if (meta == nullptr) {
+			UE_LOG(LogVRM4U, Warning, TEXT("[VRM4U SpringBone] VRM1 init failed: VrmMetaObject is null. SpringBone physics will not work."));
+			return;
+		}
 
-				if (springBoneNoList.Find(parentBoneIndex) < 0) {
-					// 親が揺れ骨ではない。通常骨から参照
+		const FTransform ComponentTransform = Output.AnimInstanceProxy->GetComponentTransform();
 
-					// 親
-					{
-						FCompactPoseBoneIndex uu = Output.Pose.GetPose().GetBoneContainer().GetCompactPoseIndexFromSkeletonIndex(parentBoneIndex);
-						if (Output.Pose.GetPose().IsValidIndex(uu) == false) {
-							continue;
-						}
-						FTransform NewBoneTM = Output.Pose.GetComponentSpaceTransform(uu);
-						parentTransform = NewBoneTM;
-					}
+		vrmMetaObject = meta;
+		skeletalMesh = VRMGetSkinnedAsset(Output.AnimInstanceProxy->GetSkelMeshComponent());
 
-					{
-						// 自分
-						FCompactPoseBoneIndex uu = Output.Pose.GetPose().GetBoneContainer().GetCompactPoseIndexFromSkeletonIndex(j1.boneNo);
-						if (Output.Pose.GetPose().IsValidIndex(uu) == false) {
-							continue;
-						}
-						FTransform NewBoneTM = Output.Pose.GetComponentSpaceTransform(uu);
-						currentTransform = NewBoneTM;
-					}
-				} else {
-					// 親が揺れ骨。揺れ骨計算結果から参照
+		// joints and colliders are the same for all instances of this model. build once
+		initTopology(VRMSpringBone::VRMSpringTopologyCache::FindOrBuild(meta, skeletalMesh, 1, [&]() {
+			return buildTopology(meta, skeletalMesh);
+		}));
 
-					// 親
-					//parentTransform = currentTransform;
-					auto* p = calcTransform.Find(parentBoneIndex);
-					if (p) {
-						parentTransform = *p;
-					}
+		compileBones(Output.Pose.GetPose().GetBoneContainer());
 
-					auto c = RefSkeletonTransform[j1.boneNo];
-					auto t = c * parentTransform;
+		const int32 Num = JointState.Num();
+		for (int32 slot = 0; slot < Num; ++slot) {
+			auto& state = JointState[slot];
+			if (state.compactIndex == INDEX_NONE) {
+				continue;
+			}
+			const FTransform t = Output.Pose.GetComponentSpaceTransform(FCompactPoseBoneIndex(state.compactIndex));
 
-					// 自分
-					currentTransform = t;
-				}
+			state.prevTail =
+				state.currentTail =
+				state.initialTail = ComponentTransform.TransformPosition(t.GetLocation());
 
-				FQuat m_localRotation = state->initialLocalMatrix.GetRotation();
+			state.lodFromQuat =
+				state.prevResultQuat =
+				state.resultQuat = t.GetRotation();
+			JointTransform[slot] = t;
+		}
 
-				const FVector currentTail = ComponentToLocal.TransformPosition(state->currentTail);
-				const FVector prevTail = ComponentToLocal.TransformPosition(state->prevTail);
+		bInit = true;
+		UE_LOG(LogVRM4U, Log, TEXT("[VRM4U SpringBone] VRM1 SpringBone initialization complete. %d/%d joints initialized successfully. Physics is active."), 
+			Num, static_cast<const VRM1SpringTopology&>(*Topology).TotalJointCount);
+	}
 
-				const FVector inertia = (currentTail - prevTail) * (1.0f - j1.dragForce);
-				const FVector stiffness = currentTransform.GetRotation() * state->boneAxis * 1.f * DeltaTime
-					* 100.f * j1.stiffness * animNode->stiffnessScale + animNode->stiffnessAdd;
+	void VRM1SpringManager::initTopology(const TSharedPtr<const VRMSpringBone::VRMSpringTopology>& InTopology) {
+		Topology = InTopology;
+		const auto& topo = static_cast<const VRM1SpringTopology&>(*Topology);
+		JointState = topo.JointState;
+		LevelStart = topo.LevelStart;
+		SpringReach = topo.SpringReach;
+		SpringMaxHitRadius = topo.SpringMaxHitRadius;
+		ColliderDef = topo.ColliderDef;
+		GroupCollider = topo.GroupCollider;
+		GroupColliderStart = topo.GroupColliderStart;
+		SpringColliderGroup = topo.SpringColliderGroup;
+		SpringColliderGroupStart = topo.SpringColliderGroupStart;
+
+		const int32 Num = JointState.Num();
+		JointParams.Init(Num);
+		JointTransform.SetNum(Num);
+		ParentTransform.SetNum(Num);
+		RootPoseTransform.SetNum(Num);
+
+		ColliderState.SetNum(ColliderDef.Num());
+		ColliderGroupState.SetNum(FMath::Max(0, GroupColliderStart.Num() - 1));
+		ActiveColliderGroup.SetNum(SpringColliderGroup.Num());
+		ActiveColliderGroupNum.SetNum(SpringReach.Num());
+	}
 
-				FVector ue4grav(-j1.gravityDir.X, j1.gravityDir.Z, j1.gravityDir.Y);
-				ue4grav = vrmMetaObject->VrmAssetListObject->model_root_transform.Inverse().TransformVector(ue4grav);
-				FVector external = ComponentToLocal.TransformVector(ue4grav) * (j1.gravityPower * DeltaTime) * animNode->gravityScale
-					+ ComponentToLocal.TransformVector(animNode->gravityAdd) * DeltaTime;
+	void VRM1SpringManager::compileBones(const FBoneContainer& RequiredBones) {
+		const USkeleton* Skeleton = RequiredBones.GetSkeletonAsset();
+		if (Skeleton == nullptr) {
+			return;
+		}
+		const FReferenceSkeleton& SkeletonRef = Skeleton->GetReferenceSkeleton();
 
+		for (auto& def : ColliderDef) {
+			const int32 SkeletonIndex = SkeletonRef.FindBoneIndex(def.boneName);
+			def.compactIndex = (SkeletonIndex == INDEX_NONE) ? INDEX_NONE : RequiredBones.GetCompactPoseIndexFromSkeletonIndex(SkeletonIndex).GetInt();
+		}
 
-				FVector nextTailTarget = currentTail + inertia + stiffness + external;
-				//FVector nextTailTarget = currentTail + stiffness * 10;
+		for (auto& state : JointState) {
+			state.compactIndex = RequiredBones.GetCompactPoseIndexFromSkeletonIndex(state.boneNo).GetInt();
+			state.parentCompactIndex = RequiredBones.GetCompactPoseIndexFromSkeletonIndex(state.parentBoneNo).GetInt();
+			state.bActive = (state.compactIndex != INDEX_NONE) && (state.parentCompactIndex != INDEX_NONE);
+		}
 
-				// 長さをboneLengthに強制
-				FVector nextTailDirection = (nextTailTarget - currentTransform.GetLocation()).GetSafeNormal();
-				FVector nextTailPosition = currentTransform.GetLocation() + nextTailDirection * state->boneLength;
+		// output order. first writer of a bone wins, then walk bones in compact order so no sort is needed
+		const int32 NumBones = RequiredBones.GetCompactPoseNumBones();
+		TArray<int32> BoneWriter;
+		BoneWriter.Init(INDEX_NONE, NumBones);
+		for (int32 slot = 0; slot < JointState.Num(); ++slot) {
+			const auto& state = JointState[slot];
+			if (state.bActive && BoneWriter[state.compactIndex] == INDEX_NONE) {
+				BoneWriter[state.compactIndex] = slot;
+			}
+		}
+		EmitOrder.Reset();
+		for (int32 slot : BoneWriter) {
+			if (slot != INDEX_NONE) {
+				EmitOrder.Add(slot);
+			}
+		}
 
+		CompiledBoneNum = NumBones;
+	}
 
-				// vrm <-> vrm collision
-				if (animNode->bIgnoreVRMCollision == false) {
+	void VRM1SpringManager::compileJointParams(const TArray<FVrmSpringJointOverride>& Overrides, const TArray<FName>& NoWindBoneNameList) {
+		if (skeletalMesh == nullptr) {
+			return;
+		}
+		// boneNo is the index of the mesh skeleton, same as buildTopology
+		const FReferenceSkeleton& RefSkeleton = VRMGetRefSkeleton(skeletalMesh);
+		JointParams.Resolve(Overrides, NoWindBoneNameList, JointState.Num(),
+			[&](int32 slot) { return RefSkeleton.IsValidIndex(JointState[slot].boneNo) ? RefSkeleton.GetBoneName(JointState[slot].boneNo) : FName(NAME_None); },
+			[&](int32 slot) { return JointState[slot].parentSlot; });
+	}
 
-					// このSpringが参照するコライダのインデックス
-					TArray<int> checkcolliderIndexArray;
-					for (auto colg : s.colliderGroups) {
-						checkcolliderIndexArray.Append(vrmMetaObject->VRM1SpringBoneMeta.ColliderGroups[colg].colliders);
-					}
+	void VRM1SpringManager::updateColliders(FComponentSpacePoseContext& Output) {
+		// collider positions once per update. joints only read them
+		for (int colNo = 0; colNo < ColliderDef.Num(); ++colNo) {
+			const auto& def = ColliderDef[colNo];
+			auto& cs = ColliderState[colNo];
 
-					// 全てのコライダ
-					auto& AllColliderArray = vrmMetaObject->VRM1SpringBoneMeta.Colliders;
+			cs.bValid = (def.compactIndex != INDEX_NONE);
+			if (cs.bValid == false) {
+				continue;
+			}
+			const FTransform& collisionBoneTrans = Output.Pose.GetComponentSpaceTransform(FCompactPoseBoneIndex(def.compactIndex));
 
-					for (auto colNo : checkcolliderIndexArray){
-						if (colNo >= AllColliderArray.Num()) {
-							continue;
-						}
-						const auto& collider = AllColliderArray[colNo];
-
-						FTransform collisionBoneTrans;
-						{
-							int boneNo = RefSkeleton.FindBoneIndex(*collider.boneName);
-							if (boneNo < 0) {
-								continue;
-							}
-
-							FCompactPoseBoneIndex uu = Output.Pose.GetPose().GetBoneContainer().GetCompactPoseIndexFromSkeletonIndex(boneNo);
-							//FCompactPoseBoneIndex uu(ii);
-							if (uu == INDEX_NONE) {
-								continue;
-							}
-							collisionBoneTrans = Output.Pose.GetComponentSpaceTransform(uu);
-						}
+			cs.offset = collisionBoneTrans.TransformPosition(def.offset);
+			if (def.shape == ESpringColliderShape::Capsule) {
+				cs.tail = collisionBoneTrans.TransformPosition(def.tail);
+			}
+		}
+	}
 
-						auto offs = collider.offset;
-						offs.Set(offs.X, -offs.Z, offs.Y);
-						offs *= 100;
-						//offs = collisionBoneTrans.TransformVector(offs);
-
-						auto tail = collider.tail;
-						tail.Set(tail.X, -tail.Z, tail.Y);
-						tail *= 100;
-						//tail = collisionBoneTrans.TransformVector(tail);
-
-						float r = (j1.hitRadius + collider.radius) * 100.f;
-
-						if (collider.shapeType == TEXT("sphere")) {
-							FVector v = collisionBoneTrans.TransformPosition(offs);
-
-							if ((v - nextTailPosition).SizeSquared() > r * r) {
-								continue;
-							}
-							// ヒット。Colliderの半径方向に押し出す
-							auto normal = (nextTailPosition - v).GetSafeNormal();
-							auto posFromCollider = v + normal * r;
-							// 長さをboneLengthに強制
-							nextTailPosition = currentTransform.GetLocation() + (posFromCollider - currentTransform.GetLocation()).GetSafeNormal() * state->boneLength;
-							nextTailDirection = (posFromCollider - currentTransform.GetLocation()).GetSafeNormal();
-						}
-						else {
-	
-							FTransform t1 = collisionBoneTrans;
-							auto v1 = t1.TransformPosition(offs);
+	void VRM1SpringManager::updateColliderBounds() {
+		for (int colg = 0; colg + 1 < GroupColliderStart.Num(); ++colg) {
+			auto& g = ColliderGroupState[colg];
+			g.bValid = false;
+			g.boundsCenter = FVector::ZeroVector;
+			g.boundsRadius = 0.f;
+
+			int validCount = 0;
+			for (int n = GroupColliderStart[colg]; n < GroupColliderStart[colg + 1]; ++n) {
+				const int colNo = GroupCollider[n];
+				const auto& cs = ColliderState[colNo];
+				if (cs.bValid == false) {
+					continue;
+				}
+				g.boundsCenter += (ColliderDef[colNo].shape == ESpringColliderShape::Sphere) ? cs.offset : (cs.offset + cs.tail) * 0.5f;
+				++validCount;
+			}
+			if (validCount == 0) {
+				continue;
+			}
+			g.bValid = true;
+			g.boundsCenter /= (float)validCount;
+			for (int n = GroupColliderStart[colg]; n < GroupColliderStart[colg + 1]; ++n) {
+				const int colNo = GroupCollider[n];
+				const auto& cs = ColliderState[colNo];
+				if (cs.bValid == false) {
+					continue;
+				}
+				float d = (cs.offset - g.boundsCenter).Size();
+				if (ColliderDef[colNo].shape == ESpringColliderShape::Capsule) {
+					d = FMath::Max(d, (float)(cs.tail - g.boundsCenter).Size());
+				}
+				g.boundsRadius = FMath::Max(g.boundsRadius, d + ColliderDef[colNo].radius);
+			}
+		}
+	}
 
-							FTransform t2 = collisionBoneTrans;
-							auto v2 = t2.TransformPosition(tail);
+	void VRM1SpringManager::fetchPose(const VRMSpringBone::VRMSpringSimParams& Params, FComponentSpacePoseContext& Output) {
+		TRACE_CPUPROFILER_EVENT_SCOPE(VRM4USpring_FetchPose);
+		SCOPE_CYCLE_COUNTER(STAT_VRM4USpring_Fetch);
 
-							FVector nearestPoint = FMath::ClosestPointOnSegment(nextTailPosition, v1, v2);
+		if (skeletalMesh == nullptr) {
+			return;
+		}
 
-							float dif = (nearestPoint - nextTailPosition).SizeSquared();
-							if (dif > r * r) {
-								continue;
-							}
+		if (CompiledBoneNum != Output.Pose.GetPose().GetNumBones()) {
+			// CacheBones is not called when evaluated from AnimInstance proxy
+			compileBones(Output.Pose.GetPose().GetBoneContainer());
+		}
 
-							auto normal = (nextTailPosition - nearestPoint).GetSafeNormal();
+		if (Params.bCollision) {
+			updateColliders(Output);
+		}
 
-							auto posFromCollider = nearestPoint + normal * r;
-							// 長さをboneLengthに強制
-							nextTailPosition = currentTransform.GetLocation() + (posFromCollider - currentTransform.GetLocation()).GetSafeNormal() * state->boneLength;
-							nextTailDirection = (posFromCollider - currentTransform.GetLocation()).GetSafeNormal();
-						}
-					}
+		// 親が揺れ骨ではない。通常骨から参照
+		// chain roots are at level 0. everything else is computed in simulate()
+		if (LevelStart.Num() > 1) {
+			for (int slot = LevelStart[0]; slot < LevelStart[1]; ++slot) {
+				const auto& state = JointState[slot];
+				if (state.bActive == false || state.parentSlot != INDEX_NONE) {
+					continue;
 				}
+				ParentTransform[slot] = Output.Pose.GetComponentSpaceTransform(FCompactPoseBoneIndex(state.parentCompactIndex));
+				RootPoseTransform[slot] = Output.Pose.GetComponentSpaceTransform(FCompactPoseBoneIndex(state.compactIndex));
+			}
+		}
 
+		FetchedComponentTransform = Output.AnimInstanceProxy->GetComponentTransform();
+	}
 
+	void VRM1SpringManager::simulateFetched(const VRMSpringBone::VRMSpringSimParams& Params, float DeltaTime) {
+		if (skeletalMesh == nullptr) {
+			return;
+		}
+		if (FMath::IsNearlyZero(DeltaTime)) {
+			return;
+		}
 
-				state->prevTail = ComponentToLocal.InverseTransformPosition(currentTail);
-				state->currentTail = ComponentToLocal.InverseTransformPosition(nextTailPosition);
+		// モデルローカル座標
+		simulate(Params, DeltaTime, FetchedComponentTransform);
+	}
 
-				{
-					FVector from = currentTransform.TransformVector(state->boneAxis).GetSafeNormal();
-					FVector to = nextTailDirection;
+	void VRM1SpringManager::beginStep(const VRMSpringBone::VRMSpringSimParams& Params, float DeltaTime, const FTransform& ComponentTransform) {
+		StepComponentToLocal = ComponentTransform.Inverse();
+		StepDeltaTime = DeltaTime;
+		StepGravityAdd = StepComponentToLocal.TransformVector(Params.gravityAdd) * DeltaTime;
+		LastComponentTransform = ComponentTransform;
 
-					state->resultQuat = FQuat::FindBetween(from, to) * parentTransform.GetRotation() * state->initialLocalMatrix.GetRotation();
-				}
+		if (Params.bCollision) {
+			updateColliderBounds();
+		}
+		for (auto& n : ActiveColliderGroupNum) {
+			n = INDEX_NONE;
+		}
+	}
 
-				// initial rot
-				{
-					//state->resultQuat = currentTransform.GetRotation();
-				}
-				{
-					//state->resultQuat = (state->initialLocalMatrix * parentTransform).GetRotation();
-				}
-				{
-					//state->resultQuat = parentTransform.GetRotation() * state->initialLocalRotation;
+	bool VRM1SpringManager::prepareLevel(const VRMSpringBone::VRMSpringSimParams& Params, int32 level, VRMSpringBone::VRMSpringJointSoA& SoA, int32 SoABase, VRMSpringBone::VRMSpringStatCounter& Counter) {
+		const FTransform& ComponentToLocal = StepComponentToLocal;
+		const float DeltaTime = StepDeltaTime;
+		const int32 Begin = LevelStart[level];
+		const int32 End = LevelStart[level + 1];
+
+		if (level > 0 && level >= LODLevelNum) {
+			// LOD. follow the parent rigidly and keep the tail at rest
+			for (int slot = Begin; slot < End; ++slot) {
+				auto& state = JointState[slot];
+				if (state.bActive == false || state.parentSlot == INDEX_NONE) {
+					continue;
 				}
+				FTransform& currentTransform = JointTransform[slot];
+				ParentTransform[slot] = JointTransform[state.parentSlot];
+				currentTransform = state.initialLocalMatrix * ParentTransform[slot];
 
-				currentTransform.SetRotation(state->resultQuat);
+				state.prevResultQuat = state.resultQuat;
+				state.resultQuat = currentTransform.GetRotation();
 
-				// 揺れ骨計算結果を保持。これの子の揺れ骨のため。
-				calcTransform.Add(j1.boneNo, currentTransform);
+				const FVector restTail = currentTransform.GetLocation() + currentTransform.TransformVector(state.boneAxis).GetSafeNormal() * state.boneLength;
+				state.currentTail = state.prevTail = ComponentToLocal.InverseTransformPosition(restTail);
 			}
+			return false;
 		}
-	}
 
-	void VRM1SpringManager::applyToComponent(FComponentSpacePoseContext& Output, TArray<FBoneTransform>& OutBoneTransforms) {
+		SCOPE_CYCLE_COUNTER(STAT_VRM4USpring_Integrate);
+		Counter.JointSteps += End - Begin;
+		for (int slot = Begin; slot < End; ++slot) {
+			auto& state = JointState[slot];
+			if (state.bActive == false) {
+				continue;
+			}
+			state.prevResultQuat = state.resultQuat;
+
+			FTransform& parentTransform = ParentTransform[slot];
+			FTransform& currentTransform = JointTransform[slot];
+
+			if (state.parentSlot != INDEX_NONE) {
+				// 親が揺れ骨。揺れ骨計算結果から参照
+				parentTransform = JointTransform[state.parentSlot];
+				currentTransform = state.initialLocalMatrix * parentTransform;
+			} else {
+				// the last step wrote its result here. several steps run on one fetched pose
+				currentTransform = RootPoseTransform[slot];
+			}
 
-		const auto RefSkeleton = Output.AnimInstanceProxy->GetSkeleton()->GetReferenceSkeleton();
-		const auto& RefSkeletonTransform = Output.Pose.GetPose().GetBoneContainer().GetRefPoseArray();
+			const FVector currentTail = ComponentToLocal.TransformPosition(state.currentTail);
+			const FVector prevTail = ComponentToLocal.TransformPosition(state.prevTail);
 
-		// 計算した揺れ骨、または揺れ骨の親
-		TMap<int, FTransform> calcTransform;
+			const FVector stiffness = currentTransform.GetRotation() * state.boneAxis * 1.f * DeltaTime
+				* 100.f * state.stiffness * Params.stiffnessScale * JointParams.StiffnessScale[slot] + Params.stiffnessAdd;
 
-		// 揺れ骨一覧
-		TArray<int> springBoneNoList;
-		{
-			for (auto& s : vrmMetaObject->VRM1SpringBoneMeta.Springs) {
-				for (auto& j : s.joints) {
-					springBoneNoList.AddUnique(j.boneNo);
-				}
+			FVector external = ComponentToLocal.TransformVector(state.gravityDir) * (state.gravityPower * DeltaTime) * Params.gravityScale * JointParams.GravityScale[slot];
+			if (JointParams.NoWind[slot] == false) {
+				external += StepGravityAdd;
 			}
+
+			SoA.SetJoint(SoABase + slot, currentTail, prevTail, currentTransform.GetLocation(), stiffness + external, state.dragForce * JointParams.DragScale[slot], state.boneLength);
 		}
+		return true;
+	}
 
-		for (auto& s : vrmMetaObject->VRM1SpringBoneMeta.Springs) {
+	void VRM1SpringManager::finishLevel(const VRMSpringBone::VRMSpringSimParams& Params, int32 level, const VRMSpringBone::VRMSpringJointSoA& SoA, int32 SoABase, VRMSpringBone::VRMSpringStatCounter& Counter) {
+		// collision and rotation. until the end of this level
+		SCOPE_CYCLE_COUNTER(STAT_VRM4USpring_Collide);
 
-			FTransform CurrentTransForm;
+		const FTransform& ComponentToLocal = StepComponentToLocal;
+		for (int slot = LevelStart[level]; slot < LevelStart[level + 1]; ++slot) {
+			auto& state = JointState[slot];
+			if (state.bActive == false) {
+				continue;
+			}
+			const FTransform& parentTransform = ParentTransform[slot];
+			FTransform& currentTransform = JointTransform[slot];
+			const FVector head = currentTransform.GetLocation();
+
+			FVector nextTailPosition = SoA.GetNextTail(SoABase + slot);
+			FVector nextTailDirection = (nextTailPosition - head).GetSafeNormal();
+
+			// vrm <-> vrm collision
+			if (Params.bCollision) {
+				const int32 springNo = state.springNo;
+				const int32 activeStart = SpringColliderGroupStart[springNo];
+				int32& activeNum = ActiveColliderGroupNum[springNo];
+
+				// broadphase. このSpringに届くコライダグループ。Springの最初の関節で一度だけ
+				if (activeNum == INDEX_NONE) {
+					activeNum = 0;
+					const float springRadius = SpringReach[springNo] * currentTransform.GetMaximumAxisScale() + SpringMaxHitRadius[springNo] * JointParams.MaxHitRadiusScale;
+					for (int n = activeStart; n < SpringColliderGroupStart[springNo + 1]; ++n) {
+						const int colg = SpringColliderGroup[n];
+						const auto& g = ColliderGroupState[colg];
+						if (g.bValid == false) {
+							continue;
+						}
+						if ((g.boundsCenter - head).SizeSquared() > FMath::Square(springRadius + g.boundsRadius)) {
+							continue;
+						}
+						ActiveColliderGroup[activeStart + activeNum] = colg;
+						++activeNum;
+					}
+				}
 
-			for (int jointNo = 0; jointNo < s.joints.Num(); ++jointNo) {
-				auto& j = s.joints[jointNo];
+				// tail is always on the sphere of bone length
+				const float hitRadius = state.hitRadius * JointParams.HitRadiusScale[slot];
+				const float jointRadius = state.boneLength + hitRadius;
 
-				auto* state = JointStateMap.Find(j.boneNo);
-				if (state == nullptr) continue;
+				for (int a = activeStart; a < activeStart + activeNum; ++a) {
+					const int colg = ActiveColliderGroup[a];
+					const auto& g = ColliderGroupState[colg];
+					if ((g.boundsCenter - head).SizeSquared() > FMath::Square(jointRadius + g.boundsRadius)) {
+						continue;
+					}
 
-				FCompactPoseBoneIndex uu = Output.Pose.GetPose().GetBoneContainer().GetCompactPoseIndexFromSkeletonIndex(j.boneNo);
-				//FCompactPoseBoneIndex uu(j.boneNo);
+					for (int n = GroupColliderStart[colg]; n < GroupColliderStart[colg + 1]; ++n) {
+						const int colNo = GroupCollider[n];
+						const auto& collider = ColliderState[colNo];
+						if (collider.bValid == false) {
+							continue;
+						}
 
-				if (Output.Pose.GetPose().IsValidIndex(uu) == false) {
-					continue;
+						const float r = hitRadius + ColliderDef[colNo].radius;
+
+						bool bHit = false;
+						if (ColliderDef[colNo].shape == ESpringColliderShape::Sphere) {
+							bHit = VRMSpringBone::CollideSphere(head, state.boneLength, collider.offset, r, nextTailPosition, nextTailDirection);
+						} else {
+							bHit = VRMSpringBone::CollideCapsule(head, state.boneLength, collider.offset, collider.tail, r, nextTailPosition, nextTailDirection);
+						}
+						++Counter.ColliderTests;
+						if (bHit) {
+							++Counter.Collisions;
+						}
+					}
 				}
+			}
 
-				FTransform NewBoneTM;
+			state.prevTail = ComponentToLocal.InverseTransformPosition(SoA.GetCurrentTail(SoABase + slot));
+			state.currentTail = ComponentToLocal.InverseTransformPosition(nextTailPosition);
 
-				int parentBoneIndex = RefSkeleton.GetParentIndex(j.boneNo);
-				if (springBoneNoList.Find(parentBoneIndex) < 0) {
-					// 親は揺れ骨でない。
+			if (nextTailDirection.IsZero()) {
+				// zero length bone. keep the rest rotation
+				state.resultQuat = parentTransform.GetRotation() * state.initialLocalMatrix.GetRotation();
+			} else {
+				FVector from = currentTransform.TransformVector(state.boneAxis).GetSafeNormal();
+				FVector to = nextTailDirection;
 
-					// 現在値
-					NewBoneTM = Output.Pose.GetComponentSpaceTransform(uu);
+				state.resultQuat = FQuat::FindBetween(from, to) * parentTransform.GetRotation() * state.initialLocalMatrix.GetRotation();
+			}
 
-					// 差分
-					NewBoneTM.SetRotation(state->resultQuat);
+			// 揺れ骨計算結果を保持。これの子の揺れ骨のため。
+			currentTransform.SetRotation(state.resultQuat);
+		}
+	}
 
-					CurrentTransForm = NewBoneTM;
-				}
-				else {
-					// 親は揺れ骨。計算結果から参照する
+	void VRM1SpringManager::simulate(const VRMSpringBone::VRMSpringSimParams& Params, float DeltaTime, const FTransform& ComponentTransform) {
+		TRACE_CPUPROFILER_EVENT_SCOPE(VRM4USpring_Simulate);
 
-					auto* p = calcTransform.Find(parentBoneIndex);
-					if (p) {
-						NewBoneTM = *p;
-					}
+		// crowd mode integrates in the buffer of the batch. sized on the first own update
+		if (JointSoA.Length.Num() < JointState.Num()) {
+			JointSoA.SetNum(JointState.Num());
+		}
+		VRMSpringBone::VRMSpringStatCounter Counter;
 
-					auto c = RefSkeletonTransform[j.boneNo];
-					NewBoneTM = c * NewBoneTM;
-					NewBoneTM.SetRotation(state->resultQuat);
+		beginStep(Params, DeltaTime, ComponentTransform);
+		for (int level = 0; level + 1 < LevelStart.Num(); ++level) {
+			if (prepareLevel(Params, level, JointSoA, 0, Counter) == false) {
+				continue;
+			}
+			{
+				SCOPE_CYCLE_COUNTER(STAT_VRM4USpring_Integrate);
+				// 長さをboneLengthに強制
+				JointSoA.Integrate(LevelStart[level], LevelStart[level + 1]);
+			}
+			finishLevel(Params, level, JointSoA, 0, Counter);
+		}
+	}
 
-					CurrentTransForm = NewBoneTM;
-				}
+	int32 VRM1SpringManager::beginCrowdStep(const VRMSpringBone::VRMSpringSimParams& Params, float DeltaTime) {
+		if (skeletalMesh == nullptr || FMath::IsNearlyZero(DeltaTime)) {
+			return 0;
+		}
+		beginStep(Params, DeltaTime, FetchedComponentTransform);
+		return FMath::Max(0, LevelStart.Num() - 1);
+	}
+
+	int32 VRM1SpringManager::getCrowdPassJointNum(int32 Pass) const {
+		if (Pass > 0 && Pass >= LODLevelNum) {
+			return 0;
+		}
+		return LevelStart[Pass + 1] - LevelStart[Pass];
+	}
 
-				FBoneTransform a(uu, NewBoneTM);
+	void VRM1SpringManager::prepareCrowdPass(const VRMSpringBone::VRMSpringSimParams& Params, int32 Pass, VRMSpringBone::VRMSpringJointSoA& SoA, int32 Base) {
+		VRMSpringBone::VRMSpringStatCounter Counter;
+		prepareLevel(Params, Pass, SoA, Base - LevelStart[Pass], Counter);
+	}
 
-				bool bFirst = true;
-				for (auto& t : OutBoneTransforms) {
-					if (t.BoneIndex == a.BoneIndex) {
-						bFirst = false;
-						break;
-					}
-				}
+	void VRM1SpringManager::finishCrowdPass(const VRMSpringBone::VRMSpringSimParams& Params, int32 Pass, const VRMSpringBone::VRMSpringJointSoA& SoA, int32 Base) {
+		if (getCrowdPassJointNum(Pass) == 0) {
+			return;
+		}
+		VRMSpringBone::VRMSpringStatCounter Counter;
+		finishLevel(Params, Pass, SoA, Base - LevelStart[Pass], Counter);
+	}
 
-				if (bFirst) {
-					OutBoneTransforms.Add(a);
-				}
+	void VRM1SpringManager::applyToComponent(FComponentSpacePoseContext& Output, TArray<FBoneTransform>& OutBoneTransforms) {
+		SCOPE_CYCLE_COUNTER(STAT_VRM4USpring_Apply);
 
+		// JointState is sorted by depth, so parents are always written first
+		for (int slot = 0; slot < JointState.Num(); ++slot) {
+			const auto& state = JointState[slot];
+			if (state.bActive == false) {
+				continue;
+			}
 
-				calcTransform.Add(j.boneNo, CurrentTransForm);
-				// update rotation
-				//FVector to = (state->currentTail * (node.parent.worldMatrix * state->initialLocalMatrix).inverse).normalized;
-				//node.rotation = initialLocalRotation * Quaternion.fromToQuaternion(boneAxis, to);
+			FTransform& NewBoneTM = JointTransform[slot];
+			if (state.parentSlot == INDEX_NONE) {
+				// 親は揺れ骨でない。現在値
+				NewBoneTM = Output.Pose.GetComponentSpaceTransform(FCompactPoseBoneIndex(state.compactIndex));
+			} else {
+				// 親は揺れ骨。計算結果から参照する
+				NewBoneTM = state.initialLocalMatrix * JointTransform[state.parentSlot];
 			}
+			NewBoneTM.SetRotation(GetOutputRotation(state.prevResultQuat, state.resultQuat, state.lodFromQuat));
 		}
-		OutBoneTransforms.Sort(FCompareBoneTransformIndex());
 
+		// EmitOrder is already sorted by compact index and has no duplicates
+		OutBoneTransforms.Reserve(OutBoneTransforms.Num() + EmitOrder.Num());
+		for (int32 slot : EmitOrder) {
+			OutBoneTransforms.Add(FBoneTransform(FCompactPoseBoneIndex(JointState[slot].compactIndex), JointTransform[slot]));
+		}
+	}
+
+	void VRM1SpringManager::forEachJointState(TFunctionRef<void(FVector&, FVector&, FQuat&, FQuat&)> Func) {
+		for (auto& state : JointState) {
+			Func(state.prevTail, state.currentTail, state.resultQuat, state.prevResultQuat);
+		}
+	}
+
+	void VRM1SpringManager::beginLODBlend() {
+		for (auto& state : JointState) {
+			state.lodFromQuat = GetOutputRotation(state.prevResultQuat, state.resultQuat, state.lodFromQuat);
+		}
+		LODBlendAlpha = 0.f;
 	}
 } //spring1
@@ -37,11 +37,40 @@ SOFTWARE.
 #include "Kismet/KismetSystemLibrary.h"
 #include "SceneInterface.h"
 #include "DrawDebugHelpers.h"
+#include "WorldCollision.h"
+#if	UE_VERSION_OLDER_THAN(5,3,0)
+#else
+#include "Engine/OverlapResult.h"
+#endif
 
 #include "VrmMetaObject.h"
 #include "VrmUtil.h"
+#include "Stats/Stats.h"
+
+#if	UE_VERSION_OLDER_THAN(4,23,0)
+#define TRACE_CPUPROFILER_EVENT_SCOPE(a)
+#else
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#endif
 
 #include <algorithm>
+
+// stat vrm4uspring
+DECLARE_STATS_GROUP(TEXT("VRM4U Spring"), STATGROUP_VRM4USpring, STATCAT_Advanced);
+
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Evaluate"), STAT_VRM4USpring_Evaluate, STATGROUP_VRM4USpring, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Init"), STAT_VRM4USpring_Init, STATGROUP_VRM4USpring, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Fetch pose"), STAT_VRM4USpring_Fetch, STATGROUP_VRM4USpring, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Integrate"), STAT_VRM4USpring_Integrate, STATGROUP_VRM4USpring, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Collide"), STAT_VRM4USpring_Collide, STATGROUP_VRM4USpring, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Apply"), STAT_VRM4USpring_Apply, STATGROUP_VRM4USpring, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Crowd batch"), STAT_VRM4USpring_CrowdBatch, STATGROUP_VRM4USpring, );
+
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Evaluated nodes"), STAT_VRM4USpring_Nodes, STATGROUP_VRM4USpring, );
+// joints x substeps
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Joint steps"), STAT_VRM4USpring_JointSteps, STATGROUP_VRM4USpring, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Collider tests"), STAT_VRM4USpring_ColliderTests, STATGROUP_VRM4USpring, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Collisions resolved"), STAT_VRM4USpring_Collisions, STATGROUP_VRM4USpring, );
 /////////////////////////////////////////////////////
 // FAnimNode_ModifyBone
 
@@ -53,19 +82,98 @@ public:
 };
 
 namespace VRMSpringBone {
+
+	struct VRMSpringSimParams;
+	class VRMSpringJointSoA;
+	struct VRMSpringStatCounter;
+
+	// built from meta data and skeleton, never modified after. shared by all managers of the same model
+	class VRMSpringTopology {
+	public:
+		virtual ~VRMSpringTopology() {}
+	};
+
+	class VRMSpringTopologyCache {
+	public:
+		// topology of (meta, mesh, Type). Build is called once per key, under the cache lock
+		static TSharedPtr<const VRMSpringTopology> FindOrBuild(const UVrmMetaObject* meta, const USkeletalMesh* mesh, int32 Type, TFunctionRef<TSharedPtr<VRMSpringTopology>()> Build);
+		static void Clear();
+	};
+
 	class VRMSpringManagerBase {
 	public:
-		VRMSpringManagerBase() {}
-		virtual ~VRMSpringManagerBase() {}
+		// register to UVRM4U_SpringBudgetSubsystem
+		VRMSpringManagerBase();
+		virtual ~VRMSpringManagerBase();
 		bool bInit = false;
 		USkeletalMesh* skeletalMesh = nullptr;
 		const UVrmMetaObject* vrmMetaObject = nullptr;
 
+		// compact pose bone num of the last compileBones()
+		int32 CompiledBoneNum = INDEX_NONE;
+
+		// init() copies joints from this, then only per instance state changes
+		TSharedPtr<const VRMSpringTopology> Topology;
+
+		// fixed timestep. output blends from the previous step result. 1 is the latest step
+		float OutputAlpha = 1.f;
+
+		// spring LOD. set by the anim node before update
+		// substeps are clamped to LODLoopCount. joints deeper than LODLevelNum follow their parent
+		int32 LODLoopCount = MAX_int32;
+		int32 LODLevelNum = MAX_int32;
+		// output blends from the rotation saved by beginLODBlend(). 1 is no blend
+		float LODBlendAlpha = 1.f;
+		virtual void beginLODBlend() {}
+
+		// spring budget. BudgetSignificance and BudgetActiveFrame are set by the anim node on game thread, the rest by UVRM4U_SpringBudgetSubsystem
+		float BudgetSignificance = 1.f;
+		uint64 BudgetActiveFrame = 0;
+		bool bBudgetGranted = true;
+		int32 BudgetSkippedFrames = 0;
+		double BudgetCostSeconds = 0.0;
+		// reservation of TryBeginUpdate. EndUpdate may come after the next BeginFrame
+		uint64 BudgetReservedFrame = 0;
+		double BudgetReservedSeconds = 0.0;
+		virtual int32 getJointNum() const { return 0; }
+
+		// component transform of the last update. tails are kept in world space
+		FTransform LastComponentTransform = FTransform::Identity;
+		// component transform of the last fetchPose
+		FTransform FetchedComponentTransform = FTransform::Identity;
+
+		// state blob of all joints. tails in component space, so it can be restored at another place
+		bool saveState(TArray<uint8>& OutData);
+		bool loadState(const TArray<uint8>& Data, const FTransform& ComponentTransform);
+		// joints in a fixed order. prevTail, currentTail, resultQuat, prevResultQuat
+		virtual void forEachJointState(TFunctionRef<void(FVector&, FVector&, FQuat&, FQuat&)> Func) {}
+
+		FQuat GetOutputRotation(const FQuat& Prev, const FQuat& Current, const FQuat& LODFrom) const {
+			const FQuat q = (OutputAlpha < 1.f) ? FQuat::Slerp(Prev, Current, OutputAlpha) : Current;
+			return (LODBlendAlpha < 1.f) ? FQuat::Slerp(LODFrom, q, LODBlendAlpha) : q;
+		}
+
 		virtual void init(const UVrmMetaObject* meta, FComponentSpacePoseContext& Output) {}
-		virtual void update(const FAnimNode_VrmSpringBone* animNode, float DeltaTime, FComponentSpacePoseContext& Output, TArray<FBoneTransform>& OutBoneTransforms) {}
+		virtual void compileBones(const FBoneContainer& RequiredBones) {}
+		// resolve per joint params of the anim node. after init
+		virtual void compileJointParams(const TArray<FVrmSpringJointOverride>& Overrides, const TArray<FName>& NoWindBoneNameList) {}
+		// fetchPose() then simulateFetched()
+		virtual void update(const FAnimNode_VrmSpringBone* animNode, float DeltaTime, FComponentSpacePoseContext& Output, TArray<FBoneTransform>& OutBoneTransforms);
+		// anim thread. reads everything the solver needs from the pose
+		virtual void fetchPose(const VRMSpringSimParams& Params, FComponentSpacePoseContext& Output) {}
+		// no pose and no anim node. may run on a task while the next pose is evaluated
+		virtual void simulateFetched(const VRMSpringSimParams& Params, float DeltaTime) {}
+		// crowd mode. UVRM4U_SpringCrowdSubsystem splits simulateFetched() into passes, and integrates one pass of all characters in one loop.
+		// a pass is a depth level, of one substep for VRM0. returns the pass count of this step, 0 when simulated here without passes
+		virtual int32 beginCrowdStep(const VRMSpringSimParams& Params, float DeltaTime) { simulateFetched(Params, DeltaTime); return 0; }
+		// joints of the pass. fixed until the next beginCrowdStep
+		virtual int32 getCrowdPassJointNum(int32 Pass) const { return 0; }
+		// write the joints of the pass to SoA from Base
+		virtual void prepareCrowdPass(const VRMSpringSimParams& Params, int32 Pass, VRMSpringJointSoA& SoA, int32 Base) {}
+		// collision and rotation from the integrated tails
+		virtual void finishCrowdPass(const VRMSpringSimParams& Params, int32 Pass, const VRMSpringJointSoA& SoA, int32 Base) {}
 		virtual void reset() {}
 		virtual void applyToComponent(FComponentSpacePoseContext& Output, TArray<FBoneTransform>& OutBoneTransforms) {}
-
 	};
 }
 
@@ -75,26 +183,181 @@ namespace VRMSpringBone {
 	public:
 		FVector offset = FVector::ZeroVector;
 		float radius = 0.f;
+
+		// unreal scale, bone space
+		FVector ueOffset = FVector::ZeroVector;
+		float ueRadius = 0.f;
+
+		// component space position of current update
+		FVector m_position = FVector::ZeroVector;
 	};
 	class VRMSpringColliderGroup {
 	public:
 		int node = 0;
 		FName node_name;
 
+		// compiled from RequiredBones
+		int32 compactIndex = INDEX_NONE;
+
+		// component space bone transform of current update
+		FTransform m_transform = FTransform::Identity;
+
+		// sphere which contains all colliders of this group
+		FVector m_boundsCenter = FVector::ZeroVector;
+		float m_boundsRadius = 0.f;
+
 		TArray<VRMSpringCollider> colliders;
+
+		// collider positions and bounds from m_transform
+		void UpdateBounds();
 	};
 
 	class VRMSpringData {
 	public:
 		int boneIndex = -1;
 		FName boneName;
+
+		// joint index of the parent in VRMSpring::SpringData. INDEX_NONE for chain root
+		int32 parent = INDEX_NONE;
+
+		// compiled from RequiredBones
+		int32 compactIndex = INDEX_NONE;
+		FTransform refPose = FTransform::Identity;
+
+		// for broadphase. distance from chain root to the head of this joint, and to the farthest tail of the chain (root only)
+		float m_headReach = 0.f;
+		float m_chainReach = 0.f;
+
 		FVector m_currentTail = FVector::ZeroVector;
 		FVector m_prevTail = FVector::ZeroVector;
-		//FTransform m_transform = FTransform::Identity;
 		FVector m_boneAxis = FVector::ForwardVector;
 		float m_length = 1.f;
 
 		FQuat m_resultQuat = FQuat::Identity;
+		FQuat m_prevResultQuat = FQuat::Identity;
+		FQuat m_lodFromQuat = FQuat::Identity;
+
+		// work for current update. component space transform of this joint
+		FTransform m_transform = FTransform::Identity;
+		// chain root only. pose transform fetched before update
+		FTransform m_poseTransform = FTransform::Identity;
+		bool m_bValid = false;
+	};
+
+	// structure of arrays for verlet integration.
+	// plain float arrays so that the compiler can process 4/8 joints per instruction.
+	class VRMSpringJointSoA {
+	public:
+		TArray<float> CurrentTailX, CurrentTailY, CurrentTailZ;
+		TArray<float> PrevTailX, PrevTailY, PrevTailZ;
+		TArray<float> HeadX, HeadY, HeadZ;
+		TArray<float> ForceX, ForceY, ForceZ;
+		TArray<float> NextTailX, NextTailY, NextTailZ;
+		TArray<float> Drag;
+		TArray<float> Length;
+
+		void SetNum(int32 Num);
+
+		void SetJoint(int32 Index, const FVector& CurrentTail, const FVector& PrevTail, const FVector& Head, const FVector& Force, float InDrag, float InLength) {
+			CurrentTailX[Index] = CurrentTail.X;
+			CurrentTailY[Index] = CurrentTail.Y;
+			CurrentTailZ[Index] = CurrentTail.Z;
+			PrevTailX[Index] = PrevTail.X;
+			PrevTailY[Index] = PrevTail.Y;
+			PrevTailZ[Index] = PrevTail.Z;
+			HeadX[Index] = Head.X;
+			HeadY[Index] = Head.Y;
+			HeadZ[Index] = Head.Z;
+			ForceX[Index] = Force.X;
+			ForceY[Index] = Force.Y;
+			ForceZ[Index] = Force.Z;
+			Drag[Index] = InDrag;
+			Length[Index] = InLength;
+		}
+		FVector GetCurrentTail(int32 Index) const {
+			return FVector(CurrentTailX[Index], CurrentTailY[Index], CurrentTailZ[Index]);
+		}
+		FVector GetNextTail(int32 Index) const {
+			return FVector(NextTailX[Index], NextTailY[Index], NextTailZ[Index]);
+		}
+
+		// NextTail = Head + normalize(Current + (Current - Prev) * (1 - Drag) + Force - Head) * Length
+		void Integrate(int32 Begin, int32 End);
+	};
+
+	// per joint multipliers from FAnimNode_VrmSpringBone::JointOverrides and NoWindBoneNameList.
+	// resolved once at init, solvers read them by joint index without name lookups
+	class VRMSpringJointParams {
+	public:
+		TArray<float> StiffnessScale;
+		TArray<float> GravityScale;
+		TArray<float> DragScale;
+		TArray<float> HitRadiusScale;
+		// no gravityAdd and no wind
+		TBitArray<> NoWind;
+		// for broadphase
+		float MaxHitRadiusScale = 1.f;
+
+		// all 1, no flags
+		void Init(int32 Num);
+		// joints must be sorted parent first. Parent(i) is INDEX_NONE or less than i
+		void Resolve(const TArray<FVrmSpringJointOverride>& Overrides, const TArray<FName>& NoWindBoneNameList, int32 Num,
+			TFunctionRef<FName(int32)> BoneName, TFunctionRef<int32(int32)> Parent);
+	};
+
+	// push Tail out of the sphere, then back on the sphere of Length around Head. false if not hit
+	// OutDirection is the direction from Head to the pushed point
+	inline bool CollideSphere(const FVector& Head, float Length, const FVector& Center, float Radius, FVector& Tail, FVector& OutDirection) {
+		if ((Center - Tail).SizeSquared() > Radius * Radius) {
+			return false;
+		}
+		// ヒット。Colliderの半径方向に押し出す
+		const FVector posFromCollider = Center + (Tail - Center).GetSafeNormal() * Radius;
+		// 長さをboneLengthに強制
+		OutDirection = (posFromCollider - Head).GetSafeNormal();
+		Tail = Head + OutDirection * Length;
+		return true;
+	}
+
+	inline bool CollideCapsule(const FVector& Head, float Length, const FVector& A, const FVector& B, float Radius, FVector& Tail, FVector& OutDirection) {
+		return CollideSphere(Head, Length, FMath::ClosestPointOnSegment(Tail, A, B), Radius, Tail, OutDirection);
+	}
+
+	// counted in the solver loops, added to the stats once per update
+	struct VRMSpringStatCounter {
+		int32 JointSteps = 0;
+		int32 ColliderTests = 0;
+		int32 Collisions = 0;
+
+		~VRMSpringStatCounter() {
+			INC_DWORD_STAT_BY(STAT_VRM4USpring_JointSteps, JointSteps);
+			INC_DWORD_STAT_BY(STAT_VRM4USpring_ColliderTests, ColliderTests);
+			INC_DWORD_STAT_BY(STAT_VRM4USpring_Collisions, Collisions);
+		}
+	};
+
+	// anim node params used by the solvers. no FAnimNode_VrmSpringBone needed for headless runs.
+	// copied by value, so a solver task does not read the node
+	struct VRMSpringSimParams {
+		float stiffnessScale = 1.f;
+		float stiffnessAdd = 0.f;
+		float gravityScale = 1.f;
+		FVector gravityAdd = FVector::ZeroVector;
+		bool bCollision = true;
+
+		// VRM0
+		int32 loopc = 1;
+		int32 collisionCheckLoopCount = 2;
+		bool bPhysicsCollision = false;
+		bool bParallelEvaluation = false;
+		bool bWind = false;
+		bool bDeterministicWindNoise = false;
+		float randomWindRange = 0.2f;
+		float windScale = 1.f;
+		FVrmSpringWindSnapshot Wind;
+
+		VRMSpringSimParams() {}
+		explicit VRMSpringSimParams(const FAnimNode_VrmSpringBone* animNode);
 	};
 
 	class VRMSpring {
@@ -114,30 +377,118 @@ namespace VRMSpringBone {
 		TArray<int> ColliderGroupIndexArray;
 
 
-		TArray< TArray<VRMSpringData> > SpringDataChain;
+		// all chains flattened and sorted by depth. parent is always stored before its children
+		TArray<VRMSpringData> SpringData;
 		TArray<VRMSpringData> RootSpringData;
 
+		// joints LevelStart[n] .. LevelStart[n+1]-1 have the same depth
+		TArray<int32> LevelStart;
+		// sized by the first Update(). crowd mode uses the buffer of the batch
+		VRMSpringJointSoA JointSoA;
+		// index is the same as SpringData
+		VRMSpringJointParams JointParams;
+
+		// box which contains all chains of this spring. from FetchPose
+		FBox Bounds = FBox(ForceInit);
+		// collider groups which may touch this spring in current update
+		TArray<int32> ActiveColliderGroup;
+
+		// simulated time and per spring offset for bDeterministicWindNoise
+		float WindTime = 0.f;
+		float WindPhase = 0.f;
+
+		// work for current update. from BeginUpdate() and BeginLoop()
+		FTransform StepComponentToLocal = FTransform::Identity;
+		float StepStiffnessForce = 0.f;
+		FVector StepExternal = FVector::ZeroVector;
+		FVector StepGravity = FVector::ZeroVector;
+
+		// world primitives around Bounds. one overlap query per update, joints test only these
+		TArray<FOverlapResult> WorldOverlap;
+		TArray<UPrimitiveComponent*> WorldPrimitive;
+		void FetchWorldPrimitives(FComponentSpacePoseContext& Output);
+
 		USkeletalMesh* skeletalMesh = nullptr;
 		~VRMSpring() {
 			skeletalMesh = nullptr;
 		}
 
-		void Update(const FAnimNode_VrmSpringBone* animNode, float DeltaTime, FTransform center,
+		// LoopCount caps Params.loopc. levels from LevelNum follow their parent without simulation
+		void Update(const VRMSpringSimParams& Params, float DeltaTime, const FTransform& ComponentTransform,
 			const TArray<VRMSpringColliderGroup>& colliderGroup,
-			FComponentSpacePoseContext& Output);
+			int32 LoopCount, int32 LevelNum);
+
+		// parts of Update(). BeginUpdate once, then per substep BeginLoop and PrepareLevel/Integrate/FinishLevel of each level.
+		// joint n of the level is at SoABase + n of SoA
+		static int32 GetLoopCount(const VRMSpringSimParams& Params, int32 LoopCount);
+		// joints integrated at the level. 0 for LOD levels
+		int32 GetLevelJointNum(int32 level, int32 LevelNum) const;
+		void BeginUpdate(const VRMSpringSimParams& Params, const FTransform& ComponentTransform, const TArray<VRMSpringColliderGroup>& colliderGroup);
+		void BeginLoop(const VRMSpringSimParams& Params, float CurrentDeltaTime);
+		// false for LOD levels. they follow the parent and need no Integrate
+		bool PrepareLevel(int32 level, int32 LevelNum, VRMSpringJointSoA& SoA, int32 SoABase, VRMSpringStatCounter& Counter);
+		void FinishLevel(const VRMSpringSimParams& Params, int32 level, const TArray<VRMSpringColliderGroup>& colliderGroup,
+			const VRMSpringJointSoA& SoA, int32 SoABase, VRMSpringStatCounter& Counter);
+
+		// reorder SpringData by chain depth and build LevelStart
+		void SortByDepth();
+
+		// read chain root transforms from pose. Update() does not touch the pose
+		void FetchPose(FComponentSpacePoseContext& Output);
+		// Bounds from m_poseTransform of the chain roots
+		void UpdatePoseBounds();
+		// m_headReach and m_chainReach from refPose and m_length
+		void UpdateChainReach();
+	};
+
+	// chains of all springs and colliders at the initial state
+	class VRMSpringManagerTopology : public VRMSpringTopology {
+	public:
+		TArray<VRMSpring> spring;
+		TArray<VRMSpringColliderGroup> colliderGroup;
+		TArray<int32> GroupSpring;
+		TArray<int32> GroupStart;
 	};
 
 	class VRMSpringManager : public VRMSpringManagerBase {
 	public:
 
+		// copy chains and colliders of a VRMSpringManagerTopology. also used by the benchmark without a mesh
+		void initTopology(const TSharedPtr<const VRMSpringTopology>& InTopology);
+
 		virtual void init(const UVrmMetaObject* meta, FComponentSpacePoseContext& Output) override;
-		virtual void update(const FAnimNode_VrmSpringBone* animNode, float DeltaTime, FComponentSpacePoseContext& Output, TArray<FBoneTransform>& OutBoneTransforms) override;
+		virtual void compileBones(const FBoneContainer& RequiredBones) override;
+		virtual void compileJointParams(const TArray<FVrmSpringJointOverride>& Overrides, const TArray<FName>& NoWindBoneNameList) override;
+		virtual void fetchPose(const VRMSpringSimParams& Params, FComponentSpacePoseContext& Output) override;
+		virtual void simulateFetched(const VRMSpringSimParams& Params, float DeltaTime) override;
+		virtual int32 beginCrowdStep(const VRMSpringSimParams& Params, float DeltaTime) override;
+		virtual int32 getCrowdPassJointNum(int32 Pass) const override;
+		virtual void prepareCrowdPass(const VRMSpringSimParams& Params, int32 Pass, VRMSpringJointSoA& SoA, int32 Base) override;
+		virtual void finishCrowdPass(const VRMSpringSimParams& Params, int32 Pass, const VRMSpringJointSoA& SoA, int32 Base) override;
 		virtual void reset() override;
 
 		virtual void applyToComponent(FComponentSpacePoseContext& Output, TArray<FBoneTransform>& OutBoneTransforms) override;
+		virtual void beginLODBlend() override;
+		virtual int32 getJointNum() const override;
+		virtual void forEachJointState(TFunctionRef<void(FVector&, FVector&, FQuat&, FQuat&)> Func) override;
 
 		TArray<VRMSpring> spring;
 		TArray<VRMSpringColliderGroup> colliderGroup;
+
+		// springs which share no bone with other groups. GroupSpring[GroupStart[n]] .. GroupSpring[GroupStart[n+1]-1]
+		TArray<int32> GroupSpring;
+		TArray<int32> GroupStart;
+
+		// (spring, SpringData) of each output bone. sorted by compact index, no duplicates
+		TArray<FIntPoint> EmitOrder;
+
+		// crowd step from beginCrowdStep. pass n is level (n % CrowdLevelNum) of substep (n / CrowdLevelNum)
+		int32 CrowdLoopCount = 1;
+		int32 CrowdLevelNum = 0;
+		float CrowdLoopDeltaTime = 0.f;
+
+		// result of the last step becomes the previous result
+		void beginSimulate();
 	};
 
 }
@@ -147,6 +498,24 @@ namespace VRM1Spring {
 
 	class SpringBoneJointState {
 	public:
+		// skeleton index
+		int32 boneNo = INDEX_NONE;
+		int32 parentBoneNo = INDEX_NONE;
+		int32 compactIndex = INDEX_NONE;
+		int32 parentCompactIndex = INDEX_NONE;
+		// slot of the parent joint when the parent is also a spring joint. INDEX_NONE reads the parent from the pose
+		int32 parentSlot = INDEX_NONE;
+		int32 springNo = INDEX_NONE;
+		// bones are in the current compact pose
+		bool bActive = false;
+
+		// joint params. unreal axis and scale
+		float hitRadius = 0.f;
+		float stiffness = 0.f;
+		float dragForce = 0.f;
+		float gravityPower = 0.f;
+		FVector gravityDir = FVector::ZeroVector;
+
 		FVector prevTail;
 		FVector currentTail;
 
@@ -157,17 +526,128 @@ namespace VRM1Spring {
 		FQuat initialLocalRotation;
 
 		FQuat resultQuat;
+		FQuat prevResultQuat;
+		FQuat lodFromQuat;
 	};
 
+	enum class ESpringColliderShape : uint8 {
+		Sphere,
+		Capsule,
+	};
+
+	// compiled from VRM1SpringBoneMeta.Colliders. bone space, unreal axis and scale
+	class SpringColliderDef {
+	public:
+		FName boneName;
+		int32 compactIndex = INDEX_NONE;
+		ESpringColliderShape shape = ESpringColliderShape::Sphere;
+		FVector offset = FVector::ZeroVector;
+		FVector tail = FVector::ZeroVector;
+		float radius = 0.f;
+	};
+
+	// collider of current update. component space
+	class SpringColliderState {
+	public:
+		bool bValid = false;
+		FVector offset = FVector::ZeroVector;
+		FVector tail = FVector::ZeroVector;
+	};
+
+	// sphere which contains all colliders of the group
+	class SpringColliderGroupState {
+	public:
+		bool bValid = false;
+		FVector boundsCenter = FVector::ZeroVector;
+		float boundsRadius = 0.f;
+	};
+
+	// joints sorted by depth, with params and rest pose. compactIndex and tails are not set
+	class VRM1SpringTopology : public VRMSpringBone::VRMSpringTopology {
+	public:
+		TArray<SpringBoneJointState> JointState;
+		TArray<int32> LevelStart;
+		TArray<float> SpringReach;
+		TArray<float> SpringMaxHitRadius;
+		TArray<SpringColliderDef> ColliderDef;
+		TArray<int32> GroupCollider;
+		TArray<int32> GroupColliderStart;
+		TArray<int32> SpringColliderGroup;
+		TArray<int32> SpringColliderGroupStart;
+		int32 TotalJointCount = 0;
+	};
 
 	class VRM1SpringManager : public VRMSpringBone::VRMSpringManagerBase {
 	public:
 
-		TMap< int, SpringBoneJointState > JointStateMap;
+		// all joints sorted by depth. joints of level n : JointState[LevelStart[n]] .. JointState[LevelStart[n+1]-1]
+		TArray<SpringBoneJointState> JointState;
+		TArray<int32> LevelStart;
+		// sized by the first simulate(). crowd mode uses the buffer of the batch
+		VRMSpringBone::VRMSpringJointSoA JointSoA;
+		// index is the same as JointState
+		VRMSpringBone::VRMSpringJointParams JointParams;
+		// component space result of each joint. children read their parent from here
+		TArray<FTransform> JointTransform;
+		TArray<FTransform> ParentTransform;
+		// pose of the chain roots from fetchPose. every simulate() step starts from it, JointTransform holds the result
+		TArray<FTransform> RootPoseTransform;
+		// slot of each output bone. sorted by compact index, no duplicates
+		TArray<int32> EmitOrder;
+
+		// for broadphase. all tails of the spring are within this distance from its first joint
+		TArray<float> SpringReach;
+		// for broadphase. largest hitRadius of the joints of the spring
+		TArray<float> SpringMaxHitRadius;
+
+		TArray<SpringColliderDef> ColliderDef;
+		// colliders of group n : GroupCollider[GroupColliderStart[n]] .. GroupCollider[GroupColliderStart[n+1]-1]
+		TArray<int32> GroupCollider;
+		TArray<int32> GroupColliderStart;
+		// collider groups of spring n : SpringColliderGroup[SpringColliderGroupStart[n]] .. SpringColliderGroup[SpringColliderGroupStart[n+1]-1]
+		TArray<int32> SpringColliderGroup;
+		TArray<int32> SpringColliderGroupStart;
+
+		TArray<SpringColliderState> ColliderState;
+		TArray<SpringColliderGroupState> ColliderGroupState;
+		// groups which reach spring n : ActiveColliderGroup[SpringColliderGroupStart[n]] .. (ActiveColliderGroupNum[n] entries)
+		TArray<int32> ActiveColliderGroup;
+		TArray<int32> ActiveColliderGroupNum;
+		// collider positions from the pose. group bounds are updated in simulate()
+		void updateColliders(FComponentSpacePoseContext& Output);
+		void updateColliderBounds();
+
+		// context free solver. reads ColliderState, and RootPoseTransform/ParentTransform of the chain roots (parentSlot == INDEX_NONE)
+		void simulate(const VRMSpringBone::VRMSpringSimParams& Params, float DeltaTime, const FTransform& ComponentTransform);
+
+		// parts of simulate(). beginStep, then prepareLevel/Integrate/finishLevel of each level. slot n is at SoABase + n of SoA
+		void beginStep(const VRMSpringBone::VRMSpringSimParams& Params, float DeltaTime, const FTransform& ComponentTransform);
+		// false for LOD levels. they follow the parent and need no Integrate
+		bool prepareLevel(const VRMSpringBone::VRMSpringSimParams& Params, int32 level, VRMSpringBone::VRMSpringJointSoA& SoA, int32 SoABase, VRMSpringBone::VRMSpringStatCounter& Counter);
+		void finishLevel(const VRMSpringBone::VRMSpringSimParams& Params, int32 level, const VRMSpringBone::VRMSpringJointSoA& SoA, int32 SoABase, VRMSpringBone::VRMSpringStatCounter& Counter);
+		// work for current step. from beginStep()
+		FTransform StepComponentToLocal = FTransform::Identity;
+		FVector StepGravityAdd = FVector::ZeroVector;
+		float StepDeltaTime = 0.f;
+
+		// copy joints and colliders of a VRM1SpringTopology and size the per instance arrays. also used by the benchmark without a mesh
+		void initTopology(const TSharedPtr<const VRMSpringBone::VRMSpringTopology>& InTopology);
 
 		virtual void init(const UVrmMetaObject* meta, FComponentSpacePoseContext& Output) override;
-		virtual void update(const FAnimNode_VrmSpringBone* animNode, float DeltaTime, FComponentSpacePoseContext& Output, TArray<FBoneTransform>& OutBoneTransforms) override;
+		virtual void compileBones(const FBoneContainer& RequiredBones) override;
+		virtual void compileJointParams(const TArray<FVrmSpringJointOverride>& Overrides, const TArray<FName>& NoWindBoneNameList) override;
+		virtual void fetchPose(const VRMSpringBone::VRMSpringSimParams& Params, FComponentSpacePoseContext& Output) override;
+		virtual void simulateFetched(const VRMSpringBone::VRMSpringSimParams& Params, float DeltaTime) override;
 		virtual void reset() override;
 		virtual void applyToComponent(FComponentSpacePoseContext& Output, TArray<FBoneTransform>& OutBoneTransforms) override;
+		virtual void beginLODBlend() override;
+		virtual int32 getJointNum() const override {
+			return JointState.Num();
+		}
+		virtual int32 beginCrowdStep(const VRMSpringBone::VRMSpringSimParams& Params, float DeltaTime) override;
+		virtual int32 getCrowdPassJointNum(int32 Pass) const override;
+		virtual void prepareCrowdPass(const VRMSpringBone::VRMSpringSimParams& Params, int32 Pass, VRMSpringBone::VRMSpringJointSoA& SoA, int32 Base) override;
+		virtual void finishCrowdPass(const VRMSpringBone::VRMSpringSimParams& Params, int32 Pass, const VRMSpringBone::VRMSpringJointSoA& SoA, int32 Base) override;
+		virtual void forEachJointState(TFunctionRef<void(FVector&, FVector&, FQuat&, FQuat&)> Func) override;
 	};
 }
@@ -8,17 +8,71 @@
 #include "BonePose.h"
 #include "BoneControllers/AnimNode_ModifyBone.h"
 #include "Misc/EngineVersionComparison.h"
+#include "Async/TaskGraphInterfaces.h"
 
 #include "AnimNode_VrmSpringBone.generated.h"
 
 class USkeletalMeshComponent;
 class UVrmMetaObject;
 class UVrmAssetListObject;
+class UVRM4U_SpringBudgetSubsystem;
+class UVRM4U_SpringCrowdSubsystem;
 
 namespace VRMSpringBone {
 	class VRMSpringManagerBase;
 }
 
+UENUM(BlueprintType)
+enum class EVRMSpringLOD : uint8
+{
+	VRMSL_Full				UMETA(DisplayName = "Full"),
+	VRMSL_ReducedSubsteps	UMETA(DisplayName = "Reduced Substeps"),
+	VRMSL_FirstJoints		UMETA(DisplayName = "First Joints Only"),
+	VRMSL_Frozen			UMETA(DisplayName = "Frozen"),
+
+	VRMSL_MAX,
+};
+
+// return EVRMSpringLOD as int32, or INDEX_NONE to use screen size. called on game thread
+DECLARE_DELEGATE_RetVal_OneParam(int32, FVrmSpringLODSelector, const USkeletalMeshComponent*);
+
+// wind at the component. sampled on game thread once per frame, read by the anim worker
+struct FVrmSpringWindSnapshot {
+	bool bValid = false;
+	// component space
+	FVector Direction = FVector::ZeroVector;
+	float Speed = 0.f;
+};
+
+// multipliers of one spring joint, or of a chain from the joint
+USTRUCT(BlueprintType)
+struct FVrmSpringJointOverride {
+	GENERATED_USTRUCT_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = VRM4U)
+	FName BoneName;
+
+	// joints below BoneName use the same values, unless they have their own entry
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = VRM4U)
+	bool bApplyToChildren = true;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = VRM4U, meta = (ClampMin = "0.0"))
+	float stiffnessScale = 1.f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = VRM4U, meta = (ClampMin = "0.0"))
+	float gravityScale = 1.f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = VRM4U, meta = (ClampMin = "0.0"))
+	float dragScale = 1.f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = VRM4U, meta = (ClampMin = "0.0"))
+	float hitRadiusScale = 1.f;
+
+	// no gravityAdd and no wind, same as NoWindBoneNameList
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = VRM4U)
+	bool bNoWind = false;
+};
+
 
 /**
 *	Simple controller that replaces or adds to the translation/rotation of a single bone.
@@ -78,18 +132,144 @@ struct VRM4U_API FAnimNode_VrmSpringBone : public FAnimNode_SkeletalControlBase
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Skeleton, meta = (PinHiddenByDefault))
 	bool bIgnoreWindDirectionalSource = false;
 
-	//
+	// wind gust from a noise of simulated time instead of a random draw. same steps give same wind
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Skeleton, meta = (PinHiddenByDefault))
+	bool bDeterministicWindNoise = false;
+
+	// evaluate independent spring groups on worker threads. ignored while physics collision is enabled
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Skeleton, meta = (PinHiddenByDefault))
+	bool bParallelEvaluation = false;
+
+	// simulate on a background task while the rest of the frame runs. output is one frame behind. ignored while physics collision is enabled
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Skeleton, meta = (PinHiddenByDefault))
+	bool bPipelinedEvaluation = false;
+
+	// crowd mode. solved with all crowd characters in one parallel pass of UVRM4U_SpringCrowdSubsystem. output is one frame behind. ignored while physics collision is enabled
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Skeleton, meta = (PinHiddenByDefault))
+	bool bCrowdEvaluation = false;
+
+	// simulate at fixedStepRate instead of the frame delta time. loopc substeps run inside each fixed step
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Skeleton, meta = (PinHiddenByDefault))
+	bool bFixedTimestep = false;
+
+	// steps per second for bFixedTimestep
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Skeleton, meta = (PinHiddenByDefault, ClampMin = "1.0"))
+	float fixedStepRate = 60.f;
+
+	// max steps in one frame. the rest of a long frame is dropped. the time caught up after budget skips is clamped to maxFixedSteps / fixedStepRate
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Skeleton, meta = (PinHiddenByDefault, ClampMin = "1"))
+	int maxFixedSteps = 4;
+
+	// blend the last two steps by the remaining time. output is up to one step behind
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Skeleton, meta = (PinHiddenByDefault))
+	bool bInterpolateFixedStep = true;
+
+	// pick a cheaper spring tier from screen size, visibility or SpringLODSelector
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Skeleton, meta = (PinHiddenByDefault))
+	bool bEnableSpringLOD = false;
+
+	// screen size (bounds radius / view distance) below which each tier is used
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Skeleton, meta = (PinHiddenByDefault))
+	float LODScreenSizeReducedSubsteps = 0.5f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Skeleton, meta = (PinHiddenByDefault))
+	float LODScreenSizeFirstJoints = 0.25f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Skeleton, meta = (PinHiddenByDefault))
+	float LODScreenSizeFrozen = 0.08f;
+
+	// a tier changes only after the screen size passes its threshold by this ratio
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Skeleton, meta = (PinHiddenByDefault, ClampMin = "0.0", ClampMax = "0.9"))
+	float LODHysteresis = 0.1f;
+
+	// loopc for ReducedSubsteps and lower
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Skeleton, meta = (PinHiddenByDefault, ClampMin = "1"))
+	int LODReducedLoopCount = 1;
+
+	// simulated joints from the root of each chain for FirstJoints and lower. others follow their parent
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Skeleton, meta = (PinHiddenByDefault, ClampMin = "1"))
+	int LODFirstJointCount = 2;
+
+	// Frozen fades out to the input pose instead of keeping the last result
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Skeleton, meta = (PinHiddenByDefault))
+	bool bLODFrozenUsesInputPose = false;
+
+	// use Frozen while the mesh is not rendered
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Skeleton, meta = (PinHiddenByDefault))
+	bool bLODFreezeWhenNotRendered = true;
+
+	// seconds to blend between tiers
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Skeleton, meta = (PinHiddenByDefault, ClampMin = "0.0"))
+	float LODBlendTime = 0.2f;
+
+	// e.g. from a significance manager. overrides the screen size rule for all spring nodes
+	static FVrmSpringLODSelector SpringLODSelector;
+
+	// order against other characters when UVRM4U_SpringBudgetSubsystem is over budget. scaled by screen size
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Skeleton, meta = (PinHiddenByDefault, ClampMin = "0.0"))
+	float SpringBudgetPriority = 1.f;
+
+	// steps simulated with the first pose after init and reset, so that springs start settled. not counted by the spring budget
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Skeleton, meta = (PinHiddenByDefault, ClampMin = "0"))
+	int WarmStartSteps = 0;
+
+	// per chain and per joint multipliers. resolved to a table at init. call RefreshJointOverrides after changing them at runtime
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Skeleton, meta = (PinHiddenByDefault))
+	TArray<FVrmSpringJointOverride> JointOverrides;
+
+	// no gravityAdd and no wind for these bones and their children. resolved at init with JointOverrides
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Skeleton, meta = (PinHiddenByDefault))
 	TArray<FName> NoWindBoneNameList;
 
+	// resolve JointOverrides and NoWindBoneNameList again on the next evaluate
+	void RefreshJointOverrides();
+	bool bJointOverridesDirty = false;
+
 	TSharedPtr<VRMSpringBone::VRMSpringManagerBase> SpringManager;
 
 	float CurrentDeltaTime = 0.f;
 
+	FVrmSpringWindSnapshot WindSnapshot;
+	void SampleWind(const USkeletalMeshComponent* SkelComp);
+
+	// SpringLOD is picked on game thread, AppliedSpringLOD is the one the worker runs
+	EVRMSpringLOD SpringLOD = EVRMSpringLOD::VRMSL_Full;
+	EVRMSpringLOD AppliedSpringLOD = EVRMSpringLOD::VRMSL_Full;
+	float LODWeight = 1.f;
+	bool bHasSpringResult = false;
+	void SelectSpringLOD(const USkeletalMeshComponent* SkelComp);
+	float CalcScreenSize(const USkeletalMeshComponent* SkelComp) const;
+
+	// set on game thread when a budget subsystem exists. time of frames skipped by the budget
+	UVRM4U_SpringBudgetSubsystem* SpringBudget = nullptr;
+	float BudgetSkippedTime = 0.f;
+	void UpdateSpringBudget(const USkeletalMeshComponent* SkelComp);
+
+	// bFixedTimestep. time not simulated yet
+	float FixedStepAccumulator = 0.f;
+	bool bFixedStepPrimed = false;
+
+	// bPipelinedEvaluation. simulation launched by the last evaluate. wait before touching SpringManager
+	FGraphEventRef SpringTask;
+	// bCrowdEvaluation. set on game thread
+	UVRM4U_SpringCrowdSubsystem* SpringCrowd = nullptr;
+	// also waits for the crowd batch which has the job of SpringManager
+	void WaitSpringTask() const;
+
 	bool bCallByAnimInstance = false;
 	TArray<FBoneTransform> BoneTransformsSpring;
 	bool IsSpringInit() const;
 
+	// spring state of all joints, tails in component space. call on game thread while the anim instance is not evaluated
+	bool SaveSpringState(TArray<uint8>& OutData) const;
+	// restored on the next evaluate. the model must be the same
+	void RestoreSpringState(const TArray<uint8>& Data);
+	// simulate Steps with the pose of the next evaluate, outside of the spring budget
+	void WarmStart(int32 Steps);
+
+	TArray<uint8> PendingSpringState;
+	int32 PendingWarmStartSteps = 0;
+
 private:
 	// Warning flags to avoid log spam (one warning per AnimNode instance)
 	bool bHasLoggedMetaObjectWarning = false;
@@ -118,6 +298,9 @@ public:
 #endif
 
 	virtual void UpdateInternal(const FAnimationUpdateContext& Context)override;
+
+	virtual bool HasPreUpdate() const override { return true; }
+	virtual void PreUpdate(const UAnimInstance* InAnimInstance) override;
 	// End of FAnimNode_SkeletalControlBase interface
 
 	virtual void ConditionalDebugDraw(FPrimitiveDrawInterface* PDI, USkeletalMeshComponent* PreviewSkelMeshComp, bool bPreviewForeground = false) const;
@@ -0,0 +1,120 @@
+// VRM4U Copyright (c) 2021-2024 Haruyoshi Yamamoto. This software is released under the MIT License.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/EngineSubsystem.h"
+#include "Misc/EngineVersionComparison.h"
+#include "VRM4U_SpringBudgetSubsystem.generated.h"
+
+
+#if	UE_VERSION_OLDER_THAN(4,22,0)
+
+//Couldn't find parent type for 'VRM4U_SpringBudgetSubsystem' named 'UEngineSubsystem'
+#error "please remove VRM4U_SpringBudgetSubsystem.h/cpp  for <=UE4.21"
+
+#endif
+
+namespace VRMSpringBone {
+	class VRMSpringManagerBase;
+}
+
+USTRUCT(BlueprintType)
+struct FVrmSpringBudgetStats {
+	GENERATED_USTRUCT_BODY()
+
+public:
+	// spring managers alive
+	UPROPERTY(BlueprintReadOnly, Category = VRM4U)
+	int32 Registered = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = VRM4U)
+	int32 Updated = 0;
+
+	// not planned for the frame. keeps the last result
+	UPROPERTY(BlueprintReadOnly, Category = VRM4U)
+	int32 Skipped = 0;
+
+	// planned, but stopped on the worker because the time budget was used up
+	UPROPERTY(BlueprintReadOnly, Category = VRM4U)
+	int32 Overrun = 0;
+
+	// updated with the time of skipped frames
+	UPROPERTY(BlueprintReadOnly, Category = VRM4U)
+	int32 Decimated = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = VRM4U)
+	int32 SimulatedJoints = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = VRM4U)
+	float TimeMs = 0.f;
+};
+
+// per frame budget for all spring bone nodes.
+// over budget, characters with higher significance are updated first. skipped ones rise every frame so that all of them are updated in turn.
+UCLASS()
+class VRM4U_API UVRM4U_SpringBudgetSubsystem : public UEngineSubsystem
+{
+	GENERATED_BODY()
+
+	FCriticalSection cs;
+
+public:
+
+	// simulated joints per frame. 0 is unlimited
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = VRM4U)
+	int32 MaxJointsPerFrame = 0;
+
+	// spring update time per frame in ms, all threads in total. 0 is unlimited
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = VRM4U)
+	float MaxTimeMsPerFrame = 0.f;
+
+	UFUNCTION(BlueprintCallable, Category = VRM4U)
+	FVrmSpringBudgetStats GetLastFrameStats();
+
+	// since start or ResetStats
+	UFUNCTION(BlueprintCallable, Category = VRM4U)
+	FVrmSpringBudgetStats GetTotalStats();
+
+	UFUNCTION(BlueprintCallable, Category = VRM4U)
+	void ResetStats();
+
+	// log the most expensive spring managers by measured update time. game thread
+	void LogTopManagers(int32 Num);
+
+	bool IsBudgetEnabled() const {
+		return MaxJointsPerFrame > 0 || MaxTimeMsPerFrame > 0.f;
+	}
+
+	static UVRM4U_SpringBudgetSubsystem* Get();
+
+	// every VRMSpringManagerBase. any thread
+	void Register(VRMSpringBone::VRMSpringManagerBase* Manager);
+	void Unregister(VRMSpringBone::VRMSpringManagerBase* Manager);
+
+	// game thread. plans the frame once, from the first spring node PreUpdate
+	void BeginFrame();
+
+	// anim worker. false if the manager should keep its last result this frame
+	bool TryBeginUpdate(VRMSpringBone::VRMSpringManagerBase* Manager);
+	void EndUpdate(VRMSpringBone::VRMSpringManagerBase* Manager, double Seconds, bool bDecimated);
+
+	virtual void Deinitialize() override;
+
+private:
+	// measured cost, or the joint estimate before the first update
+	double GetExpectedSeconds(const VRMSpringBone::VRMSpringManagerBase* Manager) const;
+
+	TArray<VRMSpringBone::VRMSpringManagerBase*> Managers;
+	uint64 PlannedFrame = MAX_uint64;
+
+	// time reserved by running updates and used by finished ones, of PlannedFrame
+	double FrameSeconds = 0.0;
+
+	// measured over all managers
+	double SecondsPerJoint = 1.0e-6;
+
+	FVrmSpringBudgetStats FrameStats;
+	FVrmSpringBudgetStats LastFrameStats;
+	FVrmSpringBudgetStats TotalStats;
+};
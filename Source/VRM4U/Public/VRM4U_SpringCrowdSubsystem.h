@@ -0,0 +1,75 @@
+// VRM4U Copyright (c) 2021-2024 Haruyoshi Yamamoto. This software is released under the MIT License.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/EngineSubsystem.h"
+#include "Misc/EngineVersionComparison.h"
+#include "VRM4U_SpringCrowdSubsystem.generated.h"
+
+
+#if	UE_VERSION_OLDER_THAN(4,22,0)
+
+//Couldn't find parent type for 'VRM4U_SpringCrowdSubsystem' named 'UEngineSubsystem'
+#error "please remove VRM4U_SpringCrowdSubsystem.h/cpp  for <=UE4.21"
+
+#endif
+
+namespace VRMSpringBone {
+	class VRMSpringManagerBase;
+	struct VRMSpringSimParams;
+}
+class UVRM4U_SpringBudgetSubsystem;
+class FVrmSpringCrowdQueue;
+
+USTRUCT(BlueprintType)
+struct FVrmSpringCrowdStats {
+	GENERATED_USTRUCT_BODY()
+
+public:
+	// characters in the last batch
+	UPROPERTY(BlueprintReadOnly, Category = VRM4U)
+	int32 Characters = 0;
+
+	// joints of the widest pass. one depth level of all characters is packed and integrated in one loop
+	UPROPERTY(BlueprintReadOnly, Category = VRM4U)
+	int32 PackedJoints = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = VRM4U)
+	float TimeMs = 0.f;
+};
+
+// crowd spring mode. spring nodes with bCrowdEvaluation submit the fetched pose,
+// and all of them are solved in one batch launched at the begin of the next frame.
+// the batch goes level by level. joints of the same depth of all characters are integrated in one loop.
+// a node waits only for the batch which has its own job.
+UCLASS()
+class VRM4U_API UVRM4U_SpringCrowdSubsystem : public UEngineSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	UFUNCTION(BlueprintCallable, Category = VRM4U)
+	FVrmSpringCrowdStats GetLastBatchStats() const;
+
+	static UVRM4U_SpringCrowdSubsystem* Get();
+
+	// anim worker. solved by the next batch. Budget gets EndUpdate with the time of this manager
+	void Submit(const TSharedPtr<VRMSpringBone::VRMSpringManagerBase>& Manager, const VRMSpringBone::VRMSpringSimParams& Params,
+		float StepTime, int32 StepCount, UVRM4U_SpringBudgetSubsystem* Budget, bool bDecimated);
+
+	// any thread. waits for the batch which solves Manager. a job which is not launched yet stays queued.
+	// nullptr waits for all batches
+	void Retire(const VRMSpringBone::VRMSpringManagerBase* Manager);
+
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+private:
+	// game thread. FCoreDelegates::OnBeginFrame. launches the batch submitted last frame
+	void BeginFrame();
+
+	TSharedPtr<FVrmSpringCrowdQueue> Queue;
+	FDelegateHandle BeginFrameHandle;
+};
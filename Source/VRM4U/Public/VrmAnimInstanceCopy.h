@@ -47,6 +47,8 @@ public:
 #else
 	virtual void UpdateAnimationNode(const FAnimationUpdateContext& InContext);
 #endif
+
+	virtual void PreUpdate(UAnimInstance* InAnimInstance, float DeltaSeconds);
 };
 
 /**
@@ -11,6 +11,7 @@
 #include "Vrm1LicenseObject.h"
 
 #include "VrmAsyncLoadAction.h"
+#include "VRM4U_AssetCacheSubsystem.h"
 
 #include "VrmConvert.h"
 #include "VrmUtil.h"
@@ -635,8 +636,8 @@ bool ULoaderBPFunctionLibrary::LoadVRMFile(const UVrmAssetListObject *InVrmAsset
 	return LoadVRMFileLocal(InVrmAsset, OutVrmAsset, filepath);
 }
 
-void ULoaderBPFunctionLibrary::LoadVRMFileAsync(const UObject* WorldContextObject, const class UVrmAssetListObject* InVrmAsset, class UVrmAssetListObject*& OutVrmAsset, const FString filepath, const FImportOptionData& OptionForRuntimeLoad, struct FLatentActionInfo LatentInfo) {
-	VRMConverter::Options::Get().SetVrmOption(&OptionForRuntimeLoad);
+static void LoadVRMFileAsyncLocal(const UObject* WorldContextObject, const class UVrmAssetListObject* InVrmAsset, class UVrmAssetListObject*& OutVrmAsset, const FString filepath, const FImportOptionData& OptionForRuntimeLoad, struct FLatentActionInfo LatentInfo, bool bShared) {
+	// the action converts with its own copy of the option
 	OutVrmAsset = nullptr;
 
 	if (UWorld* World = GEngine->GetWorldFromContextObject(WorldContextObject, EGetWorldErrorMode::LogAndReturnNull))
@@ -644,11 +645,55 @@ void ULoaderBPFunctionLibrary::LoadVRMFileAsync(const UObject* WorldContextObjec
 		FLatentActionManager& LatentActionManager = World->GetLatentActionManager();
 		if (LatentActionManager.FindExistingAction<FVrmAsyncLoadAction>(LatentInfo.CallbackTarget, LatentInfo.UUID) == NULL)
 		{
-			FVrmAsyncLoadActionParam p = { InVrmAsset, OutVrmAsset, OptionForRuntimeLoad, filepath, nullptr, 0 };
+			FVrmAsyncLoadActionParam p = { InVrmAsset, OutVrmAsset, OptionForRuntimeLoad, filepath, nullptr, 0, bShared };
 			LatentActionManager.AddNewAction(LatentInfo.CallbackTarget, LatentInfo.UUID, new FVrmAsyncLoadAction(LatentInfo, p));
 		}
 	}
-	return;
+}
+
+void ULoaderBPFunctionLibrary::LoadVRMFileAsync(const UObject* WorldContextObject, const class UVrmAssetListObject* InVrmAsset, class UVrmAssetListObject*& OutVrmAsset, const FString filepath, const FImportOptionData& OptionForRuntimeLoad, struct FLatentActionInfo LatentInfo) {
+	LoadVRMFileAsyncLocal(WorldContextObject, InVrmAsset, OutVrmAsset, filepath, OptionForRuntimeLoad, LatentInfo, false);
+}
+
+bool ULoaderBPFunctionLibrary::LoadVRMFileShared(const UVrmAssetListObject* InVrmAsset, UVrmAssetListObject*& OutVrmAsset, const FString filepath, const FImportOptionData& OptionForRuntimeLoad) {
+	OutVrmAsset = nullptr;
+
+	auto* Cache = UVRM4U_AssetCacheSubsystem::Get();
+	if (Cache == nullptr) {
+		return LoadVRMFile(InVrmAsset, OutVrmAsset, filepath, OptionForRuntimeLoad);
+	}
+
+	const FString Key = UVRM4U_AssetCacheSubsystem::MakeKey(filepath, InVrmAsset, OptionForRuntimeLoad);
+	OutVrmAsset = Cache->Acquire(Key);
+	if (OutVrmAsset) {
+		return true;
+	}
+
+	// if an async request of the same key is converting, this can not wait for it on the game thread.
+	// load here, then the async one gets this result from EndLoad
+	TArray<TWeakObjectPtr<UObject>> StandaloneObjects;
+	VRMConverter::Options::Get().StandaloneObjects = &StandaloneObjects;
+	const bool bLoaded = LoadVRMFile(InVrmAsset, OutVrmAsset, filepath, OptionForRuntimeLoad);
+	VRMConverter::Options::Get().StandaloneObjects = nullptr;
+
+	if (bLoaded == false) {
+		// what the conversion created so far
+		UVRM4U_AssetCacheSubsystem::ReleaseStandalone(OutVrmAsset, StandaloneObjects);
+		OutVrmAsset = nullptr;
+		return false;
+	}
+	OutVrmAsset = Cache->Add(Key, OutVrmAsset, StandaloneObjects);
+	return OutVrmAsset != nullptr;
+}
+
+void ULoaderBPFunctionLibrary::LoadVRMFileSharedAsync(const UObject* WorldContextObject, const class UVrmAssetListObject* InVrmAsset, class UVrmAssetListObject*& OutVrmAsset, const FString filepath, const FImportOptionData& OptionForRuntimeLoad, struct FLatentActionInfo LatentInfo) {
+	LoadVRMFileAsyncLocal(WorldContextObject, InVrmAsset, OutVrmAsset, filepath, OptionForRuntimeLoad, LatentInfo, true);
+}
+
+void ULoaderBPFunctionLibrary::ReleaseVRMFileShared(const UVrmAssetListObject* VrmAsset) {
+	if (auto* Cache = UVRM4U_AssetCacheSubsystem::Get()) {
+		Cache->Release(VrmAsset);
+	}
 }
 
 
@@ -686,34 +731,16 @@ bool ULoaderBPFunctionLibrary::LoadVRMFileFromMemoryDefaultOption(UVrmAssetListO
 	return LoadVRMFileFromMemory(m.Get(), OutVrmAsset, filepath, pData, dataSize);
 }
 
-bool ULoaderBPFunctionLibrary::LoadVRMFileFromMemory(const UVrmAssetListObject *InVrmAsset, UVrmAssetListObject *&OutVrmAsset, const FString filepath, const uint8 *pFileDataData, size_t dataSize) {
-	TRACE_CPUPROFILER_EVENT_SCOPE(TEXT("LoadVRMFileFromMemory"))
-
-	OutVrmAsset = nullptr;
-	RenderControl _dummy_control;
+const aiScene* ULoaderBPFunctionLibrary::ReadVRMScene(Assimp::Importer& Importer, const FString filepath, const uint8* pFileData, size_t dataSize) {
+	TRACE_CPUPROFILER_EVENT_SCOPE(TEXT("AssImpLoader"))
 
-	if (InVrmAsset == nullptr) {
-		return false;
-	}
-
-	Assimp::Importer mImporter;
-	mImporter.SetPropertyBool(AI_CONFIG_IMPORT_REMOVE_EMPTY_BONES, false);
+	const double StartTime = FPlatformTime::Seconds();
 	const aiScene* mScenePtr = nullptr; // delete by Assimp::Importer::~Importer
 
-	if (filepath.IsEmpty())
-	{
-	}
-
-	double StartTime = FPlatformTime::Seconds();
-	auto LogAndUpdate = [&](FString logname) {
-		UE_LOG(LogVRM4ULoader, Log, TEXT("VRM:(%02.2lf secs) %s"), FPlatformTime::Seconds() - StartTime, *logname);
-		StartTime = FPlatformTime::Seconds();
-	};
+	Importer.SetPropertyBool(AI_CONFIG_IMPORT_REMOVE_EMPTY_BONES, false);
 
 	VRMConverter::Options::Get().SetVRM0Model(true);
 	{
-		TRACE_CPUPROFILER_EVENT_SCOPE(TEXT("AssImpLoader"))
-
 		const FString ext = FPaths::GetExtension(filepath).ToLower();
 #if PLATFORM_WINDOWS
 		std::string e = utf_16_to_shift_jis(*ext);
@@ -723,9 +750,9 @@ bool ULoaderBPFunctionLibrary::LoadVRMFileFromMemory(const UVrmAssetListObject *
 		std::string e_imp = TCHAR_TO_UTF8(*ext);
 #endif
 
-		e_imp = GetExtAndSetModelTypeLocal(e, pFileDataData, dataSize);
+		e_imp = GetExtAndSetModelTypeLocal(e, pFileData, dataSize);
 
-		mScenePtr = mImporter.ReadFileFromMemory(pFileDataData, dataSize,
+		mScenePtr = Importer.ReadFileFromMemory(pFileData, dataSize,
 			aiProcess_Triangulate | aiProcess_MakeLeftHanded | aiProcess_CalcTangentSpace | aiProcess_GenSmoothNormals | aiProcess_OptimizeMeshes | aiProcess_PopulateArmatureData,
 			e_imp.c_str());
 
@@ -736,13 +763,44 @@ bool ULoaderBPFunctionLibrary::LoadVRMFileFromMemory(const UVrmAssetListObject *
 #else
 			file = TCHAR_TO_UTF8(*filepath);
 #endif
-			mScenePtr = mImporter.ReadFile(file, aiProcess_Triangulate | aiProcess_MakeLeftHanded | aiProcess_CalcTangentSpace | aiProcess_GenSmoothNormals | aiProcess_OptimizeMeshes | aiProcess_PopulateArmatureData);
+			mScenePtr = Importer.ReadFile(file, aiProcess_Triangulate | aiProcess_MakeLeftHanded | aiProcess_CalcTangentSpace | aiProcess_GenSmoothNormals | aiProcess_OptimizeMeshes | aiProcess_PopulateArmatureData);
 		}
+	}
 
-		UE_LOG(LogVRM4ULoader, Log, TEXT("VRM:(%3.3lf secs) ReadFileFromMemory"), FPlatformTime::Seconds() - StartTime);
-		StartTime = FPlatformTime::Seconds();
+	UE_LOG(LogVRM4ULoader, Log, TEXT("VRM:(%3.3lf secs) ReadFileFromMemory"), FPlatformTime::Seconds() - StartTime);
+	return mScenePtr;
+}
+
+bool ULoaderBPFunctionLibrary::LoadVRMFileFromMemory(const UVrmAssetListObject *InVrmAsset, UVrmAssetListObject *&OutVrmAsset, const FString filepath, const uint8 *pFileDataData, size_t dataSize) {
+	TRACE_CPUPROFILER_EVENT_SCOPE(TEXT("LoadVRMFileFromMemory"))
+
+	OutVrmAsset = nullptr;
+
+	if (InVrmAsset == nullptr) {
+		return false;
 	}
 
+	Assimp::Importer mImporter;
+	const aiScene* mScenePtr = ReadVRMScene(mImporter, filepath, pFileDataData, dataSize);
+
+	return LoadVRMFileFromScene(InVrmAsset, OutVrmAsset, filepath, pFileDataData, dataSize, mScenePtr);
+}
+
+bool ULoaderBPFunctionLibrary::LoadVRMFileFromScene(const UVrmAssetListObject* InVrmAsset, UVrmAssetListObject*& OutVrmAsset, const FString filepath, const uint8* pFileDataData, size_t dataSize, const aiScene* mScenePtr, VrmPreparedScene* pPrepared) {
+	TRACE_CPUPROFILER_EVENT_SCOPE(TEXT("LoadVRMFileFromScene"))
+
+	RenderControl _dummy_control;
+
+	if (InVrmAsset == nullptr) {
+		return false;
+	}
+
+	double StartTime = FPlatformTime::Seconds();
+	auto LogAndUpdate = [&](FString logname) {
+		UE_LOG(LogVRM4ULoader, Log, TEXT("VRM:(%02.2lf secs) %s"), FPlatformTime::Seconds() - StartTime, *logname);
+		StartTime = FPlatformTime::Seconds();
+	};
+
 	UpdateProgress(20);
 	if (mScenePtr == nullptr)
 	{
@@ -797,7 +855,7 @@ bool ULoaderBPFunctionLibrary::LoadVRMFileFromMemory(const UVrmAssetListObject *
 	{
 		bool ret = true;
 		VRMConverter vc;
-		vc.Init(pFileDataData, dataSize, mScenePtr);
+		vc.Init(pFileDataData, dataSize, mScenePtr, pPrepared);
 		vc.ConvertVrmFirst(out, pFileDataData, dataSize);
 
 		LogAndUpdate(TEXT("Begin convert"));
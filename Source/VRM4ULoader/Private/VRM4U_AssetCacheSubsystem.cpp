@@ -0,0 +1,234 @@
+// VRM4U Copyright (c) 2021-2024 Haruyoshi Yamamoto. This software is released under the MIT License.
+
+
+#include "VRM4U_AssetCacheSubsystem.h"
+#include "VrmAssetListObject.h"
+#include "VrmUtil.h"
+#include "VRM4ULoaderLog.h"
+#include "Engine/Engine.h"
+#include "Engine/SkeletalMesh.h"
+#include "Engine/Texture2D.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/Paths.h"
+
+namespace {
+	TAutoConsoleVariable<int32> CVarAssetCacheBudgetMB(
+		TEXT("vrm4u.AssetCache.BudgetMB"),
+		512,
+		TEXT("Memory kept for released VRM asset sets in the runtime asset cache. entries still referenced are not counted out."));
+
+	FAutoConsoleCommand CmdAssetCacheStats(
+		TEXT("vrm4u.AssetCache.Stats"),
+		TEXT("Log VRM runtime asset cache stats."),
+		FConsoleCommandDelegate::CreateLambda([]() {
+			if (auto* Cache = UVRM4U_AssetCacheSubsystem::Get()) {
+				const FVrmAssetCacheStats s = Cache->GetStats();
+				UE_LOG(LogVRM4ULoader, Log, TEXT("VRM4U AssetCache: entries=%d referenced=%d size=%.1fMB hit=%d miss=%d"),
+					s.Entries, s.Referenced, s.SizeMB, s.Hits, s.Misses);
+			}
+		})
+	);
+
+	FAutoConsoleCommand CmdAssetCacheFlush(
+		TEXT("vrm4u.AssetCache.Flush"),
+		TEXT("Evict all released VRM asset sets from the runtime asset cache."),
+		FConsoleCommandDelegate::CreateLambda([]() {
+			if (auto* Cache = UVRM4U_AssetCacheSubsystem::Get()) {
+				Cache->Flush();
+			}
+		})
+	);
+
+	int64 GetAssetBytes(const UVrmAssetListObject* Asset) {
+		int64 Bytes = 0;
+		for (auto* t : Asset->Textures) {
+			if (t) {
+				Bytes += t->GetResourceSizeBytes(EResourceSizeMode::EstimatedTotal);
+			}
+		}
+		if (Asset->SkeletalMesh) {
+			Bytes += Asset->SkeletalMesh->GetResourceSizeBytes(EResourceSizeMode::EstimatedTotal);
+		}
+		return Bytes;
+	}
+}
+
+UVRM4U_AssetCacheSubsystem* UVRM4U_AssetCacheSubsystem::Get() {
+	if (GEngine == nullptr) {
+		return nullptr;
+	}
+	return GEngine->GetEngineSubsystem<UVRM4U_AssetCacheSubsystem>();
+}
+
+FString UVRM4U_AssetCacheSubsystem::MakeKey(const FString& filepath, const UVrmAssetListObject* InVrmAsset, const FImportOptionData& Option) {
+	FString OptionText;
+	FImportOptionData::StaticStruct()->ExportText(OptionText, &Option, nullptr, nullptr, PPF_None, nullptr);
+
+	const FString fullpath = FPaths::ConvertRelativePathToFull(filepath);
+	return FString::Printf(TEXT("%s|%lld|%s|%s|%s"),
+		*fullpath,
+		IFileManager::Get().FileSize(*fullpath),
+		*IFileManager::Get().GetTimeStamp(*fullpath).ToString(),
+		InVrmAsset ? *InVrmAsset->GetPathName() : TEXT(""),
+		*OptionText);
+}
+
+UVrmAssetListObject* UVRM4U_AssetCacheSubsystem::Acquire(const FString& Key) {
+	for (auto& e : Entries) {
+		if (e.Key == Key && IsValid(e.Asset)) {
+			++e.RefCount;
+			e.LastUseTime = FPlatformTime::Seconds();
+			++Hits;
+			return e.Asset;
+		}
+	}
+	++Misses;
+	return nullptr;
+}
+
+void UVRM4U_AssetCacheSubsystem::ReleaseStandalone(UVrmAssetListObject* Asset, const TArray<TWeakObjectPtr<UObject>>& StandaloneObjects) {
+	UPackage* Transient = GetTransientPackage();
+	// the set itself is duplicated from a template asset, with its flags
+	if (Asset && Asset->GetOutermost() == Transient) {
+		Asset->ClearFlags(RF_Standalone);
+	}
+	for (const auto& w : StandaloneObjects) {
+		UObject* o = w.Get();
+		if (o && o->GetOutermost() == Transient) {
+			o->ClearFlags(RF_Standalone);
+		}
+	}
+}
+
+UVrmAssetListObject* UVRM4U_AssetCacheSubsystem::Add(const FString& Key, UVrmAssetListObject* Asset, const TArray<TWeakObjectPtr<UObject>>& StandaloneObjects) {
+	if (Asset == nullptr) {
+		ReleaseStandalone(nullptr, StandaloneObjects);
+		return nullptr;
+	}
+	for (auto& e : Entries) {
+		if (e.Key == Key && IsValid(e.Asset)) {
+			// loaded twice at the same time. keep the first one, nobody has the other one yet
+			if (e.Asset != Asset) {
+				ReleaseStandalone(Asset, StandaloneObjects);
+			}
+			++e.RefCount;
+			e.LastUseTime = FPlatformTime::Seconds();
+			return e.Asset;
+		}
+	}
+
+	auto& e = Entries.AddDefaulted_GetRef();
+	e.Asset = Asset;
+	e.Key = Key;
+	e.StandaloneObjects = StandaloneObjects;
+	e.RefCount = 1;
+	e.Bytes = GetAssetBytes(Asset);
+	e.LastUseTime = FPlatformTime::Seconds();
+
+	Trim();
+	return Asset;
+}
+
+bool UVRM4U_AssetCacheSubsystem::IsLoading(const FString& Key) const {
+	return Loading.Contains(Key);
+}
+
+bool UVRM4U_AssetCacheSubsystem::BeginLoad(const FString& Key) {
+	bool bAlreadyInSet = false;
+	Loading.Add(Key, &bAlreadyInSet);
+	return bAlreadyInSet == false;
+}
+
+UVrmAssetListObject* UVRM4U_AssetCacheSubsystem::EndLoad(const FString& Key, UVrmAssetListObject* Asset, const TArray<TWeakObjectPtr<UObject>>& StandaloneObjects) {
+	Loading.Remove(Key);
+	// on failure, releases what the conversion created so far
+	return Add(Key, Asset, StandaloneObjects);
+}
+
+void UVRM4U_AssetCacheSubsystem::Release(const UVrmAssetListObject* Asset) {
+	if (Asset == nullptr) {
+		return;
+	}
+	for (auto& e : Entries) {
+		if (e.Asset == Asset) {
+			if (e.RefCount > 0) {
+				--e.RefCount;
+			} else {
+				UE_LOG(LogVRM4ULoader, Warning, TEXT("VRM4U AssetCache: %s released more than acquired"), *Asset->GetName());
+			}
+			e.LastUseTime = FPlatformTime::Seconds();
+			break;
+		}
+	}
+	Trim();
+}
+
+void UVRM4U_AssetCacheSubsystem::Trim() {
+	Evict((int64)FMath::Max(0, CVarAssetCacheBudgetMB.GetValueOnGameThread()) * 1024 * 1024);
+}
+
+void UVRM4U_AssetCacheSubsystem::Flush() {
+	Evict(0);
+}
+
+void UVRM4U_AssetCacheSubsystem::Evict(int64 Budget) {
+	Entries.RemoveAll([](const FVrmAssetCacheEntry& e) {
+		if (IsValid(e.Asset)) {
+			return false;
+		}
+		// the set was destroyed outside. its objects still have the flag
+		ReleaseStandalone(nullptr, e.StandaloneObjects);
+		return true;
+	});
+
+	int64 Total = 0;
+	for (const auto& e : Entries) {
+		Total += e.Bytes;
+	}
+
+	while (Total > Budget) {
+		int32 Oldest = INDEX_NONE;
+		for (int32 i = 0; i < Entries.Num(); ++i) {
+			if (Entries[i].RefCount > 0) {
+				continue;
+			}
+			if (Oldest == INDEX_NONE || Entries[i].LastUseTime < Entries[Oldest].LastUseTime) {
+				Oldest = i;
+			}
+		}
+		if (Oldest == INDEX_NONE) {
+			// all in use
+			break;
+		}
+		// no reference and no RF_Standalone from here. GC collects the set once no component uses it
+		ReleaseStandalone(Entries[Oldest].Asset, Entries[Oldest].StandaloneObjects);
+		Total -= Entries[Oldest].Bytes;
+		Entries.RemoveAt(Oldest);
+	}
+}
+
+FVrmAssetCacheStats UVRM4U_AssetCacheSubsystem::GetStats() const {
+	FVrmAssetCacheStats s;
+	s.Entries = Entries.Num();
+	int64 Bytes = 0;
+	for (const auto& e : Entries) {
+		if (e.RefCount > 0) {
+			++s.Referenced;
+		}
+		Bytes += e.Bytes;
+	}
+	s.SizeMB = (float)(Bytes / (1024.0 * 1024.0));
+	s.Hits = Hits;
+	s.Misses = Misses;
+	return s;
+}
+
+void UVRM4U_AssetCacheSubsystem::Deinitialize() {
+	for (const auto& e : Entries) {
+		ReleaseStandalone(e.Asset, e.StandaloneObjects);
+	}
+	Entries.Empty();
+	Loading.Empty();
+	Super::Deinitialize();
+}
@@ -2,12 +2,19 @@
 
 #include "VrmAsyncLoadAction.h"
 #include "Async/TaskGraphInterfaces.h"
+#include "Async/ParallelFor.h"
 #include "Engine/Texture2D.h"
 #include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Modules/ModuleManager.h"
+#include "HAL/IConsoleManager.h"
+#include "IImageWrapperModule.h"
 
 #include "LoaderBPFunctionLibrary.h"
 #include "VrmAssetListObject.h"
 #include "VRM4ULoaderLog.h"
+#include "VrmLoadCache.h"
+#include "VRM4U_AssetCacheSubsystem.h"
 
 
 #include <assimp/Importer.hpp>
@@ -25,29 +32,104 @@
 #endif
 
 namespace {
-	class VrmLocalAsyncAsset {
-	public:
-		TArray<bool> NormalBoolTable;
-		TArray<bool> MaskBoolTable;
-		TArray<uint8> vrmLocalRes;
-
-		Assimp::Importer* Importer = nullptr;
-		const aiScene* ScenePtr = nullptr;
-
-		void Reset() {
-			delete Importer;
-			Importer = nullptr;
-			ScenePtr = nullptr;
-
-			NormalBoolTable.Empty();
-			MaskBoolTable.Empty();
-			vrmLocalRes.Empty();
+	TAutoConsoleVariable<int32> CVarAsyncLoadMaxConcurrent(
+		TEXT("vrm4u.AsyncLoad.MaxConcurrent"),
+		4,
+		TEXT("Max LoadVRMFileAsync requests reading, parsing or converting at once. others wait in the latent queue. 0 is no limit."));
+
+	// game thread only
+	int32 ActiveLoadNum = 0;
+}
+
+// state of one LoadVRMFileAsync request. the worker tasks only touch this and param
+class VrmLocalAsyncAsset {
+public:
+	TArray<bool> NormalBoolTable;
+	TArray<bool> MaskBoolTable;
+	TArray<uint8> vrmLocalRes;
+
+	Assimp::Importer* Importer = nullptr;
+	const aiScene* ScenePtr = nullptr;
+	// from VRMLoadCache instead of Importer
+	aiScene* CachedScene = nullptr;
+
+	// decoded on the worker. empty RawData means decode failed or already used
+	TArray<VRMUtil::FImportImage> TextureImage;
+
+	// json, morph, mesh and weight data read on the worker. AssetCreate converts with it
+	VrmPreparedScene Prepared;
+
+	// converter options of this request. Options::Get() returns it inside OptionsScope
+	VRMConverter::Options Option;
+
+	int TexCount = 0;
+	int SubCount = 0;
+	int FrameCount = 0;
+	double StartTime = 0.f;
+
+	// counted in ActiveLoadNum
+	bool bActive = false;
+
+	// key of the runtime asset cache when param.bShared
+	FString SharedKey;
+	// this request converts SharedKey, between BeginLoad and EndLoad
+	bool bSharedLoading = false;
+	// RF_Standalone objects of the conversion. Option collects them while bSharedLoading
+	TArray<TWeakObjectPtr<UObject>> StandaloneObjects;
+	bool bConverted = false;
+
+	~VrmLocalAsyncAsset() {
+		Reset();
+	}
+
+	void Reset() {
+		delete Importer;
+		Importer = nullptr;
+		VRMLoadCache::FreeScene(CachedScene);
+		ScenePtr = nullptr;
+
+		NormalBoolTable.Empty();
+		MaskBoolTable.Empty();
+		vrmLocalRes.Empty();
+		TextureImage.Empty();
+		Prepared.Reset();
+
+		if (bActive) {
+			bActive = false;
+			--ActiveLoadNum;
 		}
-	};
-	VrmLocalAsyncAsset localAsset;
+
+		// failed or aborted. the requests waiting for this key load by themselves
+		if (bSharedLoading) {
+			bSharedLoading = false;
+			if (auto* Cache = UVRM4U_AssetCacheSubsystem::Get()) {
+				Cache->EndLoad(SharedKey, nullptr, StandaloneObjects);
+			}
+		}
+		Option.StandaloneObjects = nullptr;
+		StandaloneObjects.Empty();
+	}
+};
+
+// worker thread. pure cpu work on the scene, no UObject
+static void DecodeTextureImage(VrmLocalAsyncAsset& localAsset, const aiScene* mScenePtr) {
+	TRACE_CPUPROFILER_EVENT_SCOPE(TEXT("VRMLoad DecodeTextureImage"))
+
+	localAsset.TextureImage.Empty();
+	if (mScenePtr == nullptr || mScenePtr->HasTextures() == false) {
+		return;
+	}
+	localAsset.TextureImage.SetNum(mScenePtr->mNumTextures);
+
+	ParallelFor(mScenePtr->mNumTextures, [&](int32 i) {
+		const auto& t = *mScenePtr->mTextures[i];
+		if (VRMLoaderUtil::LoadImageFromMemory(t.pcData, t.mWidth, localAsset.TextureImage[i]) == false) {
+			localAsset.TextureImage[i].RawData.Empty();
+		}
+	});
 }
 
-static bool ConvTex(UVrmAssetListObject* vrmAssetList, const aiScene* mScenePtr, const FImportOptionData* option, const int TexCount, const int SubCount) {
+static bool ConvTex(VrmLocalAsyncAsset& localAsset, UVrmAssetListObject* vrmAssetList, const aiScene* mScenePtr, const FImportOptionData* option, const int TexCount, const int SubCount) {
 	if (vrmAssetList == nullptr || mScenePtr == nullptr) {
 		return true;
 	}
@@ -104,12 +186,21 @@ static bool ConvTex(UVrmAssetListObject* vrmAssetList, const aiScene* mScenePtr,
 
 				FString name = FString(TEXT("T_")) + baseName;
 				auto* pkg = GetTransientPackage();
-				UTexture2D* NewTexture2D = VRMLoaderUtil::CreateTextureFromImage(name, pkg, t.pcData, t.mWidth, false, localAsset.NormalBoolTable[i], bNormalGreenFlip&&(VRMConverter::IsImportMode() == false));
+				UTexture2D* NewTexture2D = nullptr;
+				if (localAsset.TextureImage.IsValidIndex(i) && localAsset.TextureImage[i].RawData.Num() > 0) {
+					NewTexture2D = VRMLoaderUtil::CreateTextureFromImage(name, pkg, localAsset.TextureImage[i], false, localAsset.NormalBoolTable[i], bNormalGreenFlip&&(VRMConverter::IsImportMode() == false));
+					localAsset.TextureImage[i].RawData.Empty();
+				} else {
+					NewTexture2D = VRMLoaderUtil::CreateTextureFromImage(name, pkg, t.pcData, t.mWidth, false, localAsset.NormalBoolTable[i], bNormalGreenFlip&&(VRMConverter::IsImportMode() == false));
+				}
 				vrmAssetList->Textures[i] = NewTexture2D;
 			}
 
 			if (SubCount == 1) {
 				UTexture2D* NewTexture2D = vrmAssetList->Textures[i];
+				if (NewTexture2D == nullptr) {
+					return false;
+				}
 
 #if WITH_EDITOR
 				NewTexture2D->DeferCompression = false;
@@ -160,7 +251,18 @@ FVrmAsyncLoadAction::FVrmAsyncLoadAction(const FLatentActionInfo& LatentInfo, FV
 	, OutputLink(LatentInfo.Linkage)
 	, CallbackTarget(LatentInfo.CallbackTarget)
 	, param(p)
+	, Local(MakeUnique<VrmLocalAsyncAsset>())
 	{
+	Local->Option = VRMConverter::Options::Get();
+	Local->Option.SetVrmOption(&param.OptionForRuntimeLoad);
+	Local->Option.StandaloneObjects = nullptr;
+}
+
+FVrmAsyncLoadAction::~FVrmAsyncLoadAction() {
+	// the worker task refers this action and Local
+	if (t2.IsValid() && t2->IsComplete() == false) {
+		FTaskGraphInterface::Get().WaitUntilTaskCompletes(t2);
+	}
 }
 
 
@@ -172,26 +274,61 @@ void FVrmAsyncLoadAction::UpdateOperation(FLatentResponse& Response)
 		Init,
 		FileWait,
 		AssImp,
+		AssImpWait,
 		TextureLoop,
 		AssetCreate,
 		Finish,
 	};
 
-	static int TexCount = 0;
-	static int SubCount = 0;
-	static int FrameCount = 0;
-	static double StartTime = 0.f;
+	VrmLocalAsyncAsset& localAsset = *Local;
+	VRMConverter::OptionsScope OptionScope(localAsset.Option);
+
+	int& TexCount = localAsset.TexCount;
+	int& SubCount = localAsset.SubCount;
+	int& FrameCount = localAsset.FrameCount;
+	double& StartTime = localAsset.StartTime;
 	++FrameCount;
 
+	const FString fileName = FPaths::GetCleanFilename(param.filepath);
 	auto logFunc = [&](FString str="") {
-		UE_LOG(LogVRM4ULoader, Log, TEXT("AsyncLoad frame=%04d(%02.2lf),  SequenceNo=%02d %s"), FrameCount, FPlatformTime::Seconds()-StartTime, SequenceCount, *str);
+		UE_LOG(LogVRM4ULoader, Log, TEXT("AsyncLoad %s frame=%04d(%02.2lf),  SequenceNo=%02d %s"), *fileName, FrameCount, FPlatformTime::Seconds()-StartTime, SequenceCount, *str);
 	};
 	auto logTexFunc = [&](int TexCount) {
-		UE_LOG(LogVRM4ULoader, Log, TEXT("AsyncLoad frame=%04d(%02.2lf),  SequenceNo=%02d  TextureCount=%02d"), FrameCount, FPlatformTime::Seconds() - StartTime, SequenceCount, TexCount);
+		UE_LOG(LogVRM4ULoader, Log, TEXT("AsyncLoad %s frame=%04d(%02.2lf),  SequenceNo=%02d  TextureCount=%02d"), *fileName, FrameCount, FPlatformTime::Seconds() - StartTime, SequenceCount, TexCount);
 	};
 
 	// async file load
 	if (SequenceCount == (int)ESequenceNo::Init) {
+		auto* Cache = UVRM4U_AssetCacheSubsystem::Get();
+		if (param.bShared && Cache && localAsset.bSharedLoading == false) {
+			if (localAsset.SharedKey.IsEmpty()) {
+				localAsset.SharedKey = UVRM4U_AssetCacheSubsystem::MakeKey(param.filepath, param.InVrmAsset, param.OptionForRuntimeLoad);
+			}
+			if (Cache->IsLoading(localAsset.SharedKey)) {
+				// another request converts the same key. take its result
+				return;
+			}
+			if (UVrmAssetListObject* a = Cache->Acquire(localAsset.SharedKey)) {
+				param.OutVrmAsset = a;
+				logFunc("Shared");
+				Response.FinishAndTriggerIf(true, ExecutionFunction, OutputLink, CallbackTarget);
+				localAsset.Reset();
+				return;
+			}
+			localAsset.bSharedLoading = Cache->BeginLoad(localAsset.SharedKey);
+			if (localAsset.bSharedLoading) {
+				localAsset.Option.StandaloneObjects = &localAsset.StandaloneObjects;
+			}
+		}
+
+		const int32 MaxConcurrent = CVarAsyncLoadMaxConcurrent.GetValueOnGameThread();
+		if (MaxConcurrent > 0 && ActiveLoadNum >= MaxConcurrent) {
+			// wait for a slot
+			return;
+		}
+		localAsset.bActive = true;
+		++ActiveLoadNum;
+
 		TRACE_CPUPROFILER_EVENT_SCOPE(TEXT("VRMLoad UpdateOperation init"))
 		TexCount = 0;
 		SubCount = 0;
@@ -201,10 +338,13 @@ void FVrmAsyncLoadAction::UpdateOperation(FLatentResponse& Response)
 		++SequenceCount;
 
 
-		TFunction< void() > f = [&] {
-			if (FFileHelper::LoadFileToArray(localAsset.vrmLocalRes, *param.filepath)) {
-				param.pData = localAsset.vrmLocalRes.GetData();
-				param.dataSize = localAsset.vrmLocalRes.Num();
+		// load on the game thread. the worker only uses it
+		FModuleManager::LoadModuleChecked<IImageWrapperModule>(FName("ImageWrapper"));
+
+		TFunction< void() > f = [this] {
+			if (FFileHelper::LoadFileToArray(Local->vrmLocalRes, *param.filepath)) {
+				param.pData = Local->vrmLocalRes.GetData();
+				param.dataSize = Local->vrmLocalRes.Num();
 			}
 		};
 
@@ -230,10 +370,45 @@ void FVrmAsyncLoadAction::UpdateOperation(FLatentResponse& Response)
 		logFunc();
 		++SequenceCount;
 
+		// parse once with the converter flags on the worker. AssetCreate converts this scene
 		localAsset.Importer = new Assimp::Importer();
-		localAsset.ScenePtr = localAsset.Importer->ReadFileFromMemory(localAsset.vrmLocalRes.GetData(), localAsset.vrmLocalRes.Num(),
-			aiProcess_Triangulate | aiProcess_MakeLeftHanded | aiProcess_CalcTangentSpace | aiProcess_GenSmoothNormals | aiProcess_OptimizeMeshes,
-			"vrm");
+		const FString CacheVersion = VRMLoadCache::IsEnabled() ? VRMLoadCache::GetVersion(param.OptionForRuntimeLoad) : FString();
+		TFunction< void() > f = [this, CacheVersion] {
+			TRACE_CPUPROFILER_EVENT_SCOPE(TEXT("VRMLoad assimp task"))
+			VRMConverter::OptionsScope TaskOptionScope(Local->Option);
+
+			// a hit skips the parse, Prepare and the texture decode
+			FString CacheKey;
+			if (CacheVersion.Len()) {
+				CacheKey = VRMLoadCache::MakeKey(param.pData, param.dataSize, CacheVersion);
+				Local->CachedScene = VRMLoadCache::Load(CacheKey, Local->Prepared, Local->TextureImage);
+				if (Local->CachedScene) {
+					Local->ScenePtr = Local->CachedScene;
+					Local->Prepared.PrepareJson(param.pData, param.dataSize);
+					UE_LOG(LogVRM4ULoader, Log, TEXT("AsyncLoad %s scene from cache %s"), *FPaths::GetCleanFilename(param.filepath), *CacheKey);
+					return;
+				}
+			}
+
+			Local->ScenePtr = ULoaderBPFunctionLibrary::ReadVRMScene(*Local->Importer, param.filepath, param.pData, param.dataSize);
+			if (Local->ScenePtr == nullptr) {
+				return;
+			}
+			Local->Prepared.Prepare(param.pData, param.dataSize, Local->ScenePtr);
+			DecodeTextureImage(*Local, Local->ScenePtr);
+			if (CacheKey.Len()) {
+				VRMLoadCache::Save(CacheKey, Local->ScenePtr, Local->Prepared, Local->TextureImage);
+			}
+		};
+		t2 = FFunctionGraphTask::CreateAndDispatchWhenReady(f, TStatId(), nullptr, ENamedThreads::AnyBackgroundThreadNormalTask);
+		return;
+	}
+
+	if (SequenceCount == (int)ESequenceNo::AssImpWait) {
+		if (t2->IsComplete()) {
+			logFunc();
+			++SequenceCount;
+		}
 		return;
 	}
 
@@ -248,10 +423,10 @@ void FVrmAsyncLoadAction::UpdateOperation(FLatentResponse& Response)
 		if (TexCount < (int)localAsset.ScenePtr->mNumTextures) {
 
 			if (SubCount == 0) {
-				ConvTex(param.OutVrmAsset, localAsset.ScenePtr, &param.OptionForRuntimeLoad, TexCount, 0);
+				ConvTex(localAsset, param.OutVrmAsset, localAsset.ScenePtr, &param.OptionForRuntimeLoad, TexCount, 0);
 			}
 			if (SubCount == 2) {
-				ConvTex(param.OutVrmAsset, localAsset.ScenePtr, &param.OptionForRuntimeLoad, TexCount, 1);
+				ConvTex(localAsset, param.OutVrmAsset, localAsset.ScenePtr, &param.OptionForRuntimeLoad, TexCount, 1);
 			}
 			++SubCount;
 
@@ -272,17 +447,21 @@ void FVrmAsyncLoadAction::UpdateOperation(FLatentResponse& Response)
 		TRACE_CPUPROFILER_EVENT_SCOPE(TEXT("VRMLoad UpdateOperation asset"))
 		logFunc();
 		++SequenceCount;
-		if (param.pData) {
-			ULoaderBPFunctionLibrary::LoadVRMFileFromMemory(param.InVrmAsset, param.OutVrmAsset, param.filepath, param.pData, param.dataSize);
-		} else {
-			ULoaderBPFunctionLibrary::LoadVRMFile(param.InVrmAsset, param.OutVrmAsset, param.filepath, param.OptionForRuntimeLoad);
-		}
+		// converts into OutVrmAsset, so the textures of TextureLoop are used as they are
+		localAsset.bConverted = ULoaderBPFunctionLibrary::LoadVRMFileFromScene(param.InVrmAsset, param.OutVrmAsset, param.filepath, param.pData, param.dataSize, localAsset.ScenePtr, &localAsset.Prepared);
 		return;
 	}
 
 	if (SequenceCount == (int)ESequenceNo::Finish) {
 		logFunc("End");
 
+		if (localAsset.bSharedLoading && localAsset.bConverted) {
+			localAsset.bSharedLoading = false;
+			if (auto* Cache = UVRM4U_AssetCacheSubsystem::Get()) {
+				param.OutVrmAsset = Cache->EndLoad(localAsset.SharedKey, param.OutVrmAsset, localAsset.StandaloneObjects);
+			}
+		}
+
 		Response.FinishAndTriggerIf(true, ExecutionFunction, OutputLink, CallbackTarget);
 		localAsset.Reset();
 	}
@@ -10,6 +10,7 @@
 
 class UVrmAssetListObject;
 struct FImportOptionData;
+class VrmLocalAsyncAsset;
 
 class FVrmAsyncLoadActionParam {
 public:
@@ -19,6 +20,8 @@ public:
 	const FString filepath;
 	const uint8* pData;
 	size_t dataSize;
+	// use the runtime asset cache
+	bool bShared = false;
 };
 
 
@@ -34,7 +37,11 @@ public:
 
 	FVrmAsyncLoadActionParam param;
 
+	// per request, so that several loads can run at once
+	TUniquePtr<VrmLocalAsyncAsset> Local;
+
 	FVrmAsyncLoadAction(const FLatentActionInfo& LatentInfo, FVrmAsyncLoadActionParam &);
+	virtual ~FVrmAsyncLoadAction();
 
 	virtual void UpdateOperation(FLatentResponse& Response) override;
 
@@ -1,6 +1,7 @@
 // VRM4U Copyright (c) 2021-2024 Haruyoshi Yamamoto. This software is released under the MIT License.
 
 #include "VrmConvert.h"
+#include "LoaderBPFunctionLibrary.h"
 
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
@@ -9,6 +10,11 @@
 #include <assimp/GltfMaterial.h>
 #include <assimp/vrm/vrmmeta.h>
 #include "UObject/Package.h"
+#include "Async/ParallelFor.h"
+
+#if	UE_VERSION_OLDER_THAN(4,23,0)
+#define TRACE_CPUPROFILER_EVENT_SCOPE(a)
+#endif
 
 //static void assimpDummy() {
 	//volatile float f = Assimp::Math::PI<float>();
@@ -33,6 +39,63 @@ UPackage *VRMConverter::CreatePackageFromImportMode(UPackage *p, const FString &
 #endif
 }
 
+void VrmPreparedScene::PrepareJson(const uint8* pFileData, size_t dataSize) {
+	VRMConverter c;
+	bJson = c.Init(pFileData, dataSize, nullptr);
+	jsonData.Swap(c.jsonData);
+}
+
+void VrmPreparedScene::Prepare(const uint8* pFileData, size_t dataSize, const aiScene* pScene) {
+	TRACE_CPUPROFILER_EVENT_SCOPE(TEXT("VRMLoad PrepareScene"))
+
+	PrepareJson(pFileData, dataSize);
+
+	Morph.Empty();
+	MeshData.Reset();
+	WeightTable.Empty();
+	bWeightTable = false;
+	if (pScene == nullptr) {
+		return;
+	}
+
+	// Options is per thread, read it before ParallelFor
+	const bool bVRM10 = VRMConverter::Options::Get().IsVRM10Model();
+	const bool bIncludeNormal = VRMConverter::Options::Get().IsEnableMorphTargetNormal();
+	if (VRMConverter::Options::Get().IsSkipMorphTarget() == false) {
+		Morph.SetNum(pScene->mNumMeshes);
+		ParallelFor(pScene->mNumMeshes, [&](int32 m) {
+			const aiMesh& aiM = *pScene->mMeshes[m];
+			Morph[m].SetNum(aiM.mNumAnimMeshes);
+			for (uint32_t a = 0; a < aiM.mNumAnimMeshes; ++a) {
+				MakeMorphSource(Morph[m][a], aiM, *aiM.mAnimMeshes[a], bVRM10, bIncludeNormal);
+			}
+		});
+	}
+
+	// same order as ConvertModel. morph reads only the anim mesh, the vertex optimize does not touch it
+	MeshData = MakeShareable(new FReturnedData());
+	MakeMeshData(*MeshData, pScene);
+
+	// only for bind pose -> t pose of ConvertModel
+	const auto& Opt = VRMConverter::Options::Get();
+	if (Opt.IsVRM10Model() && Opt.IsVRM10Bindpose() == false && Opt.IsDebugOneBone() == false && Opt.IsVRM10BindToRestPose()) {
+		MakeWeightTable(WeightTable, pScene);
+		bWeightTable = true;
+	}
+}
+
+void VrmPreparedScene::Reset() {
+	{
+		VrmJson empty;
+		jsonData.Swap(empty);
+	}
+	bJson = false;
+	Morph.Empty();
+	MeshData.Reset();
+	WeightTable.Empty();
+	bWeightTable = false;
+}
+
 
 FString VRMConverter::NormalizeFileName(const char *str) {
 	FString ret = UTF8_TO_TCHAR(str);
@@ -246,11 +309,28 @@ bool VRMConverter::NormalizeBoneName(const aiScene *mScenePtr) {
 
 ////
 
+namespace {
+	// set by OptionsScope. async loads convert with their own options
+	thread_local VRMConverter::Options* CurrentOptions = nullptr;
+}
+
 VRMConverter::Options& VRMConverter::Options::Get(){
+	if (CurrentOptions) {
+		return *CurrentOptions;
+	}
 	static VRMConverter::Options o;
 	return o;
 }
 
+VRMConverter::OptionsScope::OptionsScope(Options& o) {
+	Prev = CurrentOptions;
+	CurrentOptions = &o;
+}
+
+VRMConverter::OptionsScope::~OptionsScope() {
+	CurrentOptions = Prev;
+}
+
 USkeleton *VRMConverter::Options::GetSkeleton() {
 	if (ImportOption == nullptr) return nullptr;
 
@@ -527,8 +607,6 @@ bool VRMConverter::Options::IsUE5Material() const {
 	return ImportOption->bUseUE5Material;
 }
 
-static bool bbVRM0 = false;
-static bool bbVRM10 = false;
 void VRMConverter::Options::SetVRM0Model(bool bVRM) {
 	bbVRM0 = bVRM;
 	bbVRM10 = !bVRM;
@@ -601,7 +679,6 @@ bool VRMConverter::Options::IsVRMModel() const {
 	return IsVRM0Model() || IsVRM10Model();
 }
 
-static bool bbVRMA = false;
 void VRMConverter::Options::SetVRMAModel(bool bVRMA) {
 	bbVRMA = bVRMA;
 }
@@ -610,7 +687,6 @@ bool VRMConverter::Options::IsVRMAModel() const {
 	return bbVRMA;
 }
 
-static bool bbBVH = false;
 void VRMConverter::Options::SetBVHModel(bool bBVH) {
 	bbBVH = bBVH;
 }
@@ -619,7 +695,6 @@ bool VRMConverter::Options::IsBVHModel() const {
 	return bbBVH;
 }
 
-static bool bbPMX = false;
 void VRMConverter::Options::SetPMXModel(bool bVRM) {
 	bbPMX = bVRM;
 }
@@ -628,7 +703,6 @@ bool VRMConverter::Options::IsPMXModel() const {
 	return bbPMX;
 }
 
-static bool bbNoMesh = false;
 void VRMConverter::Options::SetNoMesh(bool bNoMesh) {
 	bbNoMesh = bNoMesh;
 }
@@ -741,9 +815,11 @@ UObject* VRM4U_StaticDuplicateObject(UObject const* SourceObject, UObject* DestO
 		DestOuter = VRM4U_CreatePackage(Cast<UPackage>(DestOuter), DestName);
 	}
 
-	return StaticDuplicateObject(SourceObject,
+	UObject* r = StaticDuplicateObject(SourceObject,
 		DestOuter, DestName,
 		FlagMask, DestClass, DuplicateMode, InternalFlagsMask);
+	VRMConverter::Options::Get().AddStandaloneObject(r);
+	return r;
 }
 
 
@@ -36,6 +36,20 @@ bool VRMConverter::Init(const uint8* pFileData, size_t dataSize, const aiScene *
 	return InitJSON(pFileData, dataSize);
 }
 
+bool VRMConverter::Init(const uint8* pFileData, size_t dataSize, const aiScene* pScene, VrmPreparedScene* pPrepared) {
+	if (pPrepared == nullptr) {
+		return Init(pFileData, dataSize, pScene);
+	}
+	aiData = pScene;
+	Prepared = pPrepared;
+	if (pPrepared->bJson) {
+		jsonData.Swap(pPrepared->jsonData);
+		pPrepared->bJson = false;
+		return true;
+	}
+	return InitJSON(pFileData, dataSize);
+}
+
 bool VRMConverter::InitJSON(const uint8* pFileData, size_t dataSize) {
 
 	// little endian
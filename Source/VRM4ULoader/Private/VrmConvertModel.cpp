@@ -185,7 +185,7 @@ static int GetChildBoneLocal(const USkeleton *skeleton, const int32 ParentBoneIn
 	return Children.Num();
 }
 
-static void FindMeshInfo(const aiScene* scene, aiNode* node, FReturnedData& result, UVrmAssetListObject *vrmAssetList)
+static void FindMeshInfo(const aiScene* scene, aiNode* node, FReturnedData& result)
 {
 	if (VRMConverter::Options::Get().IsDebugNoMesh()) {
 		return;
@@ -385,13 +385,13 @@ static void FindMeshInfo(const aiScene* scene, aiNode* node, FReturnedData& resu
 }
 
 
-static void FindMesh(const aiScene* scene, aiNode* node, FReturnedData& retdata, UVrmAssetListObject *vrmAssetList)
+static void FindMesh(const aiScene* scene, aiNode* node, FReturnedData& retdata)
 {
-	FindMeshInfo(scene, node, retdata, vrmAssetList);
+	FindMeshInfo(scene, node, retdata);
 
 	for (uint32 m = 0; m < node->mNumChildren; ++m)
 	{
-		FindMesh(scene, node->mChildren[m], retdata, vrmAssetList);
+		FindMesh(scene, node->mChildren[m], retdata);
 	}
 }
 
@@ -607,22 +607,38 @@ static void CreateSwingHead(UVrmAssetListObject *vrmAssetList, VRM::VRMSpring &s
 	}
 }
 
-bool VRMConverter::ConvertModel(UVrmAssetListObject *vrmAssetList) {
-	if (vrmAssetList == nullptr) {
-		return false;
-	}
+void VrmPreparedScene::MakeWeightTable(TMap<int, TArray<WeightData> >& out, const aiScene* scene) {
+	out.Reset();
+	int vertexOffset = 0;
+	for (uint32_t meshNo = 0; meshNo < scene->mNumMeshes; ++meshNo) {
+		auto* mesh = scene->mMeshes[meshNo];
+		for (uint32_t boneNo = 0; boneNo < mesh->mNumBones; ++boneNo) {
+			auto* bone = mesh->mBones[boneNo];
+			// same as NormalizeBoneName, it runs after Prepare
+			FString boneName = UTF8_TO_TCHAR(bone->mName.C_Str());
+			if (VRMConverter::Options::Get().IsForceOriginalBoneName() == false) {
+				boneName = VRMUtil::MakeName(boneName, true);
+			}
+			for (uint32_t weightNo = 0; weightNo < bone->mNumWeights; ++weightNo) {
+				auto weight = bone->mWeights[weightNo];
 
-	vrmAssetList->MeshReturnedData = MakeShareable(new FReturnedData());
-	FReturnedData &result = *(vrmAssetList->MeshReturnedData);
-	//FReturnedData &result = *(vrmAssetList->Result);
+				WeightData d;
+				d.boneName = boneName;
+				d.weight = weight.mWeight;
+				out.FindOrAdd(vertexOffset + weight.mVertexId).Add(d);
+			}
+		}
+		vertexOffset += mesh->mNumVertices;
+	}
+}
 
+void VrmPreparedScene::MakeMeshData(FReturnedData& result, const aiScene* aiData) {
 	result.bSuccess = false;
 	result.meshInfo.Empty();
 	result.NumMeshes = 0;
 
-	if (aiData == nullptr)
-	{
-		UE_LOG(LogVRM4ULoader, Warning, TEXT("test null.\n"));
+	if (aiData == nullptr) {
+		return;
 	}
 
 	if (aiData->HasMeshes() && VRMConverter::Options::Get().IsDebugNoMesh() == false)
@@ -631,7 +647,7 @@ bool VRMConverter::ConvertModel(UVrmAssetListObject *vrmAssetList) {
 		// !! before remove unused vertex !!
 		// remove degenerate triangles
 		//
-		if (Options::Get().IsRemoveDegenerateTriangles()) {
+		if (VRMConverter::Options::Get().IsRemoveDegenerateTriangles()) {
 			for (uint32 meshNo = 0; meshNo < aiData->mNumMeshes; ++meshNo)
 			{
 				//Triangle number
@@ -678,7 +694,7 @@ bool VRMConverter::ConvertModel(UVrmAssetListObject *vrmAssetList) {
 
 
 		// find and remove unused vertex
-		FindMesh(aiData, aiData->mRootNode, result, vrmAssetList);
+		FindMesh(aiData, aiData->mRootNode, result);
 
 		for (uint32 meshNo = 0; meshNo < aiData->mNumMeshes; ++meshNo)
 		{
@@ -708,6 +724,27 @@ bool VRMConverter::ConvertModel(UVrmAssetListObject *vrmAssetList) {
 		}
 		result.bSuccess = true;
 	}
+}
+
+bool VRMConverter::ConvertModel(UVrmAssetListObject *vrmAssetList) {
+	if (vrmAssetList == nullptr) {
+		return false;
+	}
+
+	if (aiData == nullptr)
+	{
+		UE_LOG(LogVRM4ULoader, Warning, TEXT("test null.\n"));
+	}
+
+	// gathered on the loader worker when prepared. the prepared scene is used for one conversion
+	if (Prepared && Prepared->MeshData.IsValid()) {
+		vrmAssetList->MeshReturnedData = Prepared->MeshData;
+	} else {
+		vrmAssetList->MeshReturnedData = MakeShareable(new FReturnedData());
+		VrmPreparedScene::MakeMeshData(*vrmAssetList->MeshReturnedData, aiData);
+	}
+	FReturnedData &result = *(vrmAssetList->MeshReturnedData);
+	//FReturnedData &result = *(vrmAssetList->Result);
 
 	bool bReimportMode = false;
 
@@ -1052,31 +1089,15 @@ bool VRMConverter::ConvertModel(UVrmAssetListObject *vrmAssetList) {
 			}
 			else {
 				auto& info = vrmAssetList->MeshReturnedData->meshInfo;
-				struct WeightData {
-					FString boneName;
-					float weight = 0;
-				};
-				TMap<int, TArray<WeightData> > weightTable;
+				TMap<int, TArray<VrmPreparedScene::WeightData> > localWeightTable;
 				auto* scene = const_cast<aiScene*>(aiData);
 
-				// generate weightTable
+				// generate weightTable. built on the loader worker when prepared
+				if (Prepared == nullptr || Prepared->bWeightTable == false) {
+					VrmPreparedScene::MakeWeightTable(localWeightTable, scene);
+				}
+				const auto& weightTable = (Prepared && Prepared->bWeightTable) ? Prepared->WeightTable : localWeightTable;
 				{
-					int vertexOffset = 0;
-					for (uint32_t meshNo = 0; meshNo < scene->mNumMeshes; ++meshNo) {
-						auto* mesh = scene->mMeshes[meshNo];
-						for (uint32_t boneNo = 0; boneNo < mesh->mNumBones; ++boneNo) {
-							auto* bone = mesh->mBones[boneNo];
-							for (uint32_t weightNo = 0; weightNo < bone->mNumWeights; ++weightNo) {
-								auto weight = bone->mWeights[weightNo];
-
-								WeightData d;
-								d.boneName = UTF8_TO_TCHAR(bone->mName.C_Str());
-								d.weight = weight.mWeight;
-								weightTable.FindOrAdd(vertexOffset + weight.mVertexId).Add(d);
-							}
-						}
-						vertexOffset += mesh->mNumVertices;
-					}
 					// weight check
 					for (auto w : weightTable) {
 						float f = 0.f;
@@ -127,21 +127,47 @@ namespace {
 
 }
 
-static bool readMorph2(TArray<FMorphTargetDelta> &MorphDeltas, aiString targetName,const aiScene *aiData, const UVrmAssetListObject *assetList) {
+void VrmPreparedScene::MakeMorphSource(MorphSource& out, const aiMesh& aiM, const aiAnimMesh& aiA, bool bVRM10, bool bIncludeNormal) {
+	out.PositionDelta.Reset();
+	out.NormalDelta.Reset();
+
+	const uint32_t num = FMath::Min(aiM.mNumVertices, aiA.mNumVertices);
+
+	if (aiA.mVertices) {
+		out.PositionDelta.SetNumUninitialized(num);
+		for (uint32_t i = 0; i < num; ++i) {
+			auto aiV = aiA.mVertices[i] - aiM.mVertices[i];
+			if (bVRM10) {
+				out.PositionDelta[i].Set(aiV[0] * 100.f, -aiV[2] * 100.f, aiV[1] * 100.f);
+			} else {
+				out.PositionDelta[i].Set(-aiV[0] * 100.f, aiV[2] * 100.f, aiV[1] * 100.f);
+			}
+		}
+	}
+
+	if (bIncludeNormal) {
+		out.NormalDelta.SetNumZeroed(num);
+		for (uint32_t i = 0; i < num; ++i) {
+			auto aiV = aiA.mNormals[i] - aiM.mNormals[i];
+
+			// same for VRM10. its axis flip is undone on X and Y
+			FVector n(-aiV[0], aiV[2], aiV[1]);
+			if (n.Size() > 1.f) {
+				out.NormalDelta[i] = n.GetUnsafeNormal();
+			}
+		}
+	}
+}
+
+static bool readMorph2(TArray<FMorphTargetDelta> &MorphDeltas, aiString targetName,const aiScene *aiData, const UVrmAssetListObject *assetList, const VrmPreparedScene *prepared) {
 
 	MorphDeltas.Reset(0);
 	uint32_t currentVertex = 0;
 
-	FMorphTargetDelta morphinit;
-#if	UE_VERSION_OLDER_THAN(5,0,0)
-	morphinit.PositionDelta = FVector::ZeroVector;
-	morphinit.SourceIdx = 0;
-	morphinit.TangentZDelta = FVector::ZeroVector;
-#else
-	morphinit.PositionDelta = FVector3f::ZeroVector;
-	morphinit.SourceIdx = 0;
-	morphinit.TangentZDelta = FVector3f::ZeroVector;
-#endif
+	const bool bIncludeNormal = VRMConverter::Options::Get().IsEnableMorphTargetNormal();
+	const float ModelScale = VRMConverter::Options::Get().GetModelScale();
+
+	VrmPreparedScene::MorphSource localSource;
 
 	for (uint32_t m = 0; m < aiData->mNumMeshes; ++m) {
 		const auto &mesh = assetList->MeshReturnedData->meshInfo[m];
@@ -158,11 +184,16 @@ static bool readMorph2(TArray<FMorphTargetDelta> &MorphDeltas, aiString targetNa
 				UE_LOG(LogVRM4ULoader, Warning, TEXT("test18.\n"));
 			}
 
+			// axis conversion is done on the loader worker when prepared
+			const VrmPreparedScene::MorphSource* src = prepared ? prepared->FindMorph(m, a) : nullptr;
+			if (src == nullptr || (bIncludeNormal && src->NormalDelta.Num() == 0)) {
+				VrmPreparedScene::MakeMorphSource(localSource, aiM, aiA, VRMConverter::Options::Get().IsVRM10Model(), bIncludeNormal);
+				src = &localSource;
+			}
+
 			TArray<FMorphTargetDelta> tmpData;
 			tmpData.Reserve(aiA.mNumVertices);
 
-			bool bIncludeNormal = VRMConverter::Options::Get().IsEnableMorphTargetNormal();
-
 			int VertexCount = 0;
 
 			for (uint32_t i = 0; i < aiA.mNumVertices; ++i) {
@@ -181,62 +212,18 @@ static bool readMorph2(TArray<FMorphTargetDelta> &MorphDeltas, aiString targetNa
 				v.SourceIdx = VertexCount + currentVertex;
 				++VertexCount;
 
-				if (aiA.mVertices) {
-
-					auto aiV = aiA.mVertices[i] - aiM.mVertices[i];
-
-					v.PositionDelta.Set(
-						-aiV[0] * 100.f,
-						aiV[2] * 100.f,
-						aiV[1] * 100.f
-					);
-
-					if (VRMConverter::Options::Get().IsVRM10Model()) {
-						v.PositionDelta.Set(
-							aiV[0] * 100.f,
-							-aiV[2] * 100.f,
-							aiV[1] * 100.f
-						);
-					}
-
+				if (src->PositionDelta.IsValidIndex(i)) {
 					// apply original root bone rotation
-					FVector tmp;
-					tmp.Set(v.PositionDelta.X, v.PositionDelta.Y, v.PositionDelta.Z);
-					tmp = assetList->model_root_transform.TransformVector(tmp);
+					FVector tmp = assetList->model_root_transform.TransformVector(src->PositionDelta[i]);
 					v.PositionDelta.Set(tmp.X, tmp.Y, tmp.Z);
 				}
 
-				v.PositionDelta *= VRMConverter::Options::Get().GetModelScale();
-
-
-				if (bIncludeNormal) {
+				v.PositionDelta *= ModelScale;
 
-					auto aiV = aiA.mNormals[i] - aiM.mNormals[i];
 
-#if	UE_VERSION_OLDER_THAN(5,0,0)
-					FVector n(
-#else
-					FVector3f n(
-#endif
-						-aiV[0],
-						aiV[2],
-						aiV[1]);
-
-					if (VRMConverter::Options::Get().IsVRM10Model()) {
-						n.Set(
-							aiV[0],
-							-aiV[2],
-							aiV[1]);
-					}
-
-					if (n.Size() > 1.f) {
-						v.TangentZDelta = n.GetUnsafeNormal();
-					}
-
-					if (VRMConverter::Options::Get().IsVRM10Model()) {
-						v.TangentZDelta.X *= -1.f;
-						v.TangentZDelta.Y *= -1.f;
-					}
+				if (bIncludeNormal && src->NormalDelta.IsValidIndex(i)) {
+					const FVector& n = src->NormalDelta[i];
+					v.TangentZDelta.Set(n.X, n.Y, n.Z);
 				}
 
 				// skip invalid vertex data
@@ -327,7 +314,7 @@ bool VRMConverter::ConvertMorphTarget(UVrmAssetListObject *vrmAssetList) {
 
 			MorphNameList.AddUnique(morphName);
 			MorphNameList_Strict.AddUnique(morphNameOrg);
-			if (readMorph2(MorphDeltas, aiA.mName, aiData, vrmAssetList) == false) {
+			if (readMorph2(MorphDeltas, aiA.mName, aiData, vrmAssetList, Prepared) == false) {
 				continue;
 			}
 
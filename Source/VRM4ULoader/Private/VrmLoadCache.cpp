@@ -0,0 +1,1076 @@
+// VRM4U Copyright (c) 2021-2024 Haruyoshi Yamamoto. This software is released under the MIT License.
+
+#include "VrmLoadCache.h"
+#include "VRM4ULoaderLog.h"
+#include "VrmConvert.h"
+#include "LoaderBPFunctionLibrary.h"
+
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/Compression.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Misc/SecureHash.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "Interfaces/IPluginManager.h"
+
+#include <assimp/scene.h>
+#include <assimp/mesh.h>
+#include <assimp/material.h>
+#include <assimp/texture.h>
+#include <assimp/anim.h>
+#include <assimp/vrm/vrmmeta.h>
+
+#if	UE_VERSION_OLDER_THAN(4,23,0)
+#define TRACE_CPUPROFILER_EVENT_SCOPE(a)
+#else
+#endif
+
+namespace {
+	TAutoConsoleVariable<int32> CVarLoadCacheEnable(
+		TEXT("vrm4u.LoadCache.Enable"),
+		0,
+		TEXT("Cache the parsed scene, the mesh and morph data and the decoded textures of LoadVRMFileAsync in Saved/VRM4U/LoadCache, keyed by file hash, import options and plugin version."));
+
+	TAutoConsoleVariable<int32> CVarLoadCacheMaxMB(
+		TEXT("vrm4u.LoadCache.MaxMB"),
+		1024,
+		TEXT("Size cap of Saved/VRM4U/LoadCache in MB. least recently used files are deleted after a save. 0 is no limit."));
+
+	// bump when the file layout changes
+	const uint32 CacheMagic = 0x434d5256; // VRMC
+	const int32 CacheFormatVersion = 2;
+
+	FString GetCacheDir() {
+		return FPaths::ProjectSavedDir() / TEXT("VRM4U/LoadCache");
+	}
+
+	FString GetCachePath(const FString& Key) {
+		return GetCacheDir() / Key + TEXT(".vrmcache");
+	}
+
+	// any thread. a load hit refreshes the time stamp, so the oldest one is the least recently used
+	void TrimCacheDir(const FString& KeepPath) {
+		TRACE_CPUPROFILER_EVENT_SCOPE(TEXT("VRMLoadCache Trim"))
+
+		const int64 MaxBytes = (int64)CVarLoadCacheMaxMB.GetValueOnAnyThread() * 1024 * 1024;
+		if (MaxBytes <= 0) {
+			return;
+		}
+
+		struct FCacheFile {
+			FString Path;
+			FDateTime Time;
+			int64 Size = 0;
+		};
+		TArray<FCacheFile> Files;
+		int64 Total = 0;
+		IFileManager::Get().IterateDirectoryStat(*GetCacheDir(), [&](const TCHAR* Name, const FFileStatData& Stat) {
+			// not the .tmp files of a save running now
+			if (Stat.bIsDirectory == false && FString(Name).EndsWith(TEXT(".vrmcache"))) {
+				Files.Add({ FString(Name), Stat.ModificationTime, Stat.FileSize });
+				Total += Stat.FileSize;
+			}
+			return true;
+		});
+		if (Total <= MaxBytes) {
+			return;
+		}
+
+		Files.Sort([](const FCacheFile& a, const FCacheFile& b) {
+			return a.Time < b.Time;
+		});
+		const FString KeepName = FPaths::GetCleanFilename(KeepPath);
+		for (const auto& f : Files) {
+			if (Total <= MaxBytes) {
+				break;
+			}
+			if (FPaths::GetCleanFilename(f.Path) == KeepName) {
+				continue;
+			}
+			// may be gone already when another load trims at the same time
+			if (IFileManager::Get().Delete(*f.Path, false, false, true)) {
+				Total -= f.Size;
+				UE_LOG(LogVRM4ULoader, Log, TEXT("VRM4U LoadCache: evicted %s (%lld bytes)"), *f.Path, f.Size);
+			}
+		}
+	}
+
+	FAutoConsoleCommand CmdLoadCacheClear(
+		TEXT("vrm4u.LoadCache.Clear"),
+		TEXT("Delete all files in Saved/VRM4U/LoadCache."),
+		FConsoleCommandDelegate::CreateLambda([]() {
+			IFileManager::Get().DeleteDirectory(*GetCacheDir(), false, true);
+			UE_LOG(LogVRM4ULoader, Log, TEXT("VRM4U LoadCache: cleared %s"), *GetCacheDir());
+		})
+	);
+
+	// LZ4. stored as it is before 4.22
+	bool CompressBlock(TArray<uint8>& Out, const uint8* Src, int32 Size) {
+#if	UE_VERSION_OLDER_THAN(4,22,0)
+		Out.SetNumUninitialized(Size);
+		FMemory::Memcpy(Out.GetData(), Src, Size);
+		return true;
+#else
+		int32 CompressedSize = FCompression::CompressMemoryBound(NAME_LZ4, Size);
+		Out.SetNumUninitialized(CompressedSize);
+		if (FCompression::CompressMemory(NAME_LZ4, Out.GetData(), CompressedSize, Src, Size) == false) {
+			return false;
+		}
+		Out.SetNum(CompressedSize, false);
+		return true;
+#endif
+	}
+
+	bool UncompressBlock(uint8* Dst, int32 DstSize, const uint8* Src, int32 SrcSize) {
+#if	UE_VERSION_OLDER_THAN(4,22,0)
+		if (SrcSize != DstSize) {
+			return false;
+		}
+		FMemory::Memcpy(Dst, Src, SrcSize);
+		return true;
+#else
+		return FCompression::UncompressMemory(NAME_LZ4, Dst, DstSize, Src, SrcSize);
+#endif
+	}
+
+	void WriteImages(FArchive& Ar, const TArray<VRMUtil::FImportImage>& Image) {
+		int32 Num = Image.Num();
+		Ar << Num;
+
+		TArray<uint8> Compressed;
+		for (const auto& img : Image) {
+			int32 SizeX = img.SizeX;
+			int32 SizeY = img.SizeY;
+			int32 CompressedSize = 0;
+
+			if (img.RawData.Num() == 0 || img.Format != TSF_BGRA8 || img.RawData.Num() > MAX_int32
+				|| CompressBlock(Compressed, img.RawData.GetData(), (int32)img.RawData.Num()) == false) {
+				// decode failed. the texture loop decodes it again
+				SizeX = SizeY = 0;
+				Ar << SizeX << SizeY << CompressedSize;
+				continue;
+			}
+			CompressedSize = Compressed.Num();
+			Ar << SizeX << SizeY << CompressedSize;
+			Ar.Serialize(Compressed.GetData(), CompressedSize);
+		}
+	}
+
+	bool ReadImages(FArchive& Ar, const TArray<uint8>& Data, TArray<VRMUtil::FImportImage>& OutImage) {
+		int32 Num = 0;
+		Ar << Num;
+		if (Ar.IsError() || Num < 0) {
+			return false;
+		}
+
+		OutImage.SetNum(Num);
+		for (auto& img : OutImage) {
+			int32 SizeX = 0;
+			int32 SizeY = 0;
+			int32 CompressedSize = 0;
+			Ar << SizeX << SizeY << CompressedSize;
+			if (Ar.IsError() || SizeX < 0 || SizeY < 0 || CompressedSize < 0 || Ar.Tell() + CompressedSize > Ar.TotalSize()) {
+				return false;
+			}
+			if (SizeX == 0 || SizeY == 0) {
+				Ar.Seek(Ar.Tell() + CompressedSize);
+				continue;
+			}
+
+			img.Init2DWithOneMip(SizeX, SizeY, TSF_BGRA8);
+			if (UncompressBlock(img.RawData.GetData(), (int32)img.RawData.Num(), Data.GetData() + Ar.Tell(), CompressedSize) == false) {
+				return false;
+			}
+			Ar.Seek(Ar.Tell() + CompressedSize);
+		}
+		return true;
+	}
+
+	// the scene of a hit is allocated here and freed by FreeScene, never by the destructors of assimp.
+	// they may run in the assimp dll with another heap. aiScene, aiNode and aiMaterial are made by new,
+	// FreeScene empties them before delete
+	template<typename T>
+	T* AllocArray(int64 Num) {
+		if (Num <= 0) {
+			return nullptr;
+		}
+		T* p = (T*)FMemory::Malloc(sizeof(T) * Num, alignof(T));
+		for (int64 i = 0; i < Num; ++i) {
+			new(&p[i]) T();
+		}
+		return p;
+	}
+
+	template<typename T>
+	void FreeArray(T*& p) {
+		FMemory::Free(p);
+		p = nullptr;
+	}
+
+	// same layout in both ways. the cache is for this build only, so the pod is copied as it is.
+	// a broken file only stops the read, FreeScene frees the half built scene
+	struct FCacheArchive {
+		FArchive& Ar;
+		bool bError = false;
+
+		// for aiBone::mArmature and mNode
+		TArray<aiNode*> Nodes;
+		TMap<const aiNode*, int32> NodeIndex;
+
+		FCacheArchive(FArchive& InAr) : Ar(InAr) {}
+
+		bool IsError() const {
+			return bError || Ar.IsError();
+		}
+
+		// false when the rest of the file cannot hold Num elements
+		bool CheckNum(int64 Num, int64 ElementSize) {
+			if (Ar.IsLoading() && (Num < 0 || Num * ElementSize > Ar.TotalSize() - Ar.Tell())) {
+				bError = true;
+			}
+			return IsError() == false;
+		}
+
+		int32 FindNode(const aiNode* n) const {
+			const int32* i = NodeIndex.Find(n);
+			return i ? *i : INDEX_NONE;
+		}
+		aiNode* GetNode(int32 i) const {
+			return Nodes.IsValidIndex(i) ? Nodes[i] : nullptr;
+		}
+	};
+
+	template<typename T>
+	void SerializeValue(FCacheArchive& S, T& v) {
+		S.Ar.Serialize(&v, sizeof(T));
+	}
+
+	void SerializeString(FCacheArchive& S, aiString& s) {
+		uint32 Len = s.length;
+		SerializeValue(S, Len);
+		if (S.Ar.IsLoading()) {
+			if (Len >= MAXLEN || S.CheckNum(Len, 1) == false) {
+				S.bError = true;
+				return;
+			}
+			s.length = Len;
+			s.data[Len] = '\0';
+		}
+		S.Ar.Serialize(s.data, Len);
+	}
+
+	// Num elements or nullptr
+	template<typename T>
+	void SerializeArray(FCacheArchive& S, T*& p, int64 Num) {
+		bool bHas = (p != nullptr);
+		SerializeValue(S, bHas);
+		if (bHas == false || S.IsError()) {
+			return;
+		}
+		if (S.Ar.IsLoading()) {
+			if (S.CheckNum(Num, sizeof(T)) == false) {
+				return;
+			}
+			p = AllocArray<T>(Num);
+		}
+		S.Ar.Serialize(p, sizeof(T) * Num);
+	}
+
+	template<typename T>
+	void SerializeTArray(FCacheArchive& S, TArray<T>& a) {
+		int32 Num = a.Num();
+		SerializeValue(S, Num);
+		if (S.Ar.IsLoading()) {
+			if (S.CheckNum(Num, sizeof(T)) == false) {
+				return;
+			}
+			a.SetNumUninitialized(Num);
+		}
+		S.Ar.Serialize(a.GetData(), (int64)sizeof(T) * Num);
+	}
+
+	// Num elements made by AllocArray. Func serializes one
+	template<typename T, typename F>
+	void SerializeObjectArray(FCacheArchive& S, T*& p, uint32& Num, F Func) {
+		SerializeValue(S, Num);
+		if (S.Ar.IsLoading()) {
+			if (S.CheckNum(Num, sizeof(uint32)) == false) {
+				Num = 0;
+				return;
+			}
+			p = AllocArray<T>(Num);
+		}
+		for (uint32 i = 0; i < Num && S.IsError() == false; ++i) {
+			Func(S, p[i]);
+		}
+	}
+
+	// Num pointers, each element made by AllocArray. Func serializes one
+	template<typename T, typename F>
+	void SerializePtrArray(FCacheArchive& S, T**& p, uint32& Num, F Func) {
+		SerializeValue(S, Num);
+		if (S.Ar.IsLoading()) {
+			if (S.CheckNum(Num, sizeof(uint32)) == false) {
+				Num = 0;
+				return;
+			}
+			p = AllocArray<T*>(Num);
+		}
+		for (uint32 i = 0; i < Num && S.IsError() == false; ++i) {
+			if (S.Ar.IsLoading()) {
+				p[i] = AllocArray<T>(1);
+			}
+			Func(S, *p[i]);
+		}
+	}
+
+	void SerializeNode(FCacheArchive& S, aiNode*& n, aiNode* Parent) {
+		if (S.Ar.IsLoading()) {
+			n = new aiNode();
+			n->mParent = Parent;
+		}
+		S.NodeIndex.Add(n, S.Nodes.Add(n));
+
+		SerializeString(S, n->mName);
+		SerializeValue(S, n->mTransformation);
+
+		SerializeValue(S, n->mNumMeshes);
+		if (S.Ar.IsLoading()) {
+			if (S.CheckNum(n->mNumMeshes, sizeof(unsigned int)) == false) {
+				n->mNumMeshes = 0;
+				return;
+			}
+			n->mMeshes = AllocArray<unsigned int>(n->mNumMeshes);
+		}
+		S.Ar.Serialize(n->mMeshes, sizeof(unsigned int) * n->mNumMeshes);
+
+		SerializeValue(S, n->mNumChildren);
+		if (S.Ar.IsLoading()) {
+			if (S.CheckNum(n->mNumChildren, sizeof(uint32)) == false) {
+				n->mNumChildren = 0;
+				return;
+			}
+			n->mChildren = AllocArray<aiNode*>(n->mNumChildren);
+		}
+		for (uint32 c = 0; c < n->mNumChildren && S.IsError() == false; ++c) {
+			SerializeNode(S, n->mChildren[c], n);
+		}
+	}
+
+	void SerializeBone(FCacheArchive& S, aiBone& b) {
+		SerializeString(S, b.mName);
+		SerializeValue(S, b.mNumWeights);
+		SerializeArray(S, b.mWeights, b.mNumWeights);
+		SerializeValue(S, b.mOffsetMatrix);
+
+		// set by aiProcess_PopulateArmatureData. the nodes are read before the meshes
+		int32 Armature = S.FindNode(b.mArmature);
+		int32 Node = S.FindNode(b.mNode);
+		SerializeValue(S, Armature);
+		SerializeValue(S, Node);
+		if (S.Ar.IsLoading()) {
+			b.mArmature = S.GetNode(Armature);
+			b.mNode = S.GetNode(Node);
+		}
+	}
+
+	void SerializeAnimMesh(FCacheArchive& S, aiAnimMesh& a) {
+		SerializeString(S, a.mName);
+		SerializeValue(S, a.mNumVertices);
+		SerializeValue(S, a.mWeight);
+		SerializeArray(S, a.mVertices, a.mNumVertices);
+		SerializeArray(S, a.mNormals, a.mNumVertices);
+		SerializeArray(S, a.mTangents, a.mNumVertices);
+		SerializeArray(S, a.mBitangents, a.mNumVertices);
+		for (auto& c : a.mColors) {
+			SerializeArray(S, c, a.mNumVertices);
+		}
+		for (auto& t : a.mTextureCoords) {
+			SerializeArray(S, t, a.mNumVertices);
+		}
+	}
+
+	void SerializeFace(FCacheArchive& S, aiFace& f) {
+		SerializeValue(S, f.mNumIndices);
+		if (S.Ar.IsLoading()) {
+			if (S.CheckNum(f.mNumIndices, sizeof(unsigned int)) == false) {
+				f.mNumIndices = 0;
+				return;
+			}
+			f.mIndices = AllocArray<unsigned int>(f.mNumIndices);
+		}
+		S.Ar.Serialize(f.mIndices, sizeof(unsigned int) * f.mNumIndices);
+	}
+
+	void SerializeMesh(FCacheArchive& S, aiMesh& m) {
+		SerializeString(S, m.mName);
+		SerializeValue(S, m.mPrimitiveTypes);
+		SerializeValue(S, m.mNumVertices);
+		SerializeValue(S, m.mMaterialIndex);
+		SerializeValue(S, m.mMethod);
+		SerializeValue(S, m.mAABB);
+
+		SerializeArray(S, m.mVertices, m.mNumVertices);
+		SerializeArray(S, m.mNormals, m.mNumVertices);
+		SerializeArray(S, m.mTangents, m.mNumVertices);
+		SerializeArray(S, m.mBitangents, m.mNumVertices);
+		for (auto& c : m.mColors) {
+			SerializeArray(S, c, m.mNumVertices);
+		}
+		for (int i = 0; i < AI_MAX_NUMBER_OF_TEXTURECOORDS; ++i) {
+			SerializeValue(S, m.mNumUVComponents[i]);
+			SerializeArray(S, m.mTextureCoords[i], m.mNumVertices);
+		}
+
+		SerializeObjectArray(S, m.mFaces, m.mNumFaces, SerializeFace);
+		SerializePtrArray(S, m.mBones, m.mNumBones, SerializeBone);
+		SerializePtrArray(S, m.mAnimMeshes, m.mNumAnimMeshes, SerializeAnimMesh);
+	}
+
+	void SerializeMaterial(FCacheArchive& S, aiMaterial& m) {
+		uint32 Num = m.mNumProperties;
+		SerializeValue(S, Num);
+		if (S.CheckNum(Num, sizeof(uint32)) == false) {
+			return;
+		}
+		for (uint32 i = 0; i < Num && S.IsError() == false; ++i) {
+			if (S.Ar.IsLoading()) {
+				aiString Key;
+				uint32 Semantic = 0;
+				uint32 Index = 0;
+				aiPropertyTypeInfo Type = aiPTI_Buffer;
+				TArray<uint8> Data;
+				SerializeString(S, Key);
+				SerializeValue(S, Semantic);
+				SerializeValue(S, Index);
+				SerializeValue(S, Type);
+				SerializeTArray(S, Data);
+				if (S.IsError() == false) {
+					m.AddBinaryProperty(Data.GetData(), Data.Num(), Key.C_Str(), Semantic, Index, Type);
+				}
+			} else {
+				// same layout as SerializeTArray
+				auto& p = *m.mProperties[i];
+				int32 Length = p.mDataLength;
+				SerializeString(S, p.mKey);
+				SerializeValue(S, p.mSemantic);
+				SerializeValue(S, p.mIndex);
+				SerializeValue(S, p.mType);
+				SerializeValue(S, Length);
+				S.Ar.Serialize(p.mData, Length);
+			}
+		}
+	}
+
+	void SerializeTexture(FCacheArchive& S, aiTexture& t) {
+		SerializeValue(S, t.mWidth);
+		SerializeValue(S, t.mHeight);
+		S.Ar.Serialize(t.achFormatHint, sizeof(t.achFormatHint));
+		SerializeString(S, t.mFilename);
+
+		// mHeight 0 is a compressed file of mWidth bytes
+		const int64 Bytes = (t.mHeight == 0) ? (int64)t.mWidth : (int64)t.mWidth * t.mHeight * sizeof(aiTexel);
+		bool bHas = (t.pcData != nullptr);
+		SerializeValue(S, bHas);
+		if (bHas == false) {
+			return;
+		}
+		if (S.Ar.IsLoading()) {
+			if (S.CheckNum(Bytes, 1) == false) {
+				return;
+			}
+			t.pcData = AllocArray<aiTexel>((Bytes + sizeof(aiTexel) - 1) / sizeof(aiTexel));
+		}
+		S.Ar.Serialize(t.pcData, Bytes);
+	}
+
+	void SerializeNodeAnim(FCacheArchive& S, aiNodeAnim& a) {
+		SerializeString(S, a.mNodeName);
+		SerializeValue(S, a.mNumPositionKeys);
+		SerializeArray(S, a.mPositionKeys, a.mNumPositionKeys);
+		SerializeValue(S, a.mNumRotationKeys);
+		SerializeArray(S, a.mRotationKeys, a.mNumRotationKeys);
+		SerializeValue(S, a.mNumScalingKeys);
+		SerializeArray(S, a.mScalingKeys, a.mNumScalingKeys);
+		SerializeValue(S, a.mPreState);
+		SerializeValue(S, a.mPostState);
+	}
+
+	void SerializeMeshAnim(FCacheArchive& S, aiMeshAnim& a) {
+		SerializeString(S, a.mName);
+		SerializeValue(S, a.mNumKeys);
+		SerializeArray(S, a.mKeys, a.mNumKeys);
+	}
+
+	void SerializeMorphKey(FCacheArchive& S, aiMeshMorphKey& k) {
+		SerializeValue(S, k.mTime);
+		SerializeValue(S, k.mNumValuesAndWeights);
+		SerializeArray(S, k.mValues, k.mNumValuesAndWeights);
+		SerializeArray(S, k.mWeights, k.mNumValuesAndWeights);
+	}
+
+	void SerializeMorphAnim(FCacheArchive& S, aiMeshMorphAnim& a) {
+		SerializeString(S, a.mName);
+		SerializeObjectArray(S, a.mKeys, a.mNumKeys, SerializeMorphKey);
+	}
+
+	void SerializeAnimation(FCacheArchive& S, aiAnimation& a) {
+		SerializeString(S, a.mName);
+		SerializeValue(S, a.mDuration);
+		SerializeValue(S, a.mTicksPerSecond);
+		SerializePtrArray(S, a.mChannels, a.mNumChannels, SerializeNodeAnim);
+		SerializePtrArray(S, a.mMeshChannels, a.mNumMeshChannels, SerializeMeshAnim);
+		SerializePtrArray(S, a.mMorphMeshChannels, a.mNumMorphMeshChannels, SerializeMorphAnim);
+	}
+
+	// the VRM meta is pack(1). a struct is copied as it is, then the pointers in it are written again.
+	// no reference to a member, it may be unaligned
+	template<typename T, typename F>
+	T* SerializeMetaArray(FCacheArchive& S, T* p, int32 Num, F Func) {
+		bool bHas = (p != nullptr);
+		SerializeValue(S, bHas);
+		if (bHas == false || S.IsError()) {
+			return p;
+		}
+		if (S.Ar.IsLoading()) {
+			if (S.CheckNum(Num, sizeof(T)) == false) {
+				return nullptr;
+			}
+			p = AllocArray<T>(Num);
+		}
+		for (int32 i = 0; i < Num && S.IsError() == false; ++i) {
+			S.Ar.Serialize(&p[i], sizeof(T));
+			Func(p[i]);
+		}
+		return p;
+	}
+
+	void SerializeMeta(FCacheArchive& S, VRM::VRMMetadata& m) {
+		const bool bLoading = S.Ar.IsLoading();
+		auto NoPointer = [](auto&) {};
+
+		S.Ar.Serialize(&m, sizeof(m));
+		if (bLoading) {
+			m.license.licensePair = nullptr;
+			m.springs = nullptr;
+			m.colliderGroups = nullptr;
+			m.blendShapeGroup = nullptr;
+			m.material = nullptr;
+		}
+
+		m.license.licensePair = SerializeMetaArray(S, m.license.licensePair, m.license.licensePairNum, NoPointer);
+		m.springs = SerializeMetaArray(S, m.springs, m.springNum, [&](VRM::VRMSpring& s) {
+			if (bLoading) {
+				s.bones = nullptr;
+				s.bones_name = nullptr;
+				s.colliderGroups = nullptr;
+			}
+			s.bones = SerializeMetaArray(S, s.bones, s.boneNum, NoPointer);
+			s.bones_name = SerializeMetaArray(S, s.bones_name, s.boneNum, NoPointer);
+			s.colliderGroups = SerializeMetaArray(S, s.colliderGroups, s.colliderGourpNum, NoPointer);
+		});
+		m.colliderGroups = SerializeMetaArray(S, m.colliderGroups, m.colliderGroupNum, [&](VRM::VRMColliderGroup& g) {
+			if (bLoading) {
+				g.colliders = nullptr;
+			}
+			g.colliders = SerializeMetaArray(S, g.colliders, g.colliderNum, NoPointer);
+		});
+		m.blendShapeGroup = SerializeMetaArray(S, m.blendShapeGroup, m.blendShapeGroupNum, [&](VRM::VRMBlendShapeGroup& g) {
+			if (bLoading) {
+				g.bind = nullptr;
+			}
+			g.bind = SerializeMetaArray(S, g.bind, g.bindNum, NoPointer);
+		});
+		m.material = SerializeMetaArray(S, m.material, m.materialNum, NoPointer);
+	}
+
+	void FreeMeta(VRM::VRMMetadata* m) {
+		if (m == nullptr) {
+			return;
+		}
+		FMemory::Free(m->license.licensePair);
+		if (auto* p = m->springs) {
+			for (int i = 0; i < m->springNum; ++i) {
+				FMemory::Free(p[i].bones);
+				FMemory::Free(p[i].bones_name);
+				FMemory::Free(p[i].colliderGroups);
+			}
+			FMemory::Free(p);
+		}
+		if (auto* p = m->colliderGroups) {
+			for (int i = 0; i < m->colliderGroupNum; ++i) {
+				FMemory::Free(p[i].colliders);
+			}
+			FMemory::Free(p);
+		}
+		if (auto* p = m->blendShapeGroup) {
+			for (int i = 0; i < m->blendShapeGroupNum; ++i) {
+				FMemory::Free(p[i].bind);
+			}
+			FMemory::Free(p);
+		}
+		FMemory::Free(m->material);
+		FMemory::Free(m);
+	}
+
+	void SerializeScene(FCacheArchive& S, aiScene& Scene) {
+		SerializeValue(S, Scene.mFlags);
+		SerializeString(S, Scene.mName);
+
+		bool bRoot = (Scene.mRootNode != nullptr);
+		SerializeValue(S, bRoot);
+		if (bRoot) {
+			SerializeNode(S, Scene.mRootNode, nullptr);
+		}
+		SerializePtrArray(S, Scene.mMeshes, Scene.mNumMeshes, SerializeMesh);
+
+		SerializeValue(S, Scene.mNumMaterials);
+		if (S.Ar.IsLoading()) {
+			if (S.CheckNum(Scene.mNumMaterials, sizeof(uint32)) == false) {
+				Scene.mNumMaterials = 0;
+				return;
+			}
+			Scene.mMaterials = AllocArray<aiMaterial*>(Scene.mNumMaterials);
+		}
+		for (uint32 i = 0; i < Scene.mNumMaterials && S.IsError() == false; ++i) {
+			if (S.Ar.IsLoading()) {
+				Scene.mMaterials[i] = new aiMaterial();
+			}
+			SerializeMaterial(S, *Scene.mMaterials[i]);
+		}
+
+		SerializePtrArray(S, Scene.mTextures, Scene.mNumTextures, SerializeTexture);
+		SerializePtrArray(S, Scene.mAnimations, Scene.mNumAnimations, SerializeAnimation);
+
+		bool bMeta = (Scene.mVRMMeta != nullptr);
+		SerializeValue(S, bMeta);
+		if (bMeta && S.IsError() == false) {
+			if (S.Ar.IsLoading()) {
+				Scene.mVRMMeta = AllocArray<VRM::VRMMetadata>(1);
+			}
+			SerializeMeta(S, *static_cast<VRM::VRMMetadata*>(Scene.mVRMMeta));
+		}
+	}
+
+	void SerializeWeight(FCacheArchive& S, TArray<VrmPreparedScene::WeightData>& a) {
+		int32 Num = a.Num();
+		SerializeValue(S, Num);
+		if (S.Ar.IsLoading()) {
+			if (S.CheckNum(Num, sizeof(float)) == false) {
+				return;
+			}
+			a.SetNum(Num);
+		}
+		for (auto& d : a) {
+			S.Ar << d.boneName;
+			SerializeValue(S, d.weight);
+		}
+	}
+
+	void SerializePrepared(FCacheArchive& S, VrmPreparedScene& p) {
+		int32 MeshNum = p.Morph.Num();
+		SerializeValue(S, MeshNum);
+		if (S.Ar.IsLoading()) {
+			if (S.CheckNum(MeshNum, sizeof(int32)) == false) {
+				return;
+			}
+			p.Morph.SetNum(MeshNum);
+		}
+		for (auto& m : p.Morph) {
+			int32 AnimNum = m.Num();
+			SerializeValue(S, AnimNum);
+			if (S.Ar.IsLoading()) {
+				if (S.CheckNum(AnimNum, sizeof(int32)) == false) {
+					return;
+				}
+				m.SetNum(AnimNum);
+			}
+			for (auto& a : m) {
+				SerializeTArray(S, a.PositionDelta);
+				SerializeTArray(S, a.NormalDelta);
+			}
+		}
+
+		bool bMeshData = p.MeshData.IsValid();
+		SerializeValue(S, bMeshData);
+		if (bMeshData && S.IsError() == false) {
+			if (S.Ar.IsLoading()) {
+				p.MeshData = MakeShareable(new FReturnedData());
+			}
+			auto& r = *p.MeshData;
+			SerializeValue(S, r.bSuccess);
+			SerializeValue(S, r.NumMeshes);
+			int32 Num = r.meshInfo.Num();
+			SerializeValue(S, Num);
+			if (S.Ar.IsLoading()) {
+				if (S.CheckNum(Num, sizeof(int32)) == false) {
+					return;
+				}
+				r.meshInfo.SetNum(Num);
+			}
+			for (auto& mi : r.meshInfo) {
+				SerializeTArray(S, mi.Vertices);
+				SerializeTArray(S, mi.Normals);
+				SerializeTArray(S, mi.Triangles);
+				SerializeTArray(S, mi.Triangles2);
+				int32 UVNum = mi.UV0.Num();
+				SerializeValue(S, UVNum);
+				if (S.Ar.IsLoading()) {
+					if (S.CheckNum(UVNum, sizeof(int32)) == false) {
+						return;
+					}
+					mi.UV0.SetNum(UVNum);
+				}
+				for (auto& uv : mi.UV0) {
+					SerializeTArray(S, uv);
+				}
+				SerializeTArray(S, mi.VertexColors);
+				SerializeTArray(S, mi.Tangents);
+				SerializeValue(S, mi.RelativeTransform);
+				SerializeTArray(S, mi.vertexUseFlag);
+				SerializeTArray(S, mi.vertexIndexOptTable);
+				SerializeValue(S, mi.useVertexCount);
+			}
+		}
+
+		SerializeValue(S, p.bWeightTable);
+		int32 WeightNum = p.WeightTable.Num();
+		SerializeValue(S, WeightNum);
+		if (S.Ar.IsLoading()) {
+			if (S.CheckNum(WeightNum, sizeof(int32)) == false) {
+				return;
+			}
+			for (int32 i = 0; i < WeightNum && S.IsError() == false; ++i) {
+				int32 Key = 0;
+				SerializeValue(S, Key);
+				SerializeWeight(S, p.WeightTable.FindOrAdd(Key));
+			}
+		} else {
+			for (auto& w : p.WeightTable) {
+				int32 Key = w.Key;
+				SerializeValue(S, Key);
+				SerializeWeight(S, w.Value);
+			}
+		}
+	}
+
+	// set by ReadVRMScene
+	void SerializeModelType(FCacheArchive& S, VRMConverter::Options& Opt) {
+		bool Type[] = { Opt.bbVRM0, Opt.bbVRM10, Opt.bbVRMA, Opt.bbBVH, Opt.bbPMX, Opt.bbNoMesh };
+		S.Ar.Serialize(Type, sizeof(Type));
+		if (S.Ar.IsLoading() && S.IsError() == false) {
+			Opt.bbVRM0 = Type[0];
+			Opt.bbVRM10 = Type[1];
+			Opt.bbVRMA = Type[2];
+			Opt.bbBVH = Type[3];
+			Opt.bbPMX = Type[4];
+			Opt.bbNoMesh = Type[5];
+		}
+	}
+}
+
+bool VRMLoadCache::IsEnabled() {
+	return CVarLoadCacheEnable.GetValueOnAnyThread() != 0;
+}
+
+FString VRMLoadCache::GetVersion(const FImportOptionData& Option) {
+	FString v = TEXT("0");
+	TSharedPtr<IPlugin> Plugin = IPluginManager::Get().FindPlugin(TEXT("VRM4U"));
+	if (Plugin.IsValid()) {
+		v = Plugin->GetDescriptor().VersionName;
+	}
+
+	// the scene and the mesh data depend on the options
+	FString OptionText;
+	FImportOptionData::StaticStruct()->ExportText(OptionText, &Option, nullptr, nullptr, PPF_None, nullptr);
+	return v + TEXT("|") + OptionText;
+}
+
+FString VRMLoadCache::MakeKey(const uint8* pData, size_t dataSize, const FString& Version) {
+	if (pData == nullptr || dataSize == 0) {
+		return FString();
+	}
+
+	uint8 Hash[20];
+	FSHA1::HashBuffer(pData, dataSize, Hash);
+
+	FSHA1 VersionHash;
+	const FString v = Version + TEXT("_") + FString::FromInt(CacheFormatVersion);
+	VersionHash.UpdateWithString(*v, v.Len());
+	VersionHash.Final();
+	uint8 VHash[20];
+	VersionHash.GetHash(VHash);
+
+	return BytesToHex(Hash, 20) + TEXT("_") + BytesToHex(VHash, 8);
+}
+
+aiScene* VRMLoadCache::Load(const FString& Key, VrmPreparedScene& Prepared, TArray<VRMUtil::FImportImage>& OutImage) {
+	TRACE_CPUPROFILER_EVENT_SCOPE(TEXT("VRMLoadCache Load"))
+
+	OutImage.Empty();
+	if (Key.IsEmpty()) {
+		return nullptr;
+	}
+
+	TArray<uint8> Data;
+	if (FFileHelper::LoadFileToArray(Data, *GetCachePath(Key), FILEREAD_Silent) == false) {
+		return nullptr;
+	}
+
+	FMemoryReader Ar(Data);
+	uint32 Magic = 0;
+	int32 Format = 0;
+	int32 RawSize = 0;
+	int32 CompressedSize = 0;
+	Ar << Magic << Format << RawSize << CompressedSize;
+	if (Ar.IsError() || Magic != CacheMagic || Format != CacheFormatVersion
+		|| RawSize < 0 || CompressedSize < 0 || Ar.Tell() + CompressedSize > Ar.TotalSize()) {
+		return nullptr;
+	}
+
+	TArray<uint8> Body;
+	Body.SetNumUninitialized(RawSize);
+	if (UncompressBlock(Body.GetData(), RawSize, Data.GetData() + Ar.Tell(), CompressedSize) == false) {
+		return nullptr;
+	}
+	Ar.Seek(Ar.Tell() + CompressedSize);
+
+	if (ReadImages(Ar, Data, OutImage) == false) {
+		OutImage.Empty();
+		return nullptr;
+	}
+
+	// the model type goes to Options only when the whole file is good
+	VRMConverter::Options Type;
+	aiScene* Scene = new aiScene();
+	{
+		FMemoryReader BodyAr(Body);
+		FCacheArchive S(BodyAr);
+		SerializeModelType(S, Type);
+		SerializeScene(S, *Scene);
+		SerializePrepared(S, Prepared);
+		if (S.IsError() || Scene->mRootNode == nullptr || (int32)Scene->mNumTextures != OutImage.Num()) {
+			FreeScene(Scene);
+			Prepared.Reset();
+			OutImage.Empty();
+			return nullptr;
+		}
+	}
+	auto& Opt = VRMConverter::Options::Get();
+	Opt.bbVRM0 = Type.bbVRM0;
+	Opt.bbVRM10 = Type.bbVRM10;
+	Opt.bbVRMA = Type.bbVRMA;
+	Opt.bbBVH = Type.bbBVH;
+	Opt.bbPMX = Type.bbPMX;
+	Opt.bbNoMesh = Type.bbNoMesh;
+
+	IFileManager::Get().SetTimeStamp(*GetCachePath(Key), FDateTime::UtcNow());
+	return Scene;
+}
+
+bool VRMLoadCache::Save(const FString& Key, const aiScene* Scene, const VrmPreparedScene& Prepared, const TArray<VRMUtil::FImportImage>& Image) {
+	TRACE_CPUPROFILER_EVENT_SCOPE(TEXT("VRMLoadCache Save"))
+
+	if (Key.IsEmpty() || Scene == nullptr) {
+		return false;
+	}
+
+	// the writer only reads them
+	TArray<uint8> Body;
+	{
+		FMemoryWriter BodyAr(Body);
+		FCacheArchive S(BodyAr);
+		SerializeModelType(S, VRMConverter::Options::Get());
+		SerializeScene(S, const_cast<aiScene&>(*Scene));
+		SerializePrepared(S, const_cast<VrmPreparedScene&>(Prepared));
+		if (S.IsError()) {
+			return false;
+		}
+	}
+	TArray<uint8> Compressed;
+	if (CompressBlock(Compressed, Body.GetData(), Body.Num()) == false) {
+		return false;
+	}
+
+	TArray<uint8> Data;
+	FMemoryWriter Ar(Data);
+	uint32 Magic = CacheMagic;
+	int32 Format = CacheFormatVersion;
+	int32 RawSize = Body.Num();
+	int32 CompressedSize = Compressed.Num();
+	Ar << Magic << Format << RawSize << CompressedSize;
+	Ar.Serialize(Compressed.GetData(), CompressedSize);
+	WriteImages(Ar, Image);
+
+	// write then rename, so that a load running at the same time never reads half a file
+	const FString Path = GetCachePath(Key);
+	const FString TmpPath = Path + FString::Printf(TEXT(".%u.tmp"), FPlatformTLS::GetCurrentThreadId());
+	if (FFileHelper::SaveArrayToFile(Data, *TmpPath) == false) {
+		return false;
+	}
+	if (IFileManager::Get().Move(*Path, *TmpPath, true, true) == false) {
+		IFileManager::Get().Delete(*TmpPath, false, false, true);
+		return false;
+	}
+	UE_LOG(LogVRM4ULoader, Log, TEXT("VRM4U LoadCache: saved %s (%lld bytes)"), *Path, (int64)Data.Num());
+	TrimCacheDir(Path);
+	return true;
+}
+
+void VRMLoadCache::FreeScene(aiScene*& Scene) {
+	if (Scene == nullptr) {
+		return;
+	}
+
+	TFunction<void(aiNode*)> FreeNode = [&FreeNode](aiNode* n) {
+		if (n == nullptr) {
+			return;
+		}
+		if (n->mChildren) {
+			for (uint32 c = 0; c < n->mNumChildren; ++c) {
+				FreeNode(n->mChildren[c]);
+			}
+		}
+		FreeArray(n->mChildren);
+		n->mNumChildren = 0;
+		FreeArray(n->mMeshes);
+		n->mNumMeshes = 0;
+		delete n;
+	};
+	FreeNode(Scene->mRootNode);
+	Scene->mRootNode = nullptr;
+
+	if (Scene->mMeshes) {
+		for (uint32 i = 0; i < Scene->mNumMeshes; ++i) {
+			aiMesh* m = Scene->mMeshes[i];
+			if (m == nullptr) {
+				continue;
+			}
+			FreeArray(m->mVertices);
+			FreeArray(m->mNormals);
+			FreeArray(m->mTangents);
+			FreeArray(m->mBitangents);
+			for (auto& c : m->mColors) {
+				FreeArray(c);
+			}
+			for (auto& t : m->mTextureCoords) {
+				FreeArray(t);
+			}
+			if (m->mFaces) {
+				for (uint32 f = 0; f < m->mNumFaces; ++f) {
+					FreeArray(m->mFaces[f].mIndices);
+				}
+				FreeArray(m->mFaces);
+			}
+			if (m->mBones) {
+				for (uint32 b = 0; b < m->mNumBones; ++b) {
+					if (m->mBones[b]) {
+						FreeArray(m->mBones[b]->mWeights);
+						FreeArray(m->mBones[b]);
+					}
+				}
+				FreeArray(m->mBones);
+			}
+			if (m->mAnimMeshes) {
+				for (uint32 a = 0; a < m->mNumAnimMeshes; ++a) {
+					aiAnimMesh* am = m->mAnimMeshes[a];
+					if (am == nullptr) {
+						continue;
+					}
+					FreeArray(am->mVertices);
+					FreeArray(am->mNormals);
+					FreeArray(am->mTangents);
+					FreeArray(am->mBitangents);
+					for (auto& c : am->mColors) {
+						FreeArray(c);
+					}
+					for (auto& t : am->mTextureCoords) {
+						FreeArray(t);
+					}
+					FreeArray(am);
+				}
+				FreeArray(m->mAnimMeshes);
+			}
+			FreeArray(m);
+		}
+		FreeArray(Scene->mMeshes);
+	}
+	Scene->mNumMeshes = 0;
+
+	if (Scene->mMaterials) {
+		for (uint32 i = 0; i < Scene->mNumMaterials; ++i) {
+			delete Scene->mMaterials[i];
+		}
+		FreeArray(Scene->mMaterials);
+	}
+	Scene->mNumMaterials = 0;
+
+	if (Scene->mTextures) {
+		for (uint32 i = 0; i < Scene->mNumTextures; ++i) {
+			if (Scene->mTextures[i]) {
+				FreeArray(Scene->mTextures[i]->pcData);
+				FreeArray(Scene->mTextures[i]);
+			}
+		}
+		FreeArray(Scene->mTextures);
+	}
+	Scene->mNumTextures = 0;
+
+	if (Scene->mAnimations) {
+		for (uint32 i = 0; i < Scene->mNumAnimations; ++i) {
+			aiAnimation* a = Scene->mAnimations[i];
+			if (a == nullptr) {
+				continue;
+			}
+			if (a->mChannels) {
+				for (uint32 c = 0; c < a->mNumChannels; ++c) {
+					if (a->mChannels[c]) {
+						FreeArray(a->mChannels[c]->mPositionKeys);
+						FreeArray(a->mChannels[c]->mRotationKeys);
+						FreeArray(a->mChannels[c]->mScalingKeys);
+						FreeArray(a->mChannels[c]);
+					}
+				}
+				FreeArray(a->mChannels);
+			}
+			if (a->mMeshChannels) {
+				for (uint32 c = 0; c < a->mNumMeshChannels; ++c) {
+					if (a->mMeshChannels[c]) {
+						FreeArray(a->mMeshChannels[c]->mKeys);
+						FreeArray(a->mMeshChannels[c]);
+					}
+				}
+				FreeArray(a->mMeshChannels);
+			}
+			if (a->mMorphMeshChannels) {
+				for (uint32 c = 0; c < a->mNumMorphMeshChannels; ++c) {
+					aiMeshMorphAnim* ma = a->mMorphMeshChannels[c];
+					if (ma == nullptr) {
+						continue;
+					}
+					if (ma->mKeys) {
+						for (uint32 k = 0; k < ma->mNumKeys; ++k) {
+							FreeArray(ma->mKeys[k].mValues);
+							FreeArray(ma->mKeys[k].mWeights);
+						}
+						FreeArray(ma->mKeys);
+					}
+					FreeArray(ma);
+				}
+				FreeArray(a->mMorphMeshChannels);
+			}
+			FreeArray(a);
+		}
+		FreeArray(Scene->mAnimations);
+	}
+	Scene->mNumAnimations = 0;
+
+	FreeMeta(static_cast<VRM::VRMMetadata*>(Scene->mVRMMeta));
+	Scene->mVRMMeta = nullptr;
+
+	// only what the assimp constructor made is left
+	delete Scene;
+	Scene = nullptr;
+}
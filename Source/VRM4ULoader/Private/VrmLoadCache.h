@@ -0,0 +1,35 @@
+// VRM4U Copyright (c) 2021-2024 Haruyoshi Yamamoto. This software is released under the MIT License.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "VrmUtil.h"
+
+struct aiScene;
+class VrmPreparedScene;
+
+// on-disk cache for runtime loads. Saved/VRM4U/LoadCache/<key>.vrmcache
+// holds the parsed scene and the model type, the mesh, morph and weight data of VrmPreparedScene
+// and the decoded texture images, so that a hit skips the assimp parse, Prepare and the texture decode.
+// vrm4u.LoadCache.MaxMB caps the directory size, least recently used files go first.
+class VRMLoadCache {
+public:
+	// vrm4u.LoadCache.Enable. any thread
+	static bool IsEnabled();
+
+	// game thread. plugin version and import options part of the key
+	static FString GetVersion(const FImportOptionData& Option);
+
+	// any thread. hash of the file content and Version
+	static FString MakeKey(const uint8* pData, size_t dataSize, const FString& Version);
+
+	// any thread. nullptr if no cache or the cache is broken. free the scene with FreeScene.
+	// Prepared gets all but the json. sets the model type of Options::Get() as ReadVRMScene does
+	static aiScene* Load(const FString& Key, VrmPreparedScene& Prepared, TArray<VRMUtil::FImportImage>& OutImage);
+
+	// any thread. Scene is the one after Prepare, the vertex optimize is already applied
+	static bool Save(const FString& Key, const aiScene* Scene, const VrmPreparedScene& Prepared, const TArray<VRMUtil::FImportImage>& Image);
+
+	// the scene of Load. no assimp destructor frees what this module allocated
+	static void FreeScene(aiScene*& Scene);
+};
@@ -431,6 +431,11 @@ UTexture2D* VRMLoaderUtil::CreateTextureFromImage(FString name, UPackage* packag
 	if (VRMLoaderUtil::LoadImageFromMemory(Buffer, Length, img) == false) {
 		return nullptr;
 	}
+	return CreateTextureFromImage(name, package, img, bGenerateMips, bNormal, bGreenFlip);
+}
+
+UTexture2D* VRMLoaderUtil::CreateTextureFromImage(FString name, UPackage* package, const VRMUtil::FImportImage& img, bool bGenerateMips, bool bNormal, bool bGreenFlip) {
+
 	UTexture2D *tex = CreateTexture(img.SizeX, img.SizeY, name, package);
 
 	if (tex == nullptr) {
@@ -505,7 +510,7 @@ UTexture2D* VRMLoaderUtil::CreateTextureFromImage(FString name, UPackage* packag
 	{
 		// alpha check
 		bool noAlpha = true;
-		uint8 *p = img.RawData.GetData();
+		const uint8 *p = img.RawData.GetData();
 		for (int y = 0; y < img.SizeY; ++y) {
 			for (int x = 0; x < img.SizeX; ++x) {
 				if (p[(x + y * img.SizeX) * 4 + 3] != 255) {
@@ -7,6 +7,10 @@
 #include "VrmUtil.h"
 #include "LoaderBPFunctionLibrary.generated.h"
 
+namespace Assimp {
+	class Importer;
+}
+
 UENUM(BlueprintType)
 enum class EPathType : uint8
 {
@@ -92,12 +96,29 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "VRM4U", meta = (Latent, DynamicOutputParam = "OutVrmAsset", WorldContext = "WorldContextObject", LatentInfo = "LatentInfo"))
 	static void LoadVRMFileAsync(const UObject* WorldContextObject, const class UVrmAssetListObject* InVrmAsset, class UVrmAssetListObject*& OutVrmAsset, const FString filepath, const FImportOptionData& OptionForRuntimeLoad, struct FLatentActionInfo LatentInfo);
 
+	// same file and options return the same asset set from the runtime asset cache. do not modify it. call ReleaseVRMFileShared when done
+	UFUNCTION(BlueprintCallable, Category = "VRM4U", meta = (DynamicOutputParam = "OutVrmAsset"))
+	static bool LoadVRMFileShared(const class UVrmAssetListObject* InVrmAsset, class UVrmAssetListObject*& OutVrmAsset, const FString filepath, const FImportOptionData& OptionForRuntimeLoad);
+
+	UFUNCTION(BlueprintCallable, Category = "VRM4U", meta = (Latent, DynamicOutputParam = "OutVrmAsset", WorldContext = "WorldContextObject", LatentInfo = "LatentInfo"))
+	static void LoadVRMFileSharedAsync(const UObject* WorldContextObject, const class UVrmAssetListObject* InVrmAsset, class UVrmAssetListObject*& OutVrmAsset, const FString filepath, const FImportOptionData& OptionForRuntimeLoad, struct FLatentActionInfo LatentInfo);
+
+	UFUNCTION(BlueprintCallable, Category = "VRM4U")
+	static void ReleaseVRMFileShared(const class UVrmAssetListObject* VrmAsset);
+
 
 	static bool LoadVRMFileLocal(const class UVrmAssetListObject* InVrmAsset, class UVrmAssetListObject*& OutVrmAsset, const FString filepath);
 
 	static bool LoadVRMFileFromMemoryDefaultOption(UVrmAssetListObject*& OutVrmAsset, const FString filepath, const uint8* pData, size_t dataSize);
 	static bool LoadVRMFileFromMemory(const UVrmAssetListObject* InVrmAsset, UVrmAssetListObject*& OutVrmAsset, const FString filepath, const uint8* pFileData, size_t dataSize);
 
+	// parse with the flags LoadVRMFileFromMemory uses, and set the model type option. the scene is owned by Importer
+	static const aiScene* ReadVRMScene(Assimp::Importer& Importer, const FString filepath, const uint8* pFileData, size_t dataSize);
+	// convert a scene from ReadVRMScene. pFileData is the same bytes the scene was parsed from
+	// converts into OutVrmAsset if set. textures already in it are kept when the count matches the scene
+	// pPrepared is optional, made by VrmPreparedScene::Prepare from the same scene. its json is moved to the converter
+	static bool LoadVRMFileFromScene(const UVrmAssetListObject* InVrmAsset, UVrmAssetListObject*& OutVrmAsset, const FString filepath, const uint8* pFileData, size_t dataSize, const aiScene* pScene, VrmPreparedScene* pPrepared = nullptr);
+
 	static void SetImportMode(bool bImportMode, class UPackage *package);
 
 	//static void SetCopySkeletalMeshAnimation(bool bImportMode, class UPackage *package);
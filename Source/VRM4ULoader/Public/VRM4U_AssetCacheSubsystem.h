@@ -0,0 +1,119 @@
+// VRM4U Copyright (c) 2021-2024 Haruyoshi Yamamoto. This software is released under the MIT License.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/EngineSubsystem.h"
+#include "Misc/EngineVersionComparison.h"
+#include "VRM4U_AssetCacheSubsystem.generated.h"
+
+
+#if	UE_VERSION_OLDER_THAN(4,22,0)
+
+//Couldn't find parent type for 'VRM4U_AssetCacheSubsystem' named 'UEngineSubsystem'
+#error "please remove VRM4U_AssetCacheSubsystem.h/cpp  for <=UE4.21"
+
+#endif
+
+class UVrmAssetListObject;
+struct FImportOptionData;
+
+USTRUCT()
+struct FVrmAssetCacheEntry {
+	GENERATED_USTRUCT_BODY()
+
+public:
+	UPROPERTY()
+	UVrmAssetListObject* Asset = nullptr;
+
+	FString Key;
+	// RF_Standalone objects created for Asset. the flag is cleared on eviction, then GC collects the set
+	TArray<TWeakObjectPtr<UObject>> StandaloneObjects;
+	int32 RefCount = 0;
+	int64 Bytes = 0;
+	double LastUseTime = 0.0;
+};
+
+USTRUCT(BlueprintType)
+struct FVrmAssetCacheStats {
+	GENERATED_USTRUCT_BODY()
+
+public:
+	UPROPERTY(BlueprintReadOnly, Category = VRM4U)
+	int32 Entries = 0;
+
+	// entries not released yet
+	UPROPERTY(BlueprintReadOnly, Category = VRM4U)
+	int32 Referenced = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = VRM4U)
+	float SizeMB = 0.f;
+
+	UPROPERTY(BlueprintReadOnly, Category = VRM4U)
+	int32 Hits = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = VRM4U)
+	int32 Misses = 0;
+};
+
+// runtime cache of loaded asset sets, for LoadVRMFileShared / LoadVRMFileSharedAsync.
+// the same file and options return the same mesh, textures and materials. do not modify them.
+// released entries stay until the total goes over vrm4u.AssetCache.BudgetMB, oldest first.
+// game thread only.
+UCLASS()
+class VRM4ULOADER_API UVRM4U_AssetCacheSubsystem : public UEngineSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	static UVRM4U_AssetCacheSubsystem* Get();
+
+	// file path, size and time stamp, template asset and options
+	static FString MakeKey(const FString& filepath, const UVrmAssetListObject* InVrmAsset, const FImportOptionData& Option);
+
+	// adds a reference. nullptr if not cached
+	UVrmAssetListObject* Acquire(const FString& Key);
+
+	// adds with one reference. if Key was added meanwhile, returns that entry with a reference added instead, and Asset is released.
+	// StandaloneObjects are the RF_Standalone objects of the conversion, from VRMConverter::Options::StandaloneObjects
+	UVrmAssetListObject* Add(const FString& Key, UVrmAssetListObject* Asset, const TArray<TWeakObjectPtr<UObject>>& StandaloneObjects);
+
+	// a request is converting Key. the others with the same key wait for it and Acquire its result
+	bool IsLoading(const FString& Key) const;
+	// false if another request is loading Key
+	bool BeginLoad(const FString& Key);
+	// ends BeginLoad. Asset is added as Add does. nullptr on failure, then a waiting request loads by itself
+	UVrmAssetListObject* EndLoad(const FString& Key, UVrmAssetListObject* Asset, const TArray<TWeakObjectPtr<UObject>>& StandaloneObjects);
+
+	// clear RF_Standalone of a runtime loaded set, so that GC collects it once unreferenced. sets in asset packages are not touched
+	static void ReleaseStandalone(UVrmAssetListObject* Asset, const TArray<TWeakObjectPtr<UObject>>& StandaloneObjects);
+
+	UFUNCTION(BlueprintCallable, Category = VRM4U)
+	void Release(const UVrmAssetListObject* Asset);
+
+	// evict released entries, oldest first, until under the budget
+	UFUNCTION(BlueprintCallable, Category = VRM4U)
+	void Trim();
+
+	// evict all released entries
+	UFUNCTION(BlueprintCallable, Category = VRM4U)
+	void Flush();
+
+	UFUNCTION(BlueprintCallable, Category = VRM4U)
+	FVrmAssetCacheStats GetStats() const;
+
+	virtual void Deinitialize() override;
+
+private:
+	void Evict(int64 Budget);
+
+	UPROPERTY()
+	TArray<FVrmAssetCacheEntry> Entries;
+
+	// keys between BeginLoad and EndLoad
+	TSet<FString> Loading;
+
+	int32 Hits = 0;
+	int32 Misses = 0;
+};
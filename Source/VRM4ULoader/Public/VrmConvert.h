@@ -40,6 +40,55 @@ class UVrm1LicenseObject;
 class UPackage;
 
 
+// scene data that needs no UObject. built on a loader worker thread, VRMConverter uses it instead of reading the scene again
+struct FReturnedData;
+
+class VRM4ULOADER_API VrmPreparedScene {
+public:
+	struct MorphSource {
+		// unreal axis and cm, before the root bone rotation and model scale. empty if the anim mesh has no positions
+		TArray<FVector> PositionDelta;
+		// TangentZDelta as it is. empty if morph target normal is disabled
+		TArray<FVector> NormalDelta;
+	};
+	struct WeightData {
+		FString boneName;
+		float weight = 0;
+	};
+
+	VrmJson jsonData;
+	bool bJson = false;
+
+	// [mesh][anim mesh]
+	TArray<TArray<MorphSource>> Morph;
+
+	// vertex, normal, uv and index of ConvertModel. the vertex optimize is already applied to the scene
+	TSharedPtr<FReturnedData> MeshData;
+
+	// key is the vertex index over all meshes, after the vertex optimize. bone name is normalized
+	TMap<int, TArray<WeightData> > WeightTable;
+	bool bWeightTable = false;
+
+	// needs OptionsScope of the request, the model type is already set by ReadVRMScene
+	void Prepare(const uint8* pFileData, size_t dataSize, const aiScene* pScene);
+	// json only, for a VRMLoadCache hit
+	void PrepareJson(const uint8* pFileData, size_t dataSize);
+	void Reset();
+
+	const MorphSource* FindMorph(uint32_t meshNo, uint32_t animNo) const {
+		if (Morph.IsValidIndex(meshNo) && Morph[meshNo].IsValidIndex(animNo)) {
+			return &Morph[meshNo][animNo];
+		}
+		return nullptr;
+	}
+
+	static void MakeMorphSource(MorphSource& out, const aiMesh& aiM, const aiAnimMesh& aiA, bool bVRM10, bool bIncludeNormal);
+	static void MakeWeightTable(TMap<int, TArray<WeightData> >& out, const aiScene* pScene);
+	// rewrites the face and weight index of pScene when the vertex optimize is enabled
+	static void MakeMeshData(FReturnedData& out, const aiScene* pScene);
+};
+
+
 class VRM4ULOADER_API VRMConverter {
 
 	bool InitJSON(const uint8* pData, size_t pFileDataSize);
@@ -48,6 +97,8 @@ public:
 
 	VrmJson jsonData;
 	const aiScene* aiData = nullptr;
+	// optional. morph and weight data from the worker
+	const VrmPreparedScene* Prepared = nullptr;
 
 	char* GetMatName(int matNo) const;
 	char* GetMatShaderName(int matNo) const;
@@ -68,6 +119,8 @@ public:
 	static bool NormalizeBoneName(const aiScene *mScenePtr);
 
 	bool Init(const uint8* pFileData, size_t dataSize, const aiScene*);
+	// takes the json of pPrepared instead of parsing pFileData again
+	bool Init(const uint8* pFileData, size_t dataSize, const aiScene*, VrmPreparedScene* pPrepared);
 	bool ValidateSchema();
 
 	bool ConvertTextureAndMaterial(UVrmAssetListObject *vrmAssetList);
@@ -95,6 +148,23 @@ public:
 			ImportOption = p;
 		}
 
+		// set by the shared loads. RF_Standalone objects of VRM4U_NewObject and the duplicate functions are added,
+		// so that UVRM4U_AssetCacheSubsystem can clear the flag when the set leaves the cache
+		TArray<TWeakObjectPtr<UObject>>* StandaloneObjects = nullptr;
+		void AddStandaloneObject(UObject* o) {
+			if (StandaloneObjects && o && o->HasAnyFlags(RF_Standalone)) {
+				StandaloneObjects->Add(o);
+			}
+		}
+
+		// model type of the file being converted
+		bool bbVRM0 = false;
+		bool bbVRM10 = false;
+		bool bbVRMA = false;
+		bool bbBVH = false;
+		bool bbPMX = false;
+		bool bbNoMesh = false;
+
 		class USkeleton *GetSkeleton();
 		bool IsSimpleRootBone() const;
 
@@ -191,12 +261,22 @@ public:
 		EVRMImportMaterialType GetMaterialType() const;
 		void SetMaterialType(EVRMImportMaterialType type);
 	};
+
+	// Options::Get() returns o on this thread while the scope is alive
+	class VRM4ULOADER_API OptionsScope {
+		Options* Prev = nullptr;
+	public:
+		OptionsScope(Options& o);
+		~OptionsScope();
+	};
 };
 
 class VRM4ULOADER_API VRMLoaderUtil {
 public:
 	static UTexture2D* CreateTexture(int32 InSizeX, int32 InSizeY, FString name, UPackage* package);
 	static UTexture2D* CreateTextureFromImage(FString name, UPackage* package, const void* Buffer, const size_t Length, bool GenerateMip = false, bool bNormal = false, bool bNormalGreenFlip = false);
+	// image decoded by LoadImageFromMemory. decode can run on any thread, texture creation is game thread
+	static UTexture2D* CreateTextureFromImage(FString name, UPackage* package, const VRMUtil::FImportImage& Image, bool GenerateMip = false, bool bNormal = false, bool bNormalGreenFlip = false);
 
 	static bool LoadImageFromMemory(const void* Buffer, const size_t Length, VRMUtil::FImportImage& OutImage);
 };
@@ -219,6 +299,7 @@ T* VRM4U_NewObject(UObject* Outer, FName Name, EObjectFlags Flags = RF_NoFlags,
 	}
 	decltype(auto) r = NewObject<T>(pkg, Name, Flags, Template, bCopyTransientsFromClassDefaults, InInstanceGraph);
 	r->MarkPackageDirty();
+	VRMConverter::Options::Get().AddStandaloneObject(r);
 	return r;
 }
 
@@ -230,6 +311,7 @@ T* VRM4U_NewObject(UObject* Outer, UClass* Class, FName Name, EObjectFlags Flags
 	}
 	decltype(auto) r = NewObject<T>(pkg, Class, Name, Flags, Template, bCopyTransientsFromClassDefaults, InInstanceGraph);
 	r->MarkPackageDirty();
+	VRMConverter::Options::Get().AddStandaloneObject(r);
 	return r;
 }
 
@@ -241,6 +323,7 @@ T* VRM4U_DuplicateObject(const T *src, UPackage* Outer, FName Name) {
 	}
 	decltype(auto) r = DuplicateObject<T>(src, pkg, Name);
 	r->MarkPackageDirty();
+	VRMConverter::Options::Get().AddStandaloneObject(r);
 	return r;
 }
 
@@ -5,6 +5,7 @@
 #define RAPIDJSON_NAMESPACE_END } } }
 
 #include <vector>
+#include <utility>
 #include "rapidjson/document.h"
 
 class VrmJson {
@@ -19,4 +20,10 @@ public:
 	bool IsEnable() const{
 		return bEnable;
 	}
+
+	// exchange the parsed document. used to hand a document parsed on a worker to the converter
+	void Swap(VrmJson& other) {
+		doc.Swap(other.doc);
+		std::swap(bEnable, other.bEnable);
+	}
 };